@@ -22,6 +22,10 @@ static const char* kMipmapDir = "mipmap";
 static const char* kInvalidChars = "/\\:";
 static const size_t kMaxAssetFileName = 100;
 
+// Bounds on the size of each chunk a chunked AaptFile allocates.
+static const size_t kMinDataChunk = 4*1024;
+static const size_t kMaxDataChunk = 64*1024;
+
 static const String8 kResString(kResourceDir);
 
 /*
@@ -62,7 +66,9 @@ const char * const gDefaultIgnoreAssets =
 // The ignore pattern that can be passed via --ignore-assets in Main.cpp
 const char * gUserIgnoreAssets = NULL;
 
-static bool isHidden(const char *root, const char *path)
+// "type" is the type of the file "path" names.  With "quiet", nothing is
+// printed, so that the scanning threads can ask too.
+static bool isHidden(const char *path, FileType type, bool quiet = false)
 {
     // Patterns syntax:
     // - Delimiter is :
@@ -95,16 +101,19 @@ static bool isHidden(const char *root, const char *path)
     bool chatty = true;
     char *matchedPattern = NULL;
 
-    String8 fullPath(root);
-    fullPath.appendPath(path);
-    FileType type = getFileType(fullPath);
-
     int plen = strlen(path);
 
-    // Note: we don't have strtok_r under mingw.
-    for(char *token = strtok(patterns, delim);
-            !ignore && token != NULL;
-            token = strtok(NULL, delim)) {
+    // Note: we don't have strtok_r under mingw, and strtok() can't be used
+    // from several threads, so split the patterns up by hand.
+    char *next = patterns;
+    while (!ignore && next != NULL) {
+        char *token = next;
+        next = strpbrk(next, delim);
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+        if (token[0] == '\0') continue;
+
         chatty = token[0] != '!';
         if (!chatty) token++; // skip !
         if (strncasecmp(token, "<dir>" , 5) == 0) {
@@ -134,7 +143,7 @@ static bool isHidden(const char *root, const char *path)
         }
     }
 
-    if (ignore && chatty) {
+    if (ignore && chatty && !quiet) {
         fprintf(stderr, "    (skipping %s '%s' due to ANDROID_AAPT_IGNORE pattern '%s')\n",
                 type == kFileTypeDirectory ? "dir" : "file",
                 path,
@@ -442,6 +451,9 @@ AaptGroupEntry::toDirName(const String8& resType) const
 
 void* AaptFile::editData(size_t size)
 {
+    if (joinData() != NO_ERROR) {
+        return NULL;
+    }
     if (size <= mBufferSize) {
         mDataSize = size;
         return mData;
@@ -464,6 +476,9 @@ void* AaptFile::editDataInRange(size_t offset, size_t size)
 
 void* AaptFile::editData(size_t* outSize)
 {
+    if (joinData() != NO_ERROR) {
+        return NULL;
+    }
     if (outSize) {
         *outSize = mDataSize;
     }
@@ -472,6 +487,9 @@ void* AaptFile::editData(size_t* outSize)
 
 void* AaptFile::padData(size_t wordSize)
 {
+    if (joinData() != NO_ERROR) {
+        return NULL;
+    }
     const size_t extra = mDataSize%wordSize;
     if (extra == 0) {
         return mData;
@@ -487,7 +505,42 @@ void* AaptFile::padData(size_t wordSize)
 
 status_t AaptFile::writeData(const void* data, size_t size)
 {
-    size_t end = mDataSize;
+    if (mChunked) {
+        const uint8_t* src = (const uint8_t*)data;
+        while (size > 0) {
+            if (mChunks.isEmpty() || mChunks.top().size == mChunks.top().capacity) {
+                // Size new chunks at half of what we hold so far, like
+                // the slack editData() leaves, but without recopying.
+                size_t capacity = getSize()/2;
+                if (capacity < kMinDataChunk) {
+                    capacity = kMinDataChunk;
+                } else if (capacity > kMaxDataChunk) {
+                    capacity = kMaxDataChunk;
+                }
+                Chunk chunk;
+                chunk.data = (uint8_t*)malloc(capacity);
+                if (chunk.data == NULL) {
+                    return UNKNOWN_ERROR;
+                }
+                chunk.size = 0;
+                chunk.capacity = capacity;
+                mChunks.add(chunk);
+            }
+            Chunk& chunk = mChunks.editTop();
+            size_t count = chunk.capacity - chunk.size;
+            if (count > size) {
+                count = size;
+            }
+            memcpy(chunk.data + chunk.size, src, count);
+            chunk.size += count;
+            mChunkedSize += count;
+            src += count;
+            size -= count;
+        }
+        return NO_ERROR;
+    }
+
+    size_t end = getSize();
     size_t total = size + end;
     void* buf = editData(total);
     if (buf == NULL) {
@@ -503,6 +556,75 @@ void AaptFile::clearData()
     mData = NULL;
     mDataSize = 0;
     mBufferSize = 0;
+    freeChunks();
+}
+
+status_t AaptFile::reserveData(size_t size)
+{
+    status_t err = joinData();
+    if (err != NO_ERROR) {
+        return err;
+    }
+    if (size <= mBufferSize) {
+        return NO_ERROR;
+    }
+    void* buf = realloc(mData, size);
+    if (buf == NULL) {
+        return NO_MEMORY;
+    }
+    mData = buf;
+    mBufferSize = size;
+    return NO_ERROR;
+}
+
+void AaptFile::getChunks(Vector<ZipFile::DataChunk>* outChunks) const
+{
+    // The flat part always goes first, even when empty, so that there is
+    // at least one chunk to hand out.
+    ZipFile::DataChunk chunk;
+    chunk.data = mData;
+    chunk.size = mDataSize;
+    outChunks->clear();
+    outChunks->setCapacity(mChunks.size() + 1);
+    outChunks->add(chunk);
+    for (size_t i = 0; i < mChunks.size(); i++) {
+        chunk.data = mChunks[i].data;
+        chunk.size = mChunks[i].size;
+        outChunks->add(chunk);
+    }
+}
+
+status_t AaptFile::joinData()
+{
+    if (mChunks.isEmpty()) {
+        return NO_ERROR;
+    }
+    const size_t total = mDataSize + mChunkedSize;
+    if (total > mBufferSize) {
+        void* buf = realloc(mData, total);
+        if (buf == NULL) {
+            return NO_MEMORY;
+        }
+        mData = buf;
+        mBufferSize = total;
+    }
+    uint8_t* pos = ((uint8_t*)mData) + mDataSize;
+    for (size_t i = 0; i < mChunks.size(); i++) {
+        memcpy(pos, mChunks[i].data, mChunks[i].size);
+        pos += mChunks[i].size;
+    }
+    mDataSize = total;
+    freeChunks();
+    return NO_ERROR;
+}
+
+void AaptFile::freeChunks()
+{
+    for (size_t i = 0; i < mChunks.size(); i++) {
+        free(mChunks[i].data);
+    }
+    mChunks.clear();
+    mChunkedSize = 0;
 }
 
 String8 AaptFile::getPrintableSource() const
@@ -653,42 +775,53 @@ status_t AaptDir::addLeafFile(const String8& leafName, const sp<AaptFile>& file,
     return group->addFile(file, overwrite);
 }
 
+/*
+ * Keeps the scanner out of the directories isHidden() would skip anyway.
+ */
+class HiddenDirFilter : public DirectoryScanner::Filter {
+public:
+    virtual bool wantDir(const String8& /* dirPath */, const char* name) {
+        return !isHidden(name, kFileTypeDirectory, true);
+    }
+};
+
 ssize_t AaptDir::slurpFullTree(Bundle* bundle, const String8& srcDir,
                             const AaptGroupEntry& kind, const String8& resType,
                             sp<FilePathStore>& fullResPaths, const bool overwrite)
 {
-    Vector<String8> fileNames;
-    {
-        DIR* dir = NULL;
-
-        dir = opendir(srcDir.string());
-        if (dir == NULL) {
-            fprintf(stderr, "ERROR: opendir(%s): %s\n", srcDir.string(), strerror(errno));
-            return UNKNOWN_ERROR;
-        }
-
-        /*
-         * Slurp the filenames out of the directory.
-         */
-        while (1) {
-            struct dirent* entry;
+    // Read the whole tree up front, then build it up from what was read.
+    SystemDirectoryWalker walker;
+    HiddenDirFilter filter;
+    DirectoryScanner scanner(&walker, bundle->getJobs());
+    const DirectoryScanner::Dir* dir = scanner.scan(srcDir, &filter);
+    return slurpScannedTree(bundle, dir, kind, resType, fullResPaths, overwrite);
+}
 
-            entry = readdir(dir);
-            if (entry == NULL)
-                break;
+ssize_t AaptDir::slurpScannedTree(Bundle* bundle, const DirectoryScanner::Dir* dir,
+                            const AaptGroupEntry& kind, const String8& resType,
+                            sp<FilePathStore>& fullResPaths, const bool overwrite)
+{
+    const String8& srcDir = dir->path;
+    if (dir->error != 0) {
+        fprintf(stderr, "ERROR: opendir(%s): %s\n", srcDir.string(), strerror(dir->error));
+        return UNKNOWN_ERROR;
+    }
 
-            if (isHidden(srcDir.string(), entry->d_name))
-                continue;
+    /*
+     * Pick out the entries we want.
+     */
+    Vector<const DirectoryScanner::Entry*> entries;
+    for (size_t i = 0; i < dir->entries.size(); i++) {
+        const DirectoryScanner::Entry& entry = dir->entries[i];
+        if (isHidden(entry.name.string(), entry.type))
+            continue;
 
-            String8 name(entry->d_name);
-            fileNames.add(name);
-            // Add fully qualified path for dependency purposes
-            // if we're collecting them
-            if (fullResPaths != NULL) {
-                fullResPaths->add(srcDir.appendPathCopy(name));
-            }
+        entries.add(&entry);
+        // Add fully qualified path for dependency purposes
+        // if we're collecting them
+        if (fullResPaths != NULL) {
+            fullResPaths->add(srcDir.appendPathCopy(entry.name));
         }
-        closedir(dir);
     }
 
     ssize_t count = 0;
@@ -696,35 +829,35 @@ ssize_t AaptDir::slurpFullTree(Bundle* bundle, const String8& srcDir,
     /*
      * Stash away the files and recursively descend into subdirectories.
      */
-    const size_t N = fileNames.size();
+    const size_t N = entries.size();
     size_t i;
     for (i = 0; i < N; i++) {
+        const String8& fileName = entries[i]->name;
         String8 pathName(srcDir);
-        FileType type;
+        FileType type = entries[i]->type;
 
-        pathName.appendPath(fileNames[i].string());
-        type = getFileType(pathName.string());
-        if (type == kFileTypeDirectory) {
+        pathName.appendPath(fileName.string());
+        if (type == kFileTypeDirectory && entries[i]->dir != NULL) {
             sp<AaptDir> subdir;
             bool notAdded = false;
-            if (mDirs.indexOfKey(fileNames[i]) >= 0) {
-                subdir = mDirs.valueFor(fileNames[i]);
+            if (mDirs.indexOfKey(fileName) >= 0) {
+                subdir = mDirs.valueFor(fileName);
             } else {
-                subdir = new AaptDir(fileNames[i], mPath.appendPathCopy(fileNames[i]));
+                subdir = new AaptDir(fileName, mPath.appendPathCopy(fileName));
                 notAdded = true;
             }
-            ssize_t res = subdir->slurpFullTree(bundle, pathName, kind,
-                                                resType, fullResPaths, overwrite);
+            ssize_t res = subdir->slurpScannedTree(bundle, entries[i]->dir, kind,
+                                                   resType, fullResPaths, overwrite);
             if (res < NO_ERROR) {
                 return res;
             }
             if (res > 0 && notAdded) {
-                mDirs.add(fileNames[i], subdir);
+                mDirs.add(fileName, subdir);
             }
             count += res;
         } else if (type == kFileTypeRegular) {
             sp<AaptFile> file = new AaptFile(pathName, kind, resType);
-            status_t err = addLeafFile(fileNames[i], file, overwrite);
+            status_t err = addLeafFile(fileName, file, overwrite);
             if (err != NO_ERROR) {
                 return err;
             }
@@ -1132,9 +1265,14 @@ ssize_t AaptAssets::slurpResourceTree(Bundle* bundle, const String8& srcDir)
 {
     ssize_t err = 0;
 
-    DIR* dir = opendir(srcDir.string());
-    if (dir == NULL) {
-        fprintf(stderr, "ERROR: opendir(%s): %s\n", srcDir.string(), strerror(errno));
+    // Read every resource directory at once; they are looked at in order
+    // below.
+    SystemDirectoryWalker walker;
+    HiddenDirFilter filter;
+    DirectoryScanner scanner(&walker, bundle->getJobs());
+    const DirectoryScanner::Dir* scanned = scanner.scan(srcDir, &filter);
+    if (scanned->error != 0) {
+        fprintf(stderr, "ERROR: opendir(%s): %s\n", srcDir.string(), strerror(scanned->error));
         return UNKNOWN_ERROR;
     }
 
@@ -1144,25 +1282,22 @@ ssize_t AaptAssets::slurpResourceTree(Bundle* bundle, const String8& srcDir)
      * Run through the directory, looking for dirs that match the
      * expected pattern.
      */
-    while (1) {
-        struct dirent* entry = readdir(dir);
-        if (entry == NULL) {
-            break;
-        }
+    for (size_t i = 0; i < scanned->entries.size(); i++) {
+        const DirectoryScanner::Entry* entry = &scanned->entries[i];
 
-        if (isHidden(srcDir.string(), entry->d_name)) {
+        if (isHidden(entry->name.string(), entry->type)) {
             continue;
         }
 
         String8 subdirName(srcDir);
-        subdirName.appendPath(entry->d_name);
+        subdirName.appendPath(entry->name);
 
         AaptGroupEntry group;
         String8 resType;
-        bool b = group.initFromDirName(entry->d_name, &resType);
+        bool b = group.initFromDirName(entry->name.string(), &resType);
         if (!b) {
             fprintf(stderr, "invalid resource directory name: %s %s\n", srcDir.string(),
-                    entry->d_name);
+                    entry->name.string());
             err = -1;
             continue;
         }
@@ -1172,16 +1307,14 @@ ssize_t AaptAssets::slurpResourceTree(Bundle* bundle, const String8& srcDir)
             const char *verString = group.getVersionString().string();
             int dirVersionInt = atoi(verString + 1); // skip 'v' in version name
             if (dirVersionInt > maxResInt) {
-              fprintf(stderr, "max res %d, skipping %s\n", maxResInt, entry->d_name);
+              fprintf(stderr, "max res %d, skipping %s\n", maxResInt, entry->name.string());
               continue;
             }
         }
 
-        FileType type = getFileType(subdirName.string());
-
-        if (type == kFileTypeDirectory) {
+        if (entry->type == kFileTypeDirectory && entry->dir != NULL) {
             sp<AaptDir> dir = makeDir(resType);
-            ssize_t res = dir->slurpFullTree(bundle, subdirName, group,
+            ssize_t res = dir->slurpScannedTree(bundle, entry->dir, group,
                                                 resType, mFullResPaths);
             if (res < 0) {
                 count = res;
@@ -1207,9 +1340,6 @@ ssize_t AaptAssets::slurpResourceTree(Bundle* bundle, const String8& srcDir)
     }
 
 bail:
-    closedir(dir);
-    dir = NULL;
-
     if (err != 0) {
         return err;
     }
@@ -1519,6 +1649,46 @@ bool AaptAssets::isJavaSymbol(const AaptSymbolEntry& sym, bool includePrivate) c
     return false;
 }
 
+static bool gRetainIncludedResources = false;
+static DefaultKeyedVector<String8, AssetManager*> gResidentIncludes(NULL);
+
+void AaptAssets::setRetainIncludedResources(bool retain)
+{
+    gRetainIncludedResources = retain;
+    if (!retain) {
+        const size_t N = gResidentIncludes.size();
+        for (size_t i = 0; i < N; i++) {
+            delete gResidentIncludes.valueAt(i);
+        }
+        gResidentIncludes.clear();
+    }
+}
+
+/*
+ * Keep the resource table of "path" resident.  The pinning AssetManager
+ * has the package as its first (and only) path, which is the one that
+ * AssetManager caches on the SharedZip and hands out to later tables.
+ */
+static void retainIncludedResources(const String8& path)
+{
+    AssetManager* resident = gResidentIncludes.valueFor(path);
+    if (resident != NULL) {
+        if (resident->isUpToDate()) {
+            return;
+        }
+        gResidentIncludes.removeItem(path);
+        delete resident;
+    }
+
+    resident = new AssetManager();
+    if (!resident->addAssetPath(path, NULL)) {
+        delete resident;
+        return;
+    }
+    resident->getResources(false);
+    gResidentIncludes.add(path, resident);
+}
+
 status_t AaptAssets::buildIncludedResources(Bundle* bundle)
 {
     if (mHaveIncludedAssets) {
@@ -1533,6 +1703,10 @@ status_t AaptAssets::buildIncludedResources(Bundle* bundle)
             printf("Including resources from package: %s\n", includes[i].string());
         }
 
+        if (gRetainIncludedResources) {
+            retainIncludedResources(includes[i]);
+        }
+
         if (!mIncludedAssets.addAssetPath(includes[i], NULL)) {
             fprintf(stderr, "ERROR: Asset package include '%s' not found.\n",
                     includes[i].string());
@@ -19,6 +19,7 @@
 #include "AaptConfig.h"
 #include "Bundle.h"
 #include "ConfigDescription.h"
+#include "DirectoryScanner.h"
 #include "SourcePos.h"
 #include "ZipFile.h"
 
@@ -153,12 +154,15 @@ public:
         , mData(NULL)
         , mDataSize(0)
         , mBufferSize(0)
+        , mChunked(false)
+        , mChunkedSize(0)
         , mCompression(ZipEntry::kCompressStored)
         {
             //printf("new AaptFile created %s\n", (const char*)sourceFile);
         }
     virtual ~AaptFile() {
         free(mData);
+        freeChunks();
     }
 
     const String8& getPath() const { return mPath; }
@@ -166,9 +170,10 @@ public:
 
     // Data API.  If there is data attached to the file,
     // getSourceFile() is not used.
-    bool hasData() const { return mData != NULL; }
-    const void* getData() const { return mData; }
-    size_t getSize() const { return mDataSize; }
+    bool hasData() const { return mData != NULL || !mChunks.isEmpty(); }
+    // NULL while the file holds chunks that haven't been joined.
+    const void* getData() const { return mChunks.isEmpty() ? mData : NULL; }
+    size_t getSize() const { return mDataSize + mChunkedSize; }
     void* editData(size_t size);
     void* editData(size_t* outSize = NULL);
     void* editDataInRange(size_t offset, size_t size);
@@ -176,6 +181,19 @@ public:
     status_t writeData(const void* data, size_t size);
     void clearData();
 
+    // Make room for "size" bytes of data in total without leaving any
+    // slack, for writers that know up front how much they will produce.
+    status_t reserveData(size_t size);
+
+    // In chunked mode writeData() appends to a list of chunks instead of
+    // growing (and copying) one buffer.  getChunks() hands them out as
+    // they are, for consumers like ZipFile that can take them that way.
+    // Anything that wants the data in one piece calls joinData() first,
+    // before the file is shared; the edit calls above join as well.
+    void setChunked(bool chunked) { mChunked = chunked; }
+    void getChunks(Vector<ZipFile::DataChunk>* outChunks) const;
+    status_t joinData();
+
     const String8& getResourceType() const { return mResourceType; }
 
     // File API.  If the file does not hold raw data, this is
@@ -191,6 +209,14 @@ public:
 private:
     friend class AaptGroup;
 
+    struct Chunk {
+        uint8_t* data;
+        size_t size;
+        size_t capacity;
+    };
+
+    void freeChunks();
+
     String8 mPath;
     AaptGroupEntry mGroupEntry;
     String8 mResourceType;
@@ -198,6 +224,9 @@ private:
     void* mData;
     size_t mDataSize;
     size_t mBufferSize;
+    bool mChunked;
+    Vector<Chunk> mChunks;      // chunked data, following mData
+    size_t mChunkedSize;
     int mCompression;
 };
 
@@ -294,6 +323,12 @@ private:
                                   const String8& resType,
                                   sp<FilePathStore>& fullResPaths,
                                   const bool overwrite=false);
+    ssize_t slurpScannedTree(Bundle* bundle,
+                             const DirectoryScanner::Dir* dir,
+                             const AaptGroupEntry& kind,
+                             const String8& resType,
+                             sp<FilePathStore>& fullResPaths,
+                             const bool overwrite=false);
 
     String8 mLeaf;
     String8 mPath;
@@ -564,6 +599,15 @@ public:
     const ResTable& getIncludedResources() const;
     AssetManager& getAssetManager();
 
+    /*
+     * When enabled, every package include that gets loaded is also kept
+     * open by a process-wide AssetManager, so its parsed resource table
+     * stays in the shared zip cache and later AaptAssets instances (for
+     * example the next request in daemon mode) copy it instead of
+     * re-parsing it.
+     */
+    static void setRetainIncludedResources(bool retain);
+
     void print(const String8& prefix) const;
 
     inline const Vector<sp<AaptDir> >& resDirs() const { return mResDirs; }
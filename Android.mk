@@ -32,6 +32,8 @@ aaptSources := \
     ApkBuilder.cpp \
     Command.cpp \
     CrunchCache.cpp \
+    DirectoryScanner.cpp \
+    DumpWriter.cpp \
     FileFinder.cpp \
     Images.cpp \
     Package.cpp \
@@ -40,9 +42,11 @@ aaptSources := \
     ResourceFilter.cpp \
     ResourceIdCache.cpp \
     ResourceTable.cpp \
+    ResultCache.cpp \
     SourcePos.cpp \
     StringPool.cpp \
     WorkQueue.cpp \
+    WorkStealingPool.cpp \
     XMLNode.cpp \
     ZipEntry.cpp \
     ZipFile.cpp
@@ -103,7 +107,24 @@ LOCAL_MODULE := apkname
 LOCAL_CFLAGS := $(aaptCFlags)
 LOCAL_CPPFLAGS := $(aaptCppFlags)
 LOCAL_LDLIBS := $(aaptLdLibs)
-LOCAL_SRC_FILES := ApkName.cpp
+LOCAL_SRC_FILES := ApkName.cpp ArscReader.cpp
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/include
+LOCAL_STATIC_LIBRARIES := libaapt $(aaptStaticLibs)
+LOCAL_FORCE_STATIC_EXECUTABLE := true
+
+include $(BUILD_EXECUTABLE)
+
+# ==========================================================
+# Build the executable: zipbench
+# ==========================================================
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := zipbench
+LOCAL_MODULE_TAGS := optional
+LOCAL_CFLAGS := $(aaptCFlags)
+LOCAL_CPPFLAGS := $(aaptCppFlags)
+LOCAL_LDLIBS := $(aaptLdLibs)
+LOCAL_SRC_FILES := ZipBenchmark.cpp
 LOCAL_C_INCLUDES := $(LOCAL_PATH)/include
 LOCAL_STATIC_LIBRARIES := libaapt $(aaptStaticLibs)
 LOCAL_FORCE_STATIC_EXECUTABLE := true
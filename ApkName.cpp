@@ -10,20 +10,28 @@
 #include <cstdlib>
 #include <getopt.h>
 #include <cassert>
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <vector>
 
 #include "AaptXml.h"
 #include "ApkBuilder.h"
+#include "ArscReader.h"
 #include "Bundle.h"
 #include "Images.h"
 #include "Main.h"
 #include "ResourceFilter.h"
 #include "ResourceTable.h"
+#include "ResultCache.h"
+#include "WorkStealingPool.h"
 #include "XMLNode.h"
 
 bool containsOnlyASCII(const std::string& text) {
@@ -43,40 +51,71 @@ std::string trim(std::string s) {
     return s;
 }
 
-int main(int argc, char* const argv[])
+// Make a dummy config for retrieving resources...  we need to supply
+// non-default values for some configs so that we can retrieve resources
+// in the app that don't have a default.  The most important of these is
+// the API version because key resources like icons will have an implicit
+// version if they are using newer config types like density.
+static void makeLabelConfig(ResTable_config* config)
 {
-	if (argc < 2){
-		fprintf(stderr, "ERROR: no file supplied");
-		return 1;
+	memset(config, 0, sizeof(ResTable_config));
+	config->language[0] = 'e';
+	config->language[1] = 'n';
+	config->country[0] = 'U';
+	config->country[1] = 'S';
+	config->orientation = ResTable_config::ORIENTATION_PORT;
+	config->density = ResTable_config::DENSITY_MEDIUM;
+	config->sdkVersion = 10000; // Very high.
+	config->screenWidthDp = 320;
+	config->screenHeightDp = 480;
+	config->smallestScreenWidthDp = 320;
+	config->screenLayout |= ResTable_config::SCREENSIZE_NORMAL;
+}
+
+// Labels are tried in each of the table's locales in turn.  The first one
+// found is kept, unless it isn't ASCII and a later one is.
+static void pickLabel(String8* label, const String8& llabel)
+{
+	if (llabel != "") {
+		bool label_isASCII = containsOnlyASCII(ResTable::normalizeForOutput(label->string()).string());
+		bool llabel_isASCII = containsOnlyASCII(ResTable::normalizeForOutput(llabel.string()).string());
+		if (*label == "" || (label_isASCII == false && llabel_isASCII == true)) {
+			*label = llabel;
+		}
 	}
+}
+
+static void setApkName(std::string package_name, std::string app_name,
+		std::string* outPackageName, std::string* outAppName)
+{
+	if (app_name == "" || containsOnlyASCII(app_name) == false) {
+		app_name = package_name;
+	}
+
+	*outPackageName = ResTable::normalizeForOutput(package_name.c_str()).string();
+	*outAppName = ResTable::normalizeForOutput(app_name.c_str()).string();
+}
+
+/*
+ * Find the package name and application label of one APK.  Every call
+ * has its own AssetManager, so several APKs can be resolved at once.
+ */
+static bool getApkName(const char* filename, std::string* outPackageName,
+		std::string* outAppName, std::string* outError)
+{
 	std::string package_name = "unknown";
 	std::string app_name = "unknown";
 
-	const char* filename = argv[1];
-
 	AssetManager assets;
 	int32_t assetsCookie;
 
-	assets.addAssetPath(String8(filename), &assetsCookie);
+	if (!assets.addAssetPath(String8(filename), &assetsCookie)) {
+		*outError = "unable to open APK";
+		return false;
+	}
 
-	// Make a dummy config for retrieving resources...  we need to supply
-	// non-default values for some configs so that we can retrieve resources
-	// in the app that don't have a default.  The most important of these is
-	// the API version because key resources like icons will have an implicit
-	// version if they are using newer config types like density.
 	ResTable_config config;
-	memset(&config, 0, sizeof(ResTable_config));
-	config.language[0] = 'e';
-	config.language[1] = 'n';
-	config.country[0] = 'U';
-	config.country[1] = 'S';
-	config.orientation = ResTable_config::ORIENTATION_PORT;
-	config.density = ResTable_config::DENSITY_MEDIUM;
-	config.sdkVersion = 10000; // Very high.
-	config.screenWidthDp = 320;
-	config.screenHeightDp = 480;
-	config.smallestScreenWidthDp = 320;
-	config.screenLayout |= ResTable_config::SCREENSIZE_NORMAL;
+	makeLabelConfig(&config);
 	assets.setConfiguration(config);
 
 	const ResTable& res = assets.getResources(false);
@@ -88,6 +127,10 @@ int main(int argc, char* const argv[])
 	Asset* asset = NULL;
 
 	asset = assets.openNonAsset(assetsCookie, "AndroidManifest.xml", Asset::ACCESS_BUFFER);
+	if (asset == NULL) {
+		*outError = "no AndroidManifest.xml";
+		return false;
+	}
 
 	ResXMLTree tree(dynamicRefTable);
 	tree.setTo(asset->getBuffer(true), asset->getLength());
@@ -96,18 +139,6 @@ int main(int argc, char* const argv[])
 	Vector<String8> locales;
 	res.getLocales(&locales);
 
-	Vector<ResTable_config> configs;
-	res.getConfigurations(&configs);
-	SortedVector<int> densities;
-	const size_t NC = configs.size();
-	for (size_t i=0; i<NC; i++) {
-		int dens = configs[i].density;
-		if (dens == 0) {
-			dens = 160;
-		}
-		densities.add(dens);
-	}
-
 	size_t len;
 	ResXMLTree::event_code_t code;
 	int depth = 0;
@@ -195,16 +226,10 @@ int main(int argc, char* const argv[])
 					const char* localeStr =  locales[i].string();
 					assets.setConfiguration(config, localeStr != NULL ? localeStr : "");
 					String8 llabel = AaptXml::getResolvedAttribute(res, tree, 0x01010001, &error);
-					if (llabel != "") {
-						if (localeStr == NULL || strlen(localeStr) == 0) {
-							label = llabel;
-						} else {
-							bool label_isASCII = containsOnlyASCII(ResTable::normalizeForOutput(label.string()).string());
-							bool llabel_isASCII = containsOnlyASCII(ResTable::normalizeForOutput(llabel.string()).string());
-							if (label == "" || (label_isASCII == false && llabel_isASCII == true)) {
-								label = llabel;
-							}
-						}
+					if (llabel != "" && (localeStr == NULL || strlen(localeStr) == 0)) {
+						label = llabel;
+					} else {
+						pickLabel(&label, llabel);
 					}
 				}
 				assets.setConfiguration(config);
@@ -213,11 +238,409 @@ int main(int argc, char* const argv[])
 		}
 	}
 
-	if (app_name == "" || containsOnlyASCII(app_name) == false) {
-		app_name = package_name;
+	delete asset;
+
+	setApkName(package_name, app_name, outPackageName, outAppName);
+	return true;
+}
+
+/*
+ * Does what getApkName() does without loading the resource table.  Only
+ * the manifest, the chunk headers of resources.arsc and the entries the
+ * label refers to are read.  Returns false if the APK needs getApkName(),
+ * which also reports any errors.
+ */
+static bool getApkNameFast(const char* filename, std::string* outPackageName,
+		std::string* outAppName)
+{
+	std::string package_name = "unknown";
+	std::string app_name = "unknown";
+
+	ZipFileRO* zip = ZipFileRO::open(filename);
+	if (zip == NULL) {
+		return false;
+	}
+
+	ZipEntryRO entry = zip->findEntryByName("AndroidManifest.xml");
+	if (entry == NULL) {
+		delete zip;
+		return false;
+	}
+	uint32_t manifestLen;
+	zip->getEntryInfo(entry, NULL, &manifestLen, NULL, NULL, NULL, NULL);
+	std::vector<char> manifest(manifestLen);
+	bool ok = manifestLen > 0 && zip->uncompressEntry(entry, &manifest[0], manifestLen);
+	zip->releaseEntry(entry);
+
+	ResXMLTree tree;
+	if (!ok || tree.setTo(&manifest[0], manifestLen) != NO_ERROR) {
+		delete zip;
+		return false;
+	}
+
+	bool sawApplication = false;
+	bool hasLabel = false;
+	Res_value labelValue;
+	String8 labelString;
+
+	size_t len;
+	ResXMLTree::event_code_t code;
+	int depth = 0;
+	while ((code=tree.next()) != ResXMLTree::END_DOCUMENT &&
+		   code != ResXMLTree::BAD_DOCUMENT) {
+		if (code == ResXMLTree::END_TAG) {
+			depth--;
+			continue;
+		}
+		if (code != ResXMLTree::START_TAG) {
+			continue;
+		}
+		depth++;
+
+		if (depth == 1) {
+			package_name = AaptXml::getAttribute(tree, NULL, "package", NULL);
+		} else if (depth == 2 && String8(tree.getElementName(&len)) == "application") {
+			sawApplication = true;
+			hasLabel = false;
+			ssize_t idx = AaptXml::indexOfAttribute(tree, 0x01010001);
+			if (idx >= 0 && tree.getAttributeValue(idx, &labelValue) >= 0) {
+				hasLabel = true;
+				if (labelValue.dataType == Res_value::TYPE_STRING) {
+					const char16_t* str = tree.getAttributeStringValue(idx, &len);
+					labelString = str ? String8(str, len) : String8();
+				}
+			}
+		}
+	}
+
+	if (sawApplication) {
+		// With no locales in the table, no label is ever looked up.
+		ArscReader arsc;
+		status_t err = arsc.open(zip);
+		if (err != NO_ERROR && err != NAME_NOT_FOUND) {
+			delete zip;
+			return false;
+		}
+
+		ResTable_config config;
+		makeLabelConfig(&config);
+
+		String8 label;
+		const SortedVector<String8>& locales = arsc.getLocales();
+		const size_t NL = err == NO_ERROR ? locales.size() : 0;
+		for (size_t i=0; hasLabel && i<NL; i++) {
+			String8 llabel;
+			if (labelValue.dataType == Res_value::TYPE_STRING) {
+				llabel = labelString;
+			} else {
+				ResTable_config localeConfig(config);
+				localeConfig.setBcp47Locale(locales[i].string());
+				if (arsc.resolveString(labelValue, localeConfig, &llabel) != NO_ERROR) {
+					delete zip;
+					return false;
+				}
+			}
+			pickLabel(&label, llabel);
+		}
+		app_name = label;
+	}
+	delete zip;
+
+	setApkName(package_name, app_name, outPackageName, outAppName);
+	return true;
+}
+
+/*
+ * The result for one APK.  Filled in by a work thread, printed by main().
+ */
+struct ApkNameResult {
+	ApkNameResult() : done(false), ok(false) {}
+
+	std::string path;
+	std::string packageName;
+	std::string appName;
+	std::string error;
+	bool done;
+	bool ok;
+};
+
+struct ApkNameBatch {
+	ApkNameBatch() : full(false), cache(NULL) {}
+
+	bool full;      // always load the whole resource table
+	ResultCache* cache;     // NULL with --no-cache
+	Mutex lock;
+	Condition resultReady;
+	std::vector<ApkNameResult> results;
+};
+
+class ApkNameWorkUnit : public WorkQueue::WorkUnit {
+public:
+	ApkNameWorkUnit(ApkNameBatch* batch, size_t index) :
+			mBatch(batch), mIndex(index) {
+	}
+
+	virtual bool run() {
+		ApkNameResult& result = mBatch->results[mIndex];
+		std::string packageName, appName, error;
+		bool ok = false;
+
+		// Cached as the package name and the label, separated by a NUL.
+		ResultCache::ApkIdentity identity;
+		bool haveIdentity = mBatch->cache != NULL
+				&& ResultCache::getIdentity(result.path.c_str(), &identity) == NO_ERROR;
+		String8 cached;
+		if (haveIdentity && mBatch->cache->find(identity, "apkname", &cached)) {
+			const char* sep = (const char*) memchr(cached.string(), '\0', cached.length());
+			if (sep != NULL) {
+				packageName.assign(cached.string(), sep - cached.string());
+				appName.assign(sep + 1, cached.string() + cached.length());
+				ok = true;
+			}
+		}
+
+		if (!ok) {
+			ok = (!mBatch->full && getApkNameFast(result.path.c_str(), &packageName, &appName))
+					|| getApkName(result.path.c_str(), &packageName, &appName, &error);
+			if (ok && haveIdentity) {
+				std::string value = packageName + '\0' + appName;
+				mBatch->cache->put(identity, "apkname", String8(value.data(), value.size()));
+			}
+		}
+
+		AutoMutex _l(mBatch->lock);
+		result.packageName = packageName;
+		result.appName = appName;
+		result.error = error;
+		result.ok = ok;
+		result.done = true;
+		mBatch->resultReady.broadcast();
+		return true; // continue even if there are errors
+	}
+
+private:
+	ApkNameBatch* mBatch;
+	size_t mIndex;
+};
+
+static bool hasApkExtension(const std::string& name) {
+	return name.size() > 4 && strcasecmp(name.c_str() + name.size() - 4, ".apk") == 0;
+}
+
+/*
+ * Add every APK under "dir" to "paths", sorted by name so the output
+ * doesn't depend on the order of the directory.
+ */
+static void collectApks(const std::string& dir, std::vector<std::string>* paths)
+{
+	DIR* d = opendir(dir.c_str());
+	if (d == NULL) {
+		fprintf(stderr, "ERROR: unable to open '%s': %s\n", dir.c_str(), strerror(errno));
+		return;
+	}
+
+	std::vector<std::string> names;
+	struct dirent* entry;
+	while ((entry = readdir(d)) != NULL) {
+		if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+			names.push_back(entry->d_name);
+		}
+	}
+	closedir(d);
+	std::sort(names.begin(), names.end());
+
+	for (size_t i = 0; i < names.size(); i++) {
+		std::string path = dir + "/" + names[i];
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0) {
+			continue;
+		}
+		if (S_ISDIR(st.st_mode)) {
+			collectApks(path, paths);
+		} else if (S_ISREG(st.st_mode) && hasApkExtension(names[i])) {
+			paths->push_back(path);
+		}
+	}
+}
+
+static std::string jsonEscape(const std::string& s) {
+	std::string out;
+	for (size_t i = 0; i < s.size(); i++) {
+		const unsigned char c = s[i];
+		switch (c) {
+		case '"': out += "\\\""; break;
+		case '\\': out += "\\\\"; break;
+		case '\n': out += "\\n"; break;
+		case '\r': out += "\\r"; break;
+		case '\t': out += "\\t"; break;
+		default:
+			if (c < 0x20) {
+				char buf[8];
+				snprintf(buf, sizeof(buf), "\\u%04x", c);
+				out += buf;
+			} else {
+				out += c;
+			}
+		}
+	}
+	return out;
+}
+
+static void printResult(const ApkNameResult& result, bool json, bool showPath) {
+	if (json) {
+		if (result.ok) {
+			printf("{\"path\":\"%s\",\"package\":\"%s\",\"label\":\"%s\"}\n",
+					jsonEscape(result.path).c_str(), jsonEscape(result.packageName).c_str(),
+					jsonEscape(result.appName).c_str());
+		} else {
+			printf("{\"path\":\"%s\",\"error\":\"%s\"}\n",
+					jsonEscape(result.path).c_str(), jsonEscape(result.error).c_str());
+		}
+	} else if (result.ok) {
+		if (showPath) {
+			printf("%s\t", result.path.c_str());
+		}
+		printf("%s=%s\n", result.packageName.c_str(), result.appName.c_str());
+	} else {
+		fprintf(stderr, "ERROR: %s: %s\n", result.path.c_str(), result.error.c_str());
+	}
+}
+
+static void usage() {
+	fprintf(stderr,
+		"Usage: apkname [-j N] [--json] [--full] [--no-cache] [--rebuild-cache]\n"
+		"               APK-or-directory...\n"
+		"  Prints package=label for each APK, in the order given.  Directories\n"
+		"  are searched for *.apk files.  With more than one APK, each line\n"
+		"  starts with the APK's path and a tab.\n"
+		"  -j, --jobs N  resolve N APKs at a time.  Default is the number of CPUs.\n"
+		"  --json        print one JSON object per line instead.\n"
+		"  --full        load each APK's whole resource table instead of only\n"
+		"                the entries the label refers to.\n"
+		"  --no-cache    neither read nor update the result cache.  Results are\n"
+		"                otherwise kept in $AAPT_RESULT_CACHE, or aapt/results under\n"
+		"                the user's cache directory, and reused while an APK is\n"
+		"                unchanged.\n"
+		"  --rebuild-cache  ignore the result cache's contents and write it out again.\n");
+}
+
+int main(int argc, char* const argv[])
+{
+	static const struct option longOptions[] = {
+		{ "jobs", required_argument, NULL, 'j' },
+		{ "json", no_argument, NULL, 'J' },
+		{ "full", no_argument, NULL, 'F' },
+		{ "no-cache", no_argument, NULL, 'N' },
+		{ "rebuild-cache", no_argument, NULL, 'R' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	int jobs = 0;
+	bool json = false;
+	bool full = false;
+	bool useCache = true;
+	bool rebuildCache = false;
+	int opt;
+	while ((opt = getopt_long(argc, argv, "j:h", longOptions, NULL)) != -1) {
+		switch (opt) {
+		case 'j':
+			jobs = atoi(optarg);
+			if (jobs < 0) {
+				usage();
+				return 1;
+			}
+			break;
+		case 'J':
+			json = true;
+			break;
+		case 'F':
+			full = true;
+			break;
+		case 'N':
+			useCache = false;
+			break;
+		case 'R':
+			rebuildCache = true;
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "ERROR: no file supplied\n");
+		usage();
+		return 1;
+	}
+
+	ApkNameBatch batch;
+	batch.full = full;
+
+	ResultCache cache;
+	const String8 cachePath = ResultCache::getDefaultPath();
+	if (useCache && !cachePath.isEmpty() && cache.open(cachePath, rebuildCache) == NO_ERROR) {
+		batch.cache = &cache;
 	}
 
-	printf("%s=%s\n",ResTable::normalizeForOutput(package_name.c_str()).string(),ResTable::normalizeForOutput(app_name.c_str()).string());
+	bool sawDirectory = false;
+	for (int i = optind; i < argc; i++) {
+		struct stat st;
+		if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode)) {
+			std::vector<std::string> paths;
+			collectApks(argv[i], &paths);
+			for (size_t j = 0; j < paths.size(); j++) {
+				batch.results.push_back(ApkNameResult());
+				batch.results.back().path = paths[j];
+			}
+			sawDirectory = true;
+		} else {
+			batch.results.push_back(ApkNameResult());
+			batch.results.back().path = argv[i];
+		}
+	}
+	const size_t N = batch.results.size();
+	const bool showPath = sawDirectory || N > 1;
 
-	return 0;
+	int result = 0;
+	WorkStealingPool pool(N > 1 ? jobs : 1);
+	for (size_t i = 0; i < N; i++) {
+		ApkNameWorkUnit* w = new ApkNameWorkUnit(&batch, i);
+		if (pool.schedule(w, 0) != OK) {
+			w->run();
+			delete w;
+		}
+	}
+
+	// Print in input order, as soon as each result is in.
+	for (size_t i = 0; i < N; i++) {
+		for (;;) {
+			{
+				AutoMutex _l(batch.lock);
+				if (batch.results[i].done) {
+					break;
+				}
+			}
+			if (pool.runOne()) {
+				continue;
+			}
+			AutoMutex _l(batch.lock);
+			while (!batch.results[i].done) {
+				batch.resultReady.wait(batch.lock);
+			}
+		}
+
+		const ApkNameResult& r = batch.results[i];
+		printResult(r, json, showPath);
+		fflush(stdout);
+		if (!r.ok) {
+			result = 1;
+		}
+	}
+	pool.finish();
+
+	if (batch.cache != NULL) {
+		batch.cache->flush();
+	}
+	return result;
 }
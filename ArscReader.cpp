@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#define LOG_TAG "ArscReader"
+
+#include "ArscReader.h"
+
+#include <utils/ByteOrder.h>
+#include <utils/Log.h>
+
+#include <stddef.h>
+#include <stdlib.h>
+
+namespace android {
+
+/*
+ * Returns the chunk at "pos" if its header is sane and it fits before
+ * "end", or NULL.
+ */
+static const ResChunk_header* chunkAt(const uint8_t* pos, const uint8_t* end)
+{
+    if ((size_t) (end - pos) < sizeof(ResChunk_header)) {
+        return NULL;
+    }
+    const ResChunk_header* chunk = reinterpret_cast<const ResChunk_header*>(pos);
+    const size_t headerSize = dtohs(chunk->headerSize);
+    const size_t size = dtohl(chunk->size);
+    if (headerSize < sizeof(ResChunk_header) || size < headerSize
+            || size > (size_t) (end - pos) || (size & 3) != 0) {
+        return NULL;
+    }
+    return chunk;
+}
+
+ArscReader::ArscReader() :
+        mMap(NULL), mOwnedData(NULL), mData(NULL), mSize(0), mPackageId(0) {
+}
+
+ArscReader::~ArscReader() {
+    delete mMap;
+    free(mOwnedData);
+}
+
+status_t ArscReader::open(const ZipFileRO* zip) {
+    ZipEntryRO entry = zip->findEntryByName("resources.arsc");
+    if (entry == NULL) {
+        return NAME_NOT_FOUND;
+    }
+
+    uint16_t method;
+    uint32_t uncompLen;
+    zip->getEntryInfo(entry, &method, &uncompLen, NULL, NULL, NULL, NULL);
+
+    // Stored tables are normally aligned so we can use them where they lie.
+    if (method == ZipFileRO::kCompressStored) {
+        mMap = zip->createEntryFileMap(entry);
+        if (mMap != NULL && (reinterpret_cast<uintptr_t>(mMap->getDataPtr()) & 3) == 0) {
+            mData = static_cast<const uint8_t*>(mMap->getDataPtr());
+            mSize = mMap->getDataLength();
+        } else {
+            delete mMap;
+            mMap = NULL;
+        }
+    }
+    if (mData == NULL) {
+        mOwnedData = malloc(uncompLen);
+        if (mOwnedData == NULL || !zip->uncompressEntry(entry, mOwnedData, uncompLen)) {
+            zip->releaseEntry(entry);
+            return UNKNOWN_ERROR;
+        }
+        mData = static_cast<const uint8_t*>(mOwnedData);
+        mSize = uncompLen;
+    }
+    zip->releaseEntry(entry);
+
+    return parseTable();
+}
+
+status_t ArscReader::parseTable() {
+    const ResChunk_header* chunk = chunkAt(mData, mData + mSize);
+    if (chunk == NULL || dtohs(chunk->type) != RES_TABLE_TYPE
+            || dtohs(chunk->headerSize) < sizeof(ResTable_header)) {
+        return BAD_TYPE;
+    }
+    const ResTable_header* header = reinterpret_cast<const ResTable_header*>(chunk);
+    if (dtohl(header->packageCount) != 1) {
+        return INVALID_OPERATION;
+    }
+
+    const uint8_t* pos = mData + dtohs(chunk->headerSize);
+    const uint8_t* const end = mData + dtohl(chunk->size);
+    bool sawPackage = false;
+    while (pos < end) {
+        chunk = chunkAt(pos, end);
+        if (chunk == NULL) {
+            return BAD_TYPE;
+        }
+
+        const uint16_t type = dtohs(chunk->type);
+        if (type == RES_STRING_POOL_TYPE && mValueStrings.getError() != NO_ERROR) {
+            status_t err = mValueStrings.setTo(chunk, dtohl(chunk->size));
+            if (err != NO_ERROR) {
+                return err;
+            }
+        } else if (type == RES_TABLE_PACKAGE_TYPE) {
+            status_t err = parsePackage(chunk);
+            if (err != NO_ERROR) {
+                return err;
+            }
+            sawPackage = true;
+        }
+        pos += dtohl(chunk->size);
+    }
+
+    if (!sawPackage || mValueStrings.getError() != NO_ERROR) {
+        return BAD_TYPE;
+    }
+    return NO_ERROR;
+}
+
+status_t ArscReader::parsePackage(const ResChunk_header* chunk) {
+    if (dtohs(chunk->headerSize) < offsetof(ResTable_package, typeIdOffset)) {
+        return BAD_TYPE;
+    }
+    const ResTable_package* package = reinterpret_cast<const ResTable_package*>(chunk);
+    mPackageId = dtohl(package->id);
+    if (mPackageId == 0 || mPackageId >= 256) {
+        // A shared library: its references need a DynamicRefTable.
+        return INVALID_OPERATION;
+    }
+
+    const uint8_t* const base = reinterpret_cast<const uint8_t*>(chunk);
+    const uint8_t* pos = base + dtohs(chunk->headerSize);
+    const uint8_t* const end = base + dtohl(chunk->size);
+    char locale[RESTABLE_MAX_LOCALE_LEN];
+    while (pos < end) {
+        chunk = chunkAt(pos, end);
+        if (chunk == NULL) {
+            return BAD_TYPE;
+        }
+
+        const uint16_t type = dtohs(chunk->type);
+        if (type == RES_TABLE_TYPE_TYPE) {
+            // Same checks as ResTable::parsePackage().
+            const ResTable_type* typeChunk = reinterpret_cast<const ResTable_type*>(chunk);
+            const size_t headerSize = dtohs(chunk->headerSize);
+            const size_t size = dtohl(chunk->size);
+            const size_t entryCount = dtohl(typeChunk->entryCount);
+            if (headerSize < sizeof(ResTable_type) - sizeof(ResTable_config) + 4
+                    || headerSize + sizeof(uint32_t) * entryCount > size
+                    || (entryCount != 0
+                        && dtohl(typeChunk->entriesStart) > size - sizeof(ResTable_entry))
+                    || typeChunk->id == 0) {
+                return BAD_TYPE;
+            }
+
+            if (entryCount > 0) {
+                TypeChunk tc;
+                tc.type = typeChunk;
+                tc.config.copyFromDtoH(typeChunk->config);
+                mTypes.add(tc);
+
+                if (tc.config.locale != 0) {
+                    tc.config.getBcp47Locale(locale);
+                    mLocales.add(String8(locale));
+                }
+            }
+        } else if (type == RES_TABLE_LIBRARY_TYPE) {
+            const ResTable_lib_header* lib = reinterpret_cast<const ResTable_lib_header*>(chunk);
+            if (dtohs(chunk->headerSize) < sizeof(ResTable_lib_header) || dtohl(lib->count) > 0) {
+                return INVALID_OPERATION;
+            }
+        }
+        pos += dtohl(chunk->size);
+    }
+    return NO_ERROR;
+}
+
+/*
+ * The entry ResTable::getEntry() would pick for "resId", read straight out
+ * of the type chunks.
+ */
+status_t ArscReader::getValue(uint32_t resId, const ResTable_config& config,
+        Res_value* outValue) const {
+    const uint32_t packageId = Res_GETPACKAGE(resId) + 1;
+    const int typeId = Res_GETTYPE(resId) + 1;
+    const size_t entryIndex = Res_GETENTRY(resId);
+    if (packageId == 0) {
+        return INVALID_OPERATION;
+    }
+    if (packageId != mPackageId || typeId == 0) {
+        return BAD_INDEX;
+    }
+
+    const ResTable_type* bestType = NULL;
+    uint32_t bestOffset = ResTable_type::NO_ENTRY;
+    ResTable_config bestConfig;
+    memset(&bestConfig, 0, sizeof(bestConfig));
+
+    const size_t N = mTypes.size();
+    for (size_t i = 0; i < N; i++) {
+        const TypeChunk& tc = mTypes[i];
+        if (tc.type->id != typeId || entryIndex >= dtohl(tc.type->entryCount)) {
+            continue;
+        }
+        if (!tc.config.match(config)) {
+            continue;
+        }
+
+        const uint32_t* const eindex = reinterpret_cast<const uint32_t*>(
+                reinterpret_cast<const uint8_t*>(tc.type) + dtohs(tc.type->header.headerSize));
+        const uint32_t offset = dtohl(eindex[entryIndex]);
+        if (offset == ResTable_type::NO_ENTRY) {
+            continue;
+        }
+
+        if (bestType != NULL && !tc.config.isBetterThan(bestConfig, &config)) {
+            continue;
+        }
+        bestType = tc.type;
+        bestOffset = offset;
+        bestConfig = tc.config;
+    }
+
+    if (bestType == NULL) {
+        return BAD_INDEX;
+    }
+
+    const size_t typeSize = dtohl(bestType->header.size);
+    const size_t entryStart = dtohl(bestType->entriesStart) + bestOffset;
+    if (bestOffset > typeSize || entryStart > typeSize - sizeof(ResTable_entry)) {
+        return BAD_TYPE;
+    }
+    const ResTable_entry* entry = reinterpret_cast<const ResTable_entry*>(
+            reinterpret_cast<const uint8_t*>(bestType) + entryStart);
+    if ((dtohs(entry->flags) & ResTable_entry::FLAG_COMPLEX) != 0) {
+        return BAD_VALUE;
+    }
+
+    const size_t entrySize = dtohs(entry->size);
+    if (entrySize < sizeof(ResTable_entry)
+            || entryStart + entrySize > typeSize - sizeof(Res_value)) {
+        return BAD_TYPE;
+    }
+    const Res_value* value = reinterpret_cast<const Res_value*>(
+            reinterpret_cast<const uint8_t*>(entry) + entrySize);
+    outValue->size = dtohs(value->size);
+    outValue->res0 = value->res0;
+    outValue->dataType = value->dataType;
+    outValue->data = dtohl(value->data);
+    return NO_ERROR;
+}
+
+status_t ArscReader::resolveString(const Res_value& value, const ResTable_config& config,
+        String8* outString) const {
+    Res_value resolved = value;
+    for (int count = 0; resolved.dataType == Res_value::TYPE_REFERENCE
+            && resolved.data != 0 && count < 20; count++) {
+        status_t err = getValue(resolved.data, config, &resolved);
+        if (err == INVALID_OPERATION) {
+            return err;
+        }
+        if (err != NO_ERROR) {
+            break;
+        }
+    }
+
+    if (resolved.dataType == Res_value::TYPE_DYNAMIC_REFERENCE) {
+        return INVALID_OPERATION;
+    }
+    if (resolved.dataType != Res_value::TYPE_STRING) {
+        outString->clear();
+        return NO_ERROR;
+    }
+    *outString = mValueStrings.string8ObjectAt(resolved.data);
+    return NO_ERROR;
+}
+
+}; // namespace android
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef AAPT_ARSC_READER_H
+#define AAPT_ARSC_READER_H
+
+#include <androidfw/ResourceTypes.h>
+#include <androidfw/ZipFileRO.h>
+#include <utils/Errors.h>
+#include <utils/FileMap.h>
+#include <utils/SortedVector.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+/*
+ * Resolves single values out of an APK's resources.arsc without building
+ * a ResTable.
+ *
+ * open() maps the table (or inflates it, if it is compressed) and walks
+ * its chunk headers once, noting where each type chunk starts and which
+ * locales the table has.  resolveString() then only reads the entries it
+ * is asked for, choosing between configurations the way ResTable does.
+ *
+ * Only tables with a single, non-shared package are handled; anything
+ * else is INVALID_OPERATION and should be left to ResTable.
+ */
+class ArscReader {
+public:
+    ArscReader();
+    ~ArscReader();
+
+    status_t open(const ZipFileRO* zip);
+
+    /* The locales of every configuration in the table, as ResTable::getLocales() has them. */
+    const SortedVector<String8>& getLocales() const { return mLocales; }
+
+    /*
+     * Follows "value" through any references, as ResTable::resolveReference()
+     * would for "config", and returns the string it ends on in "outString".
+     * A value that doesn't end on a string, such as a missing or complex
+     * entry, comes out as an empty string.  Returns INVALID_OPERATION if the
+     * value can't be resolved without a full ResTable.
+     */
+    status_t resolveString(const Res_value& value, const ResTable_config& config,
+            String8* outString) const;
+
+private:
+    /* these are private and not defined */
+    ArscReader(const ArscReader& src);
+    ArscReader& operator=(const ArscReader& src);
+
+    struct TypeChunk {
+        const ResTable_type* type;
+        ResTable_config config;
+    };
+
+    status_t parseTable();
+    status_t parsePackage(const ResChunk_header* chunk);
+    status_t getValue(uint32_t resId, const ResTable_config& config, Res_value* outValue) const;
+
+    FileMap* mMap;
+    void* mOwnedData;
+    const uint8_t* mData;
+    size_t mSize;
+
+    ResStringPool mValueStrings;
+    uint32_t mPackageId;
+    Vector<TypeChunk> mTypes;
+    SortedVector<String8> mLocales;
+};
+
+}; // namespace android
+
+#endif // AAPT_ARSC_READER_H
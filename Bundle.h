@@ -41,6 +41,52 @@ typedef enum PseudolocalizationMethod {
     PSEUDO_BIDI,
 } PseudolocalizationMethod;
 
+/*
+ * Formats "aapt dump" can write, selected with --format.
+ */
+typedef enum DumpFormat {
+    kDumpFormatText = 0,
+    kDumpFormatJson,
+    kDumpFormatBinary
+} DumpFormat;
+
+/*
+ * Groups of "dump badging" output, selected with --fields.
+ */
+enum {
+    BADGING_PACKAGE     = 1 << 0,   // package, install-location
+    BADGING_SDK         = 1 << 1,   // sdkVersion, maxSdkVersion, targetSdkVersion
+    BADGING_LABEL       = 1 << 2,   // application-label, application-label-LOCALE
+    BADGING_ICON        = 1 << 3,   // application-icon-DENSITY
+    BADGING_APPLICATION = 1 << 4,   // application, testOnly, isGame, debuggable
+    BADGING_PERMISSIONS = 1 << 5,   // uses-permission, uses-implied-permission
+    BADGING_FEATURES    = 1 << 6,   // uses-feature, feature-group, uses-configuration, ...
+    BADGING_COMPONENTS  = 1 << 7,   // launchable-activity, provides-component, main, ...
+    BADGING_LIBRARIES   = 1 << 8,   // uses-library, uses-package
+    BADGING_META_DATA   = 1 << 9,   // meta-data, with --include-meta-data
+    BADGING_SCREENS     = 1 << 10,  // supports-screens, compatible-screens, ...
+    BADGING_LOCALES     = 1 << 11,
+    BADGING_DENSITIES   = 1 << 12,
+    BADGING_NATIVE_CODE = 1 << 13,
+    BADGING_OTHER       = 1 << 14,  // original-package, package-verifier
+
+    BADGING_ALL         = (1 << 15) - 1
+};
+
+/*
+ * One entry of the compression policy given with --compression-rule.  A
+ * rule matches a file by extension (if "extension" is set) or by size
+ * (files strictly larger than "minSize" bytes), and selects the zlib
+ * level to use for it; level 0 stores the file.
+ */
+struct CompressionRule {
+    CompressionRule() : minSize(-1), level(0) {}
+
+    android::String8 extension;
+    long        minSize;
+    int         level;
+};
+
 /*
  * Bundle of goodies, including everything specified on the command line.
  */
@@ -66,7 +112,10 @@ public:
           mErrorOnMissingConfigEntry(false), mOutputTextSymbols(NULL),
           mSingleCrunchInputFile(NULL), mSingleCrunchOutputFile(NULL),
           mBuildSharedLibrary(false),
-          mBuildAppAsSharedLibrary(false),
+          mBuildAppAsSharedLibrary(false), mJobs(1), mCompressionLevel(9),
+          mMaxFragmentation(0.25), mResourceIdCacheSize(32768),
+          mUseResultCache(true), mRebuildResultCache(false), mBadgingFields(BADGING_ALL),
+          mDumpFormat(kDumpFormatText),
           mArgc(0), mArgv(NULL)
         {}
     ~Bundle(void) {}
@@ -219,6 +268,27 @@ public:
     void setBuildAppAsSharedLibrary(bool val) { mBuildAppAsSharedLibrary = val; }
     void setNoVersionVectors(bool val) { mNoVersionVectors = val; }
     bool getNoVersionVectors() const { return mNoVersionVectors; }
+    /* worker threads to use; 0 means one per CPU */
+    int getJobs() const { return mJobs; }
+    void setJobs(int val) { mJobs = val; }
+    int getCompressionLevel() const { return mCompressionLevel; }
+    void setCompressionLevel(int val) { mCompressionLevel = val; }
+    const android::Vector<CompressionRule>& getCompressionRules() const {
+        return mCompressionRules;
+    }
+    void addCompressionRule(const CompressionRule& rule) { mCompressionRules.add(rule); }
+    double getMaxFragmentation() const { return mMaxFragmentation; }
+    void setMaxFragmentation(double val) { mMaxFragmentation = val; }
+    size_t getResourceIdCacheSize() const { return mResourceIdCacheSize; }
+    void setResourceIdCacheSize(size_t val) { mResourceIdCacheSize = val; }
+    bool getUseResultCache() const { return mUseResultCache; }
+    void setUseResultCache(bool val) { mUseResultCache = val; }
+    bool getRebuildResultCache() const { return mRebuildResultCache; }
+    void setRebuildResultCache(bool val) { mRebuildResultCache = val; }
+    uint32_t getBadgingFields() const { return mBadgingFields; }
+    void setBadgingFields(uint32_t val) { mBadgingFields = val; }
+    DumpFormat getDumpFormat() const { return mDumpFormat; }
+    void setDumpFormat(DumpFormat val) { mDumpFormat = val; }
 
     /*
      * Set and get the file specification.
@@ -340,6 +410,15 @@ private:
     const char* mSingleCrunchOutputFile;
     bool        mBuildSharedLibrary;
     bool        mBuildAppAsSharedLibrary;
+    int         mJobs;
+    int         mCompressionLevel;
+    android::Vector<CompressionRule> mCompressionRules;
+    double      mMaxFragmentation;
+    size_t      mResourceIdCacheSize;
+    bool        mUseResultCache;
+    bool        mRebuildResultCache;
+    uint32_t    mBadgingFields;
+    DumpFormat  mDumpFormat;
     android::String8 mPlatformVersionCode;
     android::String8 mPlatformVersionName;
     android::String8 mPrivateSymbolsPackage;
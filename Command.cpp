@@ -6,12 +6,18 @@
 #include "AaptXml.h"
 #include "ApkBuilder.h"
 #include "Bundle.h"
+#include "DumpWriter.h"
 #include "Images.h"
 #include "Main.h"
 #include "ResourceFilter.h"
+#include "ResourceIdCache.h"
 #include "ResourceTable.h"
+#include "ResultCache.h"
+#include "SourcePos.h"
 #include "XMLNode.h"
 
+#include <androidfw/ZipFileRO.h>
+#include <utils/ByteOrder.h>
 #include <utils/Errors.h>
 #include <utils/KeyedVector.h>
 #include <utils/List.h>
@@ -22,10 +28,15 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <unistd.h>
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
 
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <vector>
 
 using namespace android;
 
@@ -247,8 +258,8 @@ bail:
     return result;
 }
 
-static void printResolvedResourceAttribute(const ResTable& resTable, const ResXMLTree& tree,
-        uint32_t attrRes, String8 attrLabel, String8* outError)
+static void printResolvedResourceAttribute(DumpWriter* out, const ResTable& resTable,
+        const ResXMLTree& tree, uint32_t attrRes, const char* attrLabel, String8* outError)
 {
     Res_value value;
     AaptXml::getResolvedResourceAttribute(resTable, tree, attrRes, &value, outError);
@@ -257,14 +268,12 @@ static void printResolvedResourceAttribute(const ResTable& resTable, const ResXM
         return;
     }
     if (value.dataType == Res_value::TYPE_STRING) {
-        String8 result = AaptXml::getResolvedAttribute(resTable, tree, attrRes, outError);
-        printf("%s='%s'", attrLabel.string(),
-                ResTable::normalizeForOutput(result.string()).string());
+        out->attr(attrLabel, AaptXml::getResolvedAttribute(resTable, tree, attrRes, outError));
     } else if (Res_value::TYPE_FIRST_INT <= value.dataType &&
             value.dataType <= Res_value::TYPE_LAST_INT) {
-        printf("%s='%d'", attrLabel.string(), value.data);
+        out->attr(attrLabel, (int32_t) value.data);
     } else {
-        printf("%s='0x%x'", attrLabel.string(), (int)value.data);
+        out->attr(attrLabel, String8::format("0x%x", (int)value.data));
     }
 }
 
@@ -325,12 +334,11 @@ String8 getComponentName(String8 &pkgName, String8 &componentName) {
     return retStr;
 }
 
-static void printCompatibleScreens(ResXMLTree& tree, String8* outError) {
+static void printCompatibleScreens(DumpWriter* out, ResXMLTree& tree, String8* outError) {
     size_t len;
     ResXMLTree::event_code_t code;
     int depth = 0;
-    bool first = true;
-    printf("compatible-screens:");
+    out->begin("compatible-screens", DumpWriter::STYLE_COMPACT);
     while ((code=tree.next()) != ResXMLTree::END_DOCUMENT && code != ResXMLTree::BAD_DOCUMENT) {
         if (code == ResXMLTree::END_TAG) {
             depth--;
@@ -355,48 +363,42 @@ static void printCompatibleScreens(ResXMLTree& tree, String8* outError) {
             int32_t screenDensity = AaptXml::getIntegerAttribute(tree,
                     SCREEN_DENSITY_ATTR);
             if (screenSize > 0 && screenDensity > 0) {
-                if (!first) {
-                    printf(",");
-                }
-                first = false;
-                printf("'%d/%d'", screenSize, screenDensity);
+                out->value(String8::format("%d/%d", screenSize, screenDensity), false);
             }
         }
     }
-    printf("\n");
+    out->end();
 }
 
-static void printUsesPermission(const String8& name, bool optional=false, int maxSdkVersion=-1) {
-    printf("uses-permission: name='%s'", ResTable::normalizeForOutput(name.string()).string());
+static void printPermission(DumpWriter* out, const char* record, const String8& name,
+        int maxSdkVersion) {
+    out->begin(record, DumpWriter::STYLE_SPACED);
+    out->attr("name", name);
     if (maxSdkVersion != -1) {
-         printf(" maxSdkVersion='%d'", maxSdkVersion);
+        out->attr("maxSdkVersion", maxSdkVersion);
     }
-    printf("\n");
+    out->end();
+}
 
+static void printUsesPermission(DumpWriter* out, const String8& name, bool optional=false,
+        int maxSdkVersion=-1) {
+    printPermission(out, "uses-permission", name, maxSdkVersion);
     if (optional) {
-        printf("optional-permission: name='%s'",
-                ResTable::normalizeForOutput(name.string()).string());
-        if (maxSdkVersion != -1) {
-            printf(" maxSdkVersion='%d'", maxSdkVersion);
-        }
-        printf("\n");
+        printPermission(out, "optional-permission", name, maxSdkVersion);
     }
 }
 
-static void printUsesPermissionSdk23(const String8& name, int maxSdkVersion=-1) {
-    printf("uses-permission-sdk-23: ");
-
-    printf("name='%s'", ResTable::normalizeForOutput(name.string()).string());
-    if (maxSdkVersion != -1) {
-        printf(" maxSdkVersion='%d'", maxSdkVersion);
-    }
-    printf("\n");
+static void printUsesPermissionSdk23(DumpWriter* out, const String8& name,
+        int maxSdkVersion=-1) {
+    printPermission(out, "uses-permission-sdk-23", name, maxSdkVersion);
 }
 
-static void printUsesImpliedPermission(const String8& name, const String8& reason) {
-    printf("uses-implied-permission: name='%s' reason='%s'\n",
-            ResTable::normalizeForOutput(name.string()).string(),
-            ResTable::normalizeForOutput(reason.string()).string());
+static void printUsesImpliedPermission(DumpWriter* out, const String8& name,
+        const String8& reason) {
+    out->begin("uses-implied-permission", DumpWriter::STYLE_SPACED);
+    out->attr("name", name);
+    out->attr("reason", reason);
+    out->end();
 }
 
 Vector<String8> getNfcAidCategories(AssetManager& assets, String8 xmlPath, bool offHost,
@@ -464,8 +466,10 @@ Vector<String8> getNfcAidCategories(AssetManager& assets, String8 xmlPath, bool
     return categories;
 }
 
-static void printComponentPresence(const char* componentName) {
-    printf("provides-component:'%s'\n", componentName);
+static void printComponentPresence(DumpWriter* out, const char* componentName) {
+    out->begin("provides-component", DumpWriter::STYLE_COMPACT);
+    out->value(String8(componentName), false);
+    out->end();
 }
 
 /**
@@ -556,12 +560,16 @@ static void addImpliedFeature(KeyedVector<String8, ImpliedFeature>* impliedFeatu
     feature->reasons.add(reason);
 }
 
-static void printFeatureGroupImpl(const FeatureGroup& grp,
+static void printFeatureGroupImpl(DumpWriter* out, const FeatureGroup& grp,
                                   const KeyedVector<String8, ImpliedFeature>* impliedFeatures) {
-    printf("feature-group: label='%s'\n", grp.label.string());
+    out->begin("feature-group", DumpWriter::STYLE_SPACED);
+    out->attr("label", grp.label, false);
+    out->end();
 
     if (grp.openGLESVersion > 0) {
-        printf("  uses-gl-es: '0x%x'\n", grp.openGLESVersion);
+        out->begin("uses-gl-es", DumpWriter::STYLE_SPACED, 1);
+        out->value(String8::format("0x%x", grp.openGLESVersion), false);
+        out->end();
     }
 
     const size_t numFeatures = grp.features.size();
@@ -570,14 +578,13 @@ static void printFeatureGroupImpl(const FeatureGroup& grp,
         const bool required = feature.required;
         const int32_t version = feature.version;
 
-        const String8& featureName = grp.features.keyAt(i);
-        printf("  uses-feature%s: name='%s'", (required ? "" : "-not-required"),
-                ResTable::normalizeForOutput(featureName.string()).string());
-
+        out->begin("uses-feature", DumpWriter::STYLE_SPACED, 1);
+        out->qualifier("required", required);
+        out->attr("name", grp.features.keyAt(i));
         if (version > 0) {
-            printf(" version='%d'", version);
+            out->attr("version", version);
         }
-        printf("\n");
+        out->end();
     }
 
     const size_t numImpliedFeatures =
@@ -590,33 +597,38 @@ static void printFeatureGroupImpl(const FeatureGroup& grp,
             continue;
         }
 
-        String8 printableFeatureName(ResTable::normalizeForOutput(
-                    impliedFeature.name.string()));
-        const char* sdk23Suffix = impliedFeature.impliedBySdk23 ? "-sdk-23" : "";
+        const bool sdk23 = impliedFeature.impliedBySdk23;
+
+        out->begin("uses-feature", DumpWriter::STYLE_SPACED, 1);
+        out->qualifier("sdk23", sdk23);
+        out->attr("name", impliedFeature.name);
+        out->end();
 
-        printf("  uses-feature%s: name='%s'\n", sdk23Suffix, printableFeatureName.string());
-        printf("  uses-implied-feature%s: name='%s' reason='", sdk23Suffix,
-               printableFeatureName.string());
+        String8 reason;
         const size_t numReasons = impliedFeature.reasons.size();
         for (size_t j = 0; j < numReasons; j++) {
-            printf("%s", impliedFeature.reasons[j].string());
+            reason.append(impliedFeature.reasons[j]);
             if (j + 2 < numReasons) {
-                printf(", ");
+                reason.append(", ");
             } else if (j + 1 < numReasons) {
-                printf(", and ");
+                reason.append(", and ");
             }
         }
-        printf("'\n");
+        out->begin("uses-implied-feature", DumpWriter::STYLE_SPACED, 1);
+        out->qualifier("sdk23", sdk23);
+        out->attr("name", impliedFeature.name);
+        out->attr("reason", reason, false);
+        out->end();
     }
 }
 
-static void printFeatureGroup(const FeatureGroup& grp) {
-    printFeatureGroupImpl(grp, NULL);
+static void printFeatureGroup(DumpWriter* out, const FeatureGroup& grp) {
+    printFeatureGroupImpl(out, grp, NULL);
 }
 
-static void printDefaultFeatureGroup(const FeatureGroup& grp,
+static void printDefaultFeatureGroup(DumpWriter* out, const FeatureGroup& grp,
                                      const KeyedVector<String8, ImpliedFeature>& impliedFeatures) {
-    printFeatureGroupImpl(grp, &impliedFeatures);
+    printFeatureGroupImpl(out, grp, &impliedFeatures);
 }
 
 static void addParentFeatures(FeatureGroup* grp, const String8& name) {
@@ -721,10 +733,177 @@ static void addImpliedFeaturesForPermission(const int targetSdk, const String8&
 }
 
 /*
- * Handle the "dump" command, to extract select data from an archive.
+ * Writes the resource table as records: one "package" per package, one
+ * "resource" per entry and configuration, and a "bag-item" for each item
+ * of a bag.  With "inclValues", each value is also given in readable form.
+ */
+class ResTableWriter : public ResTable::EntryVisitor {
+public:
+    ResTableWriter(DumpWriter* out, bool inclValues)
+        : mOut(out), mInclValues(inclValues) {}
+
+    virtual void visitPackage(uint32_t id, const String8& name) {
+        mOut->begin("package", DumpWriter::STYLE_SPACED);
+        mOut->attr("id", String8::format("0x%02x", id), false);
+        mOut->attr("name", name);
+        mOut->end();
+    }
+
+    virtual void visitEntry(uint32_t resID, const ResTable::resource_name* resName,
+            const ResTable_config& config, uint16_t flags, const Res_value* value,
+            uint32_t bagParent, const ResStringPool* strings) {
+        mOut->begin("resource", DumpWriter::STYLE_SPACED, 1);
+        mOut->attr("id", String8::format("0x%08x", resID), false);
+        if (resName != NULL) {
+            String8 name(resName->package, resName->packageLen);
+            name.append(":");
+            name.append(resName->type8 != NULL ? String8(resName->type8, resName->typeLen)
+                    : String8(resName->type, resName->typeLen));
+            name.append("/");
+            name.append(resName->name8 != NULL ? String8(resName->name8, resName->nameLen)
+                    : String8(resName->name, resName->nameLen));
+            mOut->attr("name", name);
+        }
+        String8 configStr = config.toString();
+        mOut->attr("config", configStr.size() > 0 ? configStr : String8("(default)"), false);
+        if ((flags & ResTable_entry::FLAG_PUBLIC) != 0) {
+            mOut->attr("public", String8("true"), false);
+        }
+        if ((flags & ResTable_entry::FLAG_OVERLAY) != 0) {
+            mOut->attr("overlay", String8("true"), false);
+        }
+        if (value != NULL) {
+            writeValue(*value, strings);
+        } else {
+            mOut->attr("bag", String8("true"), false);
+            mOut->attr("parent", String8::format("0x%08x", bagParent), false);
+        }
+        mOut->end();
+    }
+
+    virtual void visitBagItem(uint32_t key, const Res_value& value,
+            const ResStringPool* strings) {
+        mOut->begin("bag-item", DumpWriter::STYLE_SPACED, 2);
+        mOut->attr("key", String8::format("0x%08x", key), false);
+        writeValue(value, strings);
+        mOut->end();
+    }
+
+private:
+    void writeValue(const Res_value& value, const ResStringPool* strings) {
+        mOut->attr("type", String8::format("0x%02x", (int) value.dataType), false);
+        mOut->attr("data", String8::format("0x%08x", value.data), false);
+        if (!mInclValues) {
+            return;
+        }
+        String8 str;
+        switch (value.dataType) {
+            case Res_value::TYPE_NULL:
+                break;
+            case Res_value::TYPE_STRING:
+                str = strings->string8ObjectAt(value.data);
+                break;
+            case Res_value::TYPE_REFERENCE:
+            case Res_value::TYPE_DYNAMIC_REFERENCE:
+                str = String8::format("@0x%08x", value.data);
+                break;
+            case Res_value::TYPE_ATTRIBUTE:
+            case Res_value::TYPE_DYNAMIC_ATTRIBUTE:
+                str = String8::format("?0x%08x", value.data);
+                break;
+            case Res_value::TYPE_FLOAT:
+                str = String8::format("%g", *(const float*)&value.data);
+                break;
+            case Res_value::TYPE_INT_BOOLEAN:
+                str = value.data ? "true" : "false";
+                break;
+            default:
+                if (value.dataType >= Res_value::TYPE_FIRST_COLOR_INT
+                        && value.dataType <= Res_value::TYPE_LAST_COLOR_INT) {
+                    str = String8::format("#%08x", value.data);
+                } else if (value.dataType >= Res_value::TYPE_FIRST_INT
+                        && value.dataType <= Res_value::TYPE_LAST_INT) {
+                    str = String8::format("%d", (int32_t) value.data);
+                } else {
+                    // dimensions and fractions are left to the reader
+                    return;
+                }
+                break;
+        }
+        mOut->attr("value", str);
+    }
+
+    DumpWriter* const mOut;
+    const bool mInclValues;
+};
+
+static void writeResTable(DumpWriter* out, const ResTable& res, bool inclValues)
+{
+    ResTableWriter writer(out, inclValues);
+    res.visit(&writer);
+}
+
+/*
+ * Say whether the resource table of "filename" is used where it lies in
+ * the file or has to be copied to the heap, which is what decides how much
+ * memory a dump takes.  The AssetManager maps resources.arsc when it is
+ * stored uncompressed at a 4-byte aligned offset and parses it in place;
+ * anything else is inflated or copied first.
+ */
+static void reportResourceTableStorage(const char* filename)
+{
+    ZipFileRO* zip = ZipFileRO::open(filename);
+    if (zip == NULL) {
+        return;
+    }
+    ZipEntryRO entry = zip->findEntryByName("resources.arsc");
+    uint16_t method;
+    uint32_t uncompressedLen;
+    off64_t offset;
+    if (entry == NULL) {
+        fprintf(stderr, "resources.arsc: none\n");
+    } else if (zip->getEntryInfo(entry, &method, &uncompressedLen, NULL, &offset, NULL, NULL)) {
+        const char* how;
+        if (method != ZipFileRO::kCompressStored) {
+            how = "inflated to the heap (stored compressed)";
+        } else if ((offset & 0x3) != 0) {
+            how = "copied to the heap (not 4-byte aligned; run zipalign)";
+        } else if (htods(0xf0) != 0xf0) {
+            how = "copied to the heap (big-endian host)";
+        } else {
+            how = "mapped from the APK";
+        }
+        fprintf(stderr, "resources.arsc: %u bytes %s\n", uncompressedLen, how);
+    }
+    if (entry != NULL) {
+        zip->releaseEntry(entry);
+    }
+    delete zip;
+}
+
+/*
+ * Print the most memory the process has had resident at once.
+ */
+static void reportPeakMemory()
+{
+#if !defined(_WIN32)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(__APPLE__)
+        const long kb = usage.ru_maxrss / 1024;     // bytes on Darwin
+#else
+        const long kb = usage.ru_maxrss;
+#endif
+        fprintf(stderr, "peak RSS: %ld KB\n", kb);
+    }
+#endif
+}
+
+/*
+ * Dump select data from an archive.
  */
 extern char CONSOLE_DATA[2925]; // see EOF
-int doDump(Bundle* bundle)
+static int dumpArchive(Bundle* bundle)
 {
     status_t result = UNKNOWN_ERROR;
 
@@ -741,6 +920,14 @@ int doDump(Bundle* bundle)
     const char* option = bundle->getFileSpecEntry(0);
     const char* filename = bundle->getFileSpecEntry(1);
 
+    if (bundle->getDumpFormat() != kDumpFormatText
+            && strcmp("badging", option) != 0 && strcmp("permissions", option) != 0
+            && strcmp("resources", option) != 0 && strcmp("strings", option) != 0
+            && strcmp("xmltree", option) != 0) {
+        fprintf(stderr, "ERROR: dump %s only supports --format text\n", option);
+        return 1;
+    }
+
     AssetManager assets;
     int32_t assetsCookie;
     if (!assets.addAssetPath(String8(filename), &assetsCookie)) {
@@ -773,6 +960,9 @@ int doDump(Bundle* bundle)
         fprintf(stderr, "ERROR: dump failed because the resource table is invalid/corrupt.\n");
         return 1;
     }
+    if (bundle->getVerbose()) {
+        reportResourceTableStorage(filename);
+    }
 
     // Source for AndroidManifest.xml
     const String8 manifestFile = String8::format("%s@AndroidManifest.xml", filename);
@@ -783,14 +973,27 @@ int doDump(Bundle* bundle)
 
     Asset* asset = NULL;
 
+    // Everything but the text form of resources, strings and xmltree goes
+    // through here, so nothing else may print to stdout while it's open.
+    DumpWriter* out = DumpWriter::create(bundle->getDumpFormat(), stdout);
+    const bool textFormat = out->getFormat() == kDumpFormatText;
+
     if (strcmp("resources", option) == 0) {
+        if (!textFormat) {
+            writeResTable(out, res, bundle->getValues());
+        } else {
 #ifndef __ANDROID__
-        res.print(bundle->getValues());
+            res.print(bundle->getValues());
 #endif
+        }
 
     } else if (strcmp("strings", option) == 0) {
         const ResStringPool* pool = res.getTableStringBlock(0);
-        printStringPool(pool);
+        if (!textFormat) {
+            writeStringPool(out, pool);
+        } else {
+            printStringPool(pool);
+        }
 
     } else if (strcmp("xmltree", option) == 0) {
         if (bundle->getFileSpecCount() < 3) {
@@ -813,7 +1016,14 @@ int doDump(Bundle* bundle)
                 goto bail;
             }
             tree.restart();
-            printXMLBlock(&tree);
+            if (!textFormat) {
+                out->begin("file", DumpWriter::STYLE_PLAIN);
+                out->value(String8(resname), false);
+                out->end();
+                writeXMLBlock(out, &tree);
+            } else {
+                printXMLBlock(&tree);
+            }
             tree.uninit();
             delete asset;
             asset = NULL;
@@ -885,8 +1095,9 @@ int doDump(Bundle* bundle)
                         fprintf(stderr, "ERROR: manifest does not start with <manifest> tag\n");
                         goto bail;
                     }
-                    String8 pkg = AaptXml::getAttribute(tree, NULL, "package", NULL);
-                    printf("package: %s\n", ResTable::normalizeForOutput(pkg.string()).string());
+                    out->begin("package", DumpWriter::STYLE_PLAIN);
+                    out->value(AaptXml::getAttribute(tree, NULL, "package", NULL));
+                    out->end();
                 } else if (depth == 2) {
                     if (tag == "permission") {
                         String8 error;
@@ -900,8 +1111,9 @@ int doDump(Bundle* bundle)
                             fprintf(stderr, "ERROR: missing 'android:name' for permission\n");
                             goto bail;
                         }
-                        printf("permission: %s\n",
-                                ResTable::normalizeForOutput(name.string()).string());
+                        out->begin("permission", DumpWriter::STYLE_PLAIN);
+                        out->value(name);
+                        out->end();
                     } else if (tag == "uses-permission") {
                         String8 error;
                         String8 name = AaptXml::getAttribute(tree, NAME_ATTR, &error);
@@ -914,7 +1126,7 @@ int doDump(Bundle* bundle)
                             fprintf(stderr, "ERROR: missing 'android:name' for uses-permission\n");
                             goto bail;
                         }
-                        printUsesPermission(name,
+                        printUsesPermission(out, name,
                                 AaptXml::getIntegerAttribute(tree, REQUIRED_ATTR, 1) == 0,
                                 AaptXml::getIntegerAttribute(tree, MAX_SDK_VERSION_ATTR));
                     } else if (tag == "uses-permission-sdk-23" || tag == "uses-permission-sdk-m") {
@@ -930,26 +1142,39 @@ int doDump(Bundle* bundle)
                                     "uses-permission-sdk-23\n");
                             goto bail;
                         }
-                        printUsesPermissionSdk23(
+                        printUsesPermissionSdk23(out,
                                 name,
                                 AaptXml::getIntegerAttribute(tree, MAX_SDK_VERSION_ATTR));
                     }
                 }
             }
         } else if (strcmp("badging", option) == 0) {
+            // Work that only feeds groups nobody asked for is skipped, so a
+            // field that isn't printed may go unchecked too.
+            const uint32_t fields = bundle->getBadgingFields();
+            const bool wantLabels = (fields & (BADGING_LABEL | BADGING_APPLICATION)) != 0;
+            const bool wantPermissions = (fields & BADGING_PERMISSIONS) != 0;
+            const bool wantFeatures = (fields & BADGING_FEATURES) != 0;
+            const bool wantComponents = (fields & BADGING_COMPONENTS) != 0;
+            const bool wantScreens = (fields & BADGING_SCREENS) != 0;
+
             Vector<String8> locales;
-            res.getLocales(&locales);
+            if (fields & (BADGING_LABEL | BADGING_APPLICATION | BADGING_LOCALES)) {
+                res.getLocales(&locales);
+            }
 
-            Vector<ResTable_config> configs;
-            res.getConfigurations(&configs);
             SortedVector<int> densities;
-            const size_t NC = configs.size();
-            for (size_t i=0; i<NC; i++) {
-                int dens = configs[i].density;
-                if (dens == 0) {
-                    dens = 160;
+            if (fields & (BADGING_ICON | BADGING_DENSITIES)) {
+                Vector<ResTable_config> configs;
+                res.getConfigurations(&configs);
+                const size_t NC = configs.size();
+                for (size_t i=0; i<NC; i++) {
+                    int dens = configs[i].density;
+                    if (dens == 0) {
+                        dens = 160;
+                    }
+                    densities.add(dens);
                 }
-                densities.add(dens);
             }
 
             size_t len;
@@ -1079,50 +1304,41 @@ int doDump(Bundle* bundle)
                     depth--;
                     if (depth < 2) {
                         if (withinSupportsInput && !supportedInput.isEmpty()) {
-                            printf("supports-input: '");
+                            out->begin("supports-input", DumpWriter::STYLE_SPACED);
                             const size_t N = supportedInput.size();
                             for (size_t i=0; i<N; i++) {
-                                printf("%s", ResTable::normalizeForOutput(
-                                        supportedInput[i].string()).string());
-                                if (i != N - 1) {
-                                    printf("' '");
-                                } else {
-                                    printf("'\n");
-                                }
+                                out->value(supportedInput[i]);
                             }
+                            out->end();
                             supportedInput.clear();
                         }
                         withinApplication = false;
                         withinSupportsInput = false;
                         withinFeatureGroup = false;
                     } else if (depth < 3) {
-                        if (withinActivity && isMainActivity) {
+                        if (withinActivity && isMainActivity && wantComponents) {
                             String8 aName(getComponentName(pkg, activityName));
                             if (isLauncherActivity) {
-                                printf("launchable-activity:");
+                                out->begin("launchable-activity", DumpWriter::STYLE_SPACED);
                                 if (aName.length() > 0) {
-                                    printf(" name='%s' ",
-                                            ResTable::normalizeForOutput(aName.string()).string());
+                                    out->attr("name", aName);
+                                    out->pad();
                                 }
-                                printf(" label='%s' icon='%s'\n",
-                                       ResTable::normalizeForOutput(activityLabel.string())
-                                                .string(),
-                                       ResTable::normalizeForOutput(activityIcon.string())
-                                                .string());
+                                out->attr("label", activityLabel);
+                                out->attr("icon", activityIcon);
+                                out->end();
                             }
                             if (isLeanbackLauncherActivity) {
-                                printf("leanback-launchable-activity:");
+                                out->begin("leanback-launchable-activity",
+                                        DumpWriter::STYLE_SPACED);
                                 if (aName.length() > 0) {
-                                    printf(" name='%s' ",
-                                            ResTable::normalizeForOutput(aName.string()).string());
+                                    out->attr("name", aName);
+                                    out->pad();
                                 }
-                                printf(" label='%s' icon='%s' banner='%s'\n",
-                                       ResTable::normalizeForOutput(activityLabel.string())
-                                                .string(),
-                                       ResTable::normalizeForOutput(activityIcon.string())
-                                                .string(),
-                                       ResTable::normalizeForOutput(activityBanner.string())
-                                                .string());
+                                out->attr("label", activityLabel);
+                                out->attr("icon", activityIcon);
+                                out->attr("banner", activityBanner);
+                                out->end();
                             }
                         }
                         if (!hasIntentFilter) {
@@ -1199,8 +1415,15 @@ int doDump(Bundle* bundle)
                         goto bail;
                     }
                     pkg = AaptXml::getAttribute(tree, NULL, "package", NULL);
-                    printf("package: name='%s' ",
-                            ResTable::normalizeForOutput(pkg.string()).string());
+                    if (!(fields & BADGING_PACKAGE)) {
+                        // Everything else comes from further in.
+                        if (!(fields & ~(BADGING_LOCALES | BADGING_DENSITIES))) {
+                            break;
+                        }
+                        continue;
+                    }
+                    out->begin("package", DumpWriter::STYLE_SPACED);
+                    out->attr("name", pkg);
                     int32_t versionCode = AaptXml::getIntegerAttribute(tree, VERSION_CODE_ATTR,
                             &error);
                     if (error != "") {
@@ -1209,9 +1432,9 @@ int doDump(Bundle* bundle)
                         goto bail;
                     }
                     if (versionCode > 0) {
-                        printf("versionCode='%d' ", versionCode);
+                        out->attr("versionCode", versionCode);
                     } else {
-                        printf("versionCode='' ");
+                        out->attr("versionCode", String8(), false);
                     }
                     String8 versionName = AaptXml::getResolvedAttribute(res, tree,
                             VERSION_NAME_ATTR, &error);
@@ -1220,19 +1443,17 @@ int doDump(Bundle* bundle)
                                 error.string());
                         goto bail;
                     }
-                    printf("versionName='%s'",
-                            ResTable::normalizeForOutput(versionName.string()).string());
+                    out->attr("versionName", versionName);
 
                     String8 splitName = AaptXml::getAttribute(tree, NULL, "split");
                     if (!splitName.isEmpty()) {
-                        printf(" split='%s'", ResTable::normalizeForOutput(
-                                    splitName.string()).string());
+                        out->attr("split", splitName);
                     }
 
                     String8 platformVersionName = AaptXml::getAttribute(tree, NULL,
                             "platformBuildVersionName");
-                    printf(" platformBuildVersionName='%s'", platformVersionName.string());
-                    printf("\n");
+                    out->attr("platformBuildVersionName", platformVersionName, false);
+                    out->end();
 
                     int32_t installLocation = AaptXml::getResolvedIntegerAttribute(res, tree,
                             INSTALL_LOCATION_ATTR, &error);
@@ -1243,22 +1464,28 @@ int doDump(Bundle* bundle)
                     }
 
                     if (installLocation >= 0) {
-                        printf("install-location:'");
+                        const char* location;
                         switch (installLocation) {
                             case 0:
-                                printf("auto");
+                                location = "auto";
                                 break;
                             case 1:
-                                printf("internalOnly");
+                                location = "internalOnly";
                                 break;
                             case 2:
-                                printf("preferExternal");
+                                location = "preferExternal";
                                 break;
                             default:
                                 fprintf(stderr, "Invalid installLocation %d\n", installLocation);
                                 goto bail;
                         }
-                        printf("'\n");
+                        out->begin("install-location", DumpWriter::STYLE_COMPACT);
+                        out->value(String8(location), false);
+                        out->end();
+                    }
+
+                    if (!(fields & ~(BADGING_PACKAGE | BADGING_LOCALES | BADGING_DENSITIES))) {
+                        break;
                     }
                 } else if (depth == 2) {
                     withinApplication = false;
@@ -1266,7 +1493,7 @@ int doDump(Bundle* bundle)
                         withinApplication = true;
 
                         String8 label;
-                        const size_t NL = locales.size();
+                        const size_t NL = wantLabels ? locales.size() : 0;
                         for (size_t i=0; i<NL; i++) {
                             const char* localeStr =  locales[i].string();
                             assets.setLocale(localeStr != NULL ? localeStr : "");
@@ -1275,85 +1502,103 @@ int doDump(Bundle* bundle)
                             if (llabel != "") {
                                 if (localeStr == NULL || strlen(localeStr) == 0) {
                                     label = llabel;
-                                    printf("application-label:'%s'\n",
-                                            ResTable::normalizeForOutput(llabel.string()).string());
+                                    if (fields & BADGING_LABEL) {
+                                        out->begin("application-label",
+                                                DumpWriter::STYLE_COMPACT);
+                                        out->value(llabel);
+                                        out->end();
+                                    }
                                 } else {
                                     if (label == "") {
                                         label = llabel;
                                     }
-                                    printf("application-label-%s:'%s'\n", localeStr,
-                                           ResTable::normalizeForOutput(llabel.string()).string());
+                                    if (fields & BADGING_LABEL) {
+                                        out->begin("application-label",
+                                                DumpWriter::STYLE_COMPACT);
+                                        out->qualifier("locale", String8(localeStr));
+                                        out->value(llabel);
+                                        out->end();
+                                    }
                                 }
                             }
                         }
 
                         ResTable_config tmpConfig = config;
-                        const size_t ND = densities.size();
+                        const size_t ND = (fields & BADGING_ICON) ? densities.size() : 0;
                         for (size_t i=0; i<ND; i++) {
                             tmpConfig.density = densities[i];
                             assets.setConfiguration(tmpConfig);
                             String8 icon = AaptXml::getResolvedAttribute(res, tree, ICON_ATTR,
                                     &error);
                             if (icon != "") {
-                                printf("application-icon-%d:'%s'\n", densities[i],
-                                        ResTable::normalizeForOutput(icon.string()).string());
+                                out->begin("application-icon", DumpWriter::STYLE_COMPACT);
+                                out->qualifier("density", (int32_t) densities[i]);
+                                out->value(icon);
+                                out->end();
                             }
                         }
                         assets.setConfiguration(config);
 
-                        String8 icon = AaptXml::getResolvedAttribute(res, tree, ICON_ATTR, &error);
-                        if (error != "") {
-                            fprintf(stderr, "ERROR getting 'android:icon' attribute: %s\n",
-                                    error.string());
-                            goto bail;
-                        }
-                        int32_t testOnly = AaptXml::getIntegerAttribute(tree, TEST_ONLY_ATTR, 0,
-                                &error);
-                        if (error != "") {
-                            fprintf(stderr, "ERROR getting 'android:testOnly' attribute: %s\n",
-                                    error.string());
-                            goto bail;
-                        }
+                        if (fields & BADGING_APPLICATION) {
+                            String8 icon = AaptXml::getResolvedAttribute(res, tree, ICON_ATTR,
+                                    &error);
+                            if (error != "") {
+                                fprintf(stderr, "ERROR getting 'android:icon' attribute: %s\n",
+                                        error.string());
+                                goto bail;
+                            }
+                            int32_t testOnly = AaptXml::getIntegerAttribute(tree, TEST_ONLY_ATTR,
+                                    0, &error);
+                            if (error != "") {
+                                fprintf(stderr, "ERROR getting 'android:testOnly' attribute: %s\n",
+                                        error.string());
+                                goto bail;
+                            }
 
-                        String8 banner = AaptXml::getResolvedAttribute(res, tree, BANNER_ATTR,
-                                                                       &error);
-                        if (error != "") {
-                            fprintf(stderr, "ERROR getting 'android:banner' attribute: %s\n",
-                                    error.string());
-                            goto bail;
-                        }
-                        printf("application: label='%s' ",
-                                ResTable::normalizeForOutput(label.string()).string());
-                        printf("icon='%s'", ResTable::normalizeForOutput(icon.string()).string());
-                        if (banner != "") {
-                            printf(" banner='%s'",
-                                   ResTable::normalizeForOutput(banner.string()).string());
-                        }
-                        printf("\n");
-                        if (testOnly != 0) {
-                            printf("testOnly='%d'\n", testOnly);
-                        }
+                            String8 banner = AaptXml::getResolvedAttribute(res, tree, BANNER_ATTR,
+                                                                           &error);
+                            if (error != "") {
+                                fprintf(stderr, "ERROR getting 'android:banner' attribute: %s\n",
+                                        error.string());
+                                goto bail;
+                            }
+                            out->begin("application", DumpWriter::STYLE_SPACED);
+                            out->attr("label", label);
+                            out->attr("icon", icon);
+                            if (banner != "") {
+                                out->attr("banner", banner);
+                            }
+                            out->end();
+                            if (testOnly != 0) {
+                                out->begin("testOnly", DumpWriter::STYLE_ASSIGN);
+                                out->value(testOnly);
+                                out->end();
+                            }
 
-                        int32_t isGame = AaptXml::getResolvedIntegerAttribute(res, tree,
-                                ISGAME_ATTR, 0, &error);
-                        if (error != "") {
-                            fprintf(stderr, "ERROR getting 'android:isGame' attribute: %s\n",
-                                    error.string());
-                            goto bail;
-                        }
-                        if (isGame != 0) {
-                            printf("application-isGame\n");
-                        }
+                            int32_t isGame = AaptXml::getResolvedIntegerAttribute(res, tree,
+                                    ISGAME_ATTR, 0, &error);
+                            if (error != "") {
+                                fprintf(stderr, "ERROR getting 'android:isGame' attribute: %s\n",
+                                        error.string());
+                                goto bail;
+                            }
+                            if (isGame != 0) {
+                                out->begin("application-isGame", DumpWriter::STYLE_FLAG);
+                                out->end();
+                            }
 
-                        int32_t debuggable = AaptXml::getResolvedIntegerAttribute(res, tree,
-                                DEBUGGABLE_ATTR, 0, &error);
-                        if (error != "") {
-                            fprintf(stderr, "ERROR getting 'android:debuggable' attribute: %s\n",
-                                    error.string());
-                            goto bail;
-                        }
-                        if (debuggable != 0) {
-                            printf("application-debuggable\n");
+                            int32_t debuggable = AaptXml::getResolvedIntegerAttribute(res, tree,
+                                    DEBUGGABLE_ATTR, 0, &error);
+                            if (error != "") {
+                                fprintf(stderr,
+                                        "ERROR getting 'android:debuggable' attribute: %s\n",
+                                        error.string());
+                                goto bail;
+                            }
+                            if (debuggable != 0) {
+                                out->begin("application-debuggable", DumpWriter::STYLE_FLAG);
+                                out->end();
+                            }
                         }
 
                         // We must search by name because the multiArch flag hasn't been API
@@ -1383,15 +1628,24 @@ int doDump(Bundle* bundle)
                                 goto bail;
                             }
                             if (name == "Donut") targetSdk = 4;
-                            printf("sdkVersion:'%s'\n",
-                                    ResTable::normalizeForOutput(name.string()).string());
+                            if (fields & BADGING_SDK) {
+                                out->begin("sdkVersion", DumpWriter::STYLE_COMPACT);
+                                out->value(name);
+                                out->end();
+                            }
                         } else if (code != -1) {
                             targetSdk = code;
-                            printf("sdkVersion:'%d'\n", code);
+                            if (fields & BADGING_SDK) {
+                                out->begin("sdkVersion", DumpWriter::STYLE_COMPACT);
+                                out->value(code);
+                                out->end();
+                            }
                         }
                         code = AaptXml::getIntegerAttribute(tree, MAX_SDK_VERSION_ATTR);
-                        if (code != -1) {
-                            printf("maxSdkVersion:'%d'\n", code);
+                        if (code != -1 && (fields & BADGING_SDK)) {
+                            out->begin("maxSdkVersion", DumpWriter::STYLE_COMPACT);
+                            out->value(code);
+                            out->end();
                         }
                         code = AaptXml::getIntegerAttribute(tree, TARGET_SDK_VERSION_ATTR, &error);
                         if (error != "") {
@@ -1405,15 +1659,22 @@ int doDump(Bundle* bundle)
                                 goto bail;
                             }
                             if (name == "Donut" && targetSdk < 4) targetSdk = 4;
-                            printf("targetSdkVersion:'%s'\n",
-                                    ResTable::normalizeForOutput(name.string()).string());
+                            if (fields & BADGING_SDK) {
+                                out->begin("targetSdkVersion", DumpWriter::STYLE_COMPACT);
+                                out->value(name);
+                                out->end();
+                            }
                         } else if (code != -1) {
                             if (targetSdk < code) {
                                 targetSdk = code;
                             }
-                            printf("targetSdkVersion:'%d'\n", code);
+                            if (fields & BADGING_SDK) {
+                                out->begin("targetSdkVersion", DumpWriter::STYLE_COMPACT);
+                                out->value(code);
+                                out->end();
+                            }
                         }
-                    } else if (tag == "uses-configuration") {
+                    } else if (tag == "uses-configuration" && wantFeatures) {
                         int32_t reqTouchScreen = AaptXml::getIntegerAttribute(tree,
                                 REQ_TOUCH_SCREEN_ATTR, 0);
                         int32_t reqKeyboardType = AaptXml::getIntegerAttribute(tree,
@@ -1424,26 +1685,26 @@ int doDump(Bundle* bundle)
                                 REQ_NAVIGATION_ATTR, 0);
                         int32_t reqFiveWayNav = AaptXml::getIntegerAttribute(tree,
                                 REQ_FIVE_WAY_NAV_ATTR, 0);
-                        printf("uses-configuration:");
+                        out->begin("uses-configuration", DumpWriter::STYLE_SPACED);
                         if (reqTouchScreen != 0) {
-                            printf(" reqTouchScreen='%d'", reqTouchScreen);
+                            out->attr("reqTouchScreen", reqTouchScreen);
                         }
                         if (reqKeyboardType != 0) {
-                            printf(" reqKeyboardType='%d'", reqKeyboardType);
+                            out->attr("reqKeyboardType", reqKeyboardType);
                         }
                         if (reqHardKeyboard != 0) {
-                            printf(" reqHardKeyboard='%d'", reqHardKeyboard);
+                            out->attr("reqHardKeyboard", reqHardKeyboard);
                         }
                         if (reqNavigation != 0) {
-                            printf(" reqNavigation='%d'", reqNavigation);
+                            out->attr("reqNavigation", reqNavigation);
                         }
                         if (reqFiveWayNav != 0) {
-                            printf(" reqFiveWayNav='%d'", reqFiveWayNav);
+                            out->attr("reqFiveWayNav", reqFiveWayNav);
                         }
-                        printf("\n");
-                    } else if (tag == "supports-input") {
+                        out->end();
+                    } else if (tag == "supports-input" && wantFeatures) {
                         withinSupportsInput = true;
-                    } else if (tag == "supports-screens") {
+                    } else if (tag == "supports-screens" && wantScreens) {
                         smallScreen = AaptXml::getIntegerAttribute(tree,
                                 SMALL_SCREEN_ATTR, 1);
                         normalScreen = AaptXml::getIntegerAttribute(tree,
@@ -1460,7 +1721,7 @@ int doDump(Bundle* bundle)
                                 COMPATIBLE_WIDTH_LIMIT_DP_ATTR, 0);
                         largestWidthLimitDp = AaptXml::getIntegerAttribute(tree,
                                 LARGEST_WIDTH_LIMIT_DP_ATTR, 0);
-                    } else if (tag == "feature-group") {
+                    } else if (tag == "feature-group" && wantFeatures) {
                         withinFeatureGroup = true;
                         FeatureGroup group;
                         group.label = AaptXml::getResolvedAttribute(res, tree, LABEL_ATTR, &error);
@@ -1471,7 +1732,7 @@ int doDump(Bundle* bundle)
                         }
                         featureGroups.add(group);
 
-                    } else if (tag == "uses-feature") {
+                    } else if (tag == "uses-feature" && wantFeatures) {
                         String8 name = AaptXml::getAttribute(tree, NAME_ATTR, &error);
                         if (name != "" && error == "") {
                             const char* androidSchema =
@@ -1508,7 +1769,7 @@ int doDump(Bundle* bundle)
                                 }
                             }
                         }
-                    } else if (tag == "uses-permission") {
+                    } else if (tag == "uses-permission" && (wantPermissions || wantFeatures)) {
                         String8 name = AaptXml::getAttribute(tree, NAME_ATTR, &error);
                         if (error != "") {
                             fprintf(stderr, "ERROR getting 'android:name' attribute: %s\n",
@@ -1539,11 +1800,14 @@ int doDump(Bundle* bundle)
                             hasWriteCallLogPermission = true;
                         }
 
-                        printUsesPermission(name,
-                                AaptXml::getIntegerAttribute(tree, REQUIRED_ATTR, 1) == 0,
-                                AaptXml::getIntegerAttribute(tree, MAX_SDK_VERSION_ATTR));
+                        if (wantPermissions) {
+                            printUsesPermission(out, name,
+                                    AaptXml::getIntegerAttribute(tree, REQUIRED_ATTR, 1) == 0,
+                                    AaptXml::getIntegerAttribute(tree, MAX_SDK_VERSION_ATTR));
+                        }
 
-                    } else if (tag == "uses-permission-sdk-23" || tag == "uses-permission-sdk-m") {
+                    } else if ((tag == "uses-permission-sdk-23" || tag == "uses-permission-sdk-m")
+                            && (wantPermissions || wantFeatures)) {
                         String8 name = AaptXml::getAttribute(tree, NAME_ATTR, &error);
                         if (error != "") {
                             fprintf(stderr, "ERROR getting 'android:name' attribute: %s\n",
@@ -1559,56 +1823,62 @@ int doDump(Bundle* bundle)
 
                         addImpliedFeaturesForPermission(targetSdk, name, &impliedFeatures, true);
 
-                        printUsesPermissionSdk23(
-                                name, AaptXml::getIntegerAttribute(tree, MAX_SDK_VERSION_ATTR));
+                        if (wantPermissions) {
+                            printUsesPermissionSdk23(out,
+                                    name, AaptXml::getIntegerAttribute(tree, MAX_SDK_VERSION_ATTR));
+                        }
 
-                    } else if (tag == "uses-package") {
+                    } else if (tag == "uses-package" && (fields & BADGING_LIBRARIES)) {
                         String8 name = AaptXml::getAttribute(tree, NAME_ATTR, &error);
                         if (name != "" && error == "") {
-                            printf("uses-package:'%s'\n",
-                                    ResTable::normalizeForOutput(name.string()).string());
+                            out->begin("uses-package", DumpWriter::STYLE_COMPACT);
+                            out->value(name);
+                            out->end();
                         } else {
                             fprintf(stderr, "ERROR getting 'android:name' attribute: %s\n",
                                     error.string());
                                 goto bail;
                         }
-                    } else if (tag == "original-package") {
+                    } else if (tag == "original-package" && (fields & BADGING_OTHER)) {
                         String8 name = AaptXml::getAttribute(tree, NAME_ATTR, &error);
                         if (name != "" && error == "") {
-                            printf("original-package:'%s'\n",
-                                    ResTable::normalizeForOutput(name.string()).string());
+                            out->begin("original-package", DumpWriter::STYLE_COMPACT);
+                            out->value(name);
+                            out->end();
                         } else {
                             fprintf(stderr, "ERROR getting 'android:name' attribute: %s\n",
                                     error.string());
                                 goto bail;
                         }
-                    } else if (tag == "supports-gl-texture") {
+                    } else if (tag == "supports-gl-texture" && wantFeatures) {
                         String8 name = AaptXml::getAttribute(tree, NAME_ATTR, &error);
                         if (name != "" && error == "") {
-                            printf("supports-gl-texture:'%s'\n",
-                                    ResTable::normalizeForOutput(name.string()).string());
+                            out->begin("supports-gl-texture", DumpWriter::STYLE_COMPACT);
+                            out->value(name);
+                            out->end();
                         } else {
                             fprintf(stderr, "ERROR getting 'android:name' attribute: %s\n",
                                     error.string());
                                 goto bail;
                         }
-                    } else if (tag == "compatible-screens") {
-                        printCompatibleScreens(tree, &error);
+                    } else if (tag == "compatible-screens" && wantScreens) {
+                        printCompatibleScreens(out, tree, &error);
                         if (error != "") {
                             fprintf(stderr, "ERROR getting compatible screens: %s\n",
                                     error.string());
                             goto bail;
                         }
                         depth--;
-                    } else if (tag == "package-verifier") {
+                    } else if (tag == "package-verifier" && (fields & BADGING_OTHER)) {
                         String8 name = AaptXml::getAttribute(tree, NAME_ATTR, &error);
                         if (name != "" && error == "") {
                             String8 publicKey = AaptXml::getAttribute(tree, PUBLIC_KEY_ATTR,
                                                                       &error);
                             if (publicKey != "" && error == "") {
-                                printf("package-verifier: name='%s' publicKey='%s'\n",
-                                        ResTable::normalizeForOutput(name.string()).string(),
-                                        ResTable::normalizeForOutput(publicKey.string()).string());
+                                out->begin("package-verifier", DumpWriter::STYLE_SPACED);
+                                out->attr("name", name);
+                                out->attr("publicKey", publicKey);
+                                out->end();
                             }
                         }
                     }
@@ -1638,32 +1908,37 @@ int doDump(Bundle* bundle)
                                 goto bail;
                             }
 
-                            activityLabel = AaptXml::getResolvedAttribute(res, tree, LABEL_ATTR,
-                                    &error);
-                            if (error != "") {
-                                fprintf(stderr, "ERROR getting 'android:label' attribute: %s\n",
-                                        error.string());
-                                goto bail;
-                            }
+                            if (wantComponents) {
+                                activityLabel = AaptXml::getResolvedAttribute(res, tree,
+                                        LABEL_ATTR, &error);
+                                if (error != "") {
+                                    fprintf(stderr, "ERROR getting 'android:label' attribute: %s\n",
+                                            error.string());
+                                    goto bail;
+                                }
 
-                            activityIcon = AaptXml::getResolvedAttribute(res, tree, ICON_ATTR,
-                                    &error);
-                            if (error != "") {
-                                fprintf(stderr, "ERROR getting 'android:icon' attribute: %s\n",
-                                        error.string());
-                                goto bail;
-                            }
+                                activityIcon = AaptXml::getResolvedAttribute(res, tree,
+                                        ICON_ATTR, &error);
+                                if (error != "") {
+                                    fprintf(stderr, "ERROR getting 'android:icon' attribute: %s\n",
+                                            error.string());
+                                    goto bail;
+                                }
 
-                            activityBanner = AaptXml::getResolvedAttribute(res, tree, BANNER_ATTR,
-                                    &error);
-                            if (error != "") {
-                                fprintf(stderr, "ERROR getting 'android:banner' attribute: %s\n",
-                                        error.string());
-                                goto bail;
+                                activityBanner = AaptXml::getResolvedAttribute(res, tree,
+                                        BANNER_ATTR, &error);
+                                if (error != "") {
+                                    fprintf(stderr,
+                                            "ERROR getting 'android:banner' attribute: %s\n",
+                                            error.string());
+                                    goto bail;
+                                }
                             }
 
-                            int32_t orien = AaptXml::getResolvedIntegerAttribute(res, tree,
-                                    SCREEN_ORIENTATION_ATTR, &error);
+                            int32_t orien = wantFeatures
+                                    ? AaptXml::getResolvedIntegerAttribute(res, tree,
+                                            SCREEN_ORIENTATION_ATTR, &error)
+                                    : -1;
                             if (error == "") {
                                 if (orien == 0 || orien == 6 || orien == 8) {
                                     // Requests landscape, sensorLandscape, or reverseLandscape.
@@ -1681,7 +1956,7 @@ int doDump(Bundle* bundle)
                                             false);
                                 }
                             }
-                        } else if (tag == "uses-library") {
+                        } else if (tag == "uses-library" && (fields & BADGING_LIBRARIES)) {
                             String8 libraryName = AaptXml::getAttribute(tree, NAME_ATTR, &error);
                             if (error != "") {
                                 fprintf(stderr,
@@ -1691,10 +1966,11 @@ int doDump(Bundle* bundle)
                             }
                             int req = AaptXml::getIntegerAttribute(tree,
                                     REQUIRED_ATTR, 1);
-                            printf("uses-library%s:'%s'\n",
-                                    req ? "" : "-not-required", ResTable::normalizeForOutput(
-                                            libraryName.string()).string());
-                        } else if (tag == "receiver") {
+                            out->begin("uses-library", DumpWriter::STYLE_COMPACT);
+                            out->qualifier("required", req != 0);
+                            out->value(libraryName);
+                            out->end();
+                        } else if (tag == "receiver" && wantComponents) {
                             withinReceiver = true;
                             receiverName = AaptXml::getAttribute(tree, NAME_ATTR, &error);
 
@@ -1717,7 +1993,7 @@ int doDump(Bundle* bundle)
                                         " receiver '%s': %s\n",
                                         receiverName.string(), error.string());
                             }
-                        } else if (tag == "service") {
+                        } else if (tag == "service" && wantComponents) {
                             withinService = true;
                             serviceName = AaptXml::getAttribute(tree, NAME_ATTR, &error);
 
@@ -1751,7 +2027,7 @@ int doDump(Bundle* bundle)
                                 fprintf(stderr, "ERROR getting 'android:permission' attribute for "
                                         "service '%s': %s\n", serviceName.string(), error.string());
                             }
-                        } else if (tag == "provider") {
+                        } else if (tag == "provider" && wantComponents) {
                             withinProvider = true;
 
                             bool exported = AaptXml::getResolvedIntegerAttribute(res, tree,
@@ -1783,7 +2059,8 @@ int doDump(Bundle* bundle)
                             hasRequiredSafAttributes |= exported && grantUriPermissions &&
                                 permission == "android.permission.MANAGE_DOCUMENTS";
 
-                        } else if (bundle->getIncludeMetaData() && tag == "meta-data") {
+                        } else if (bundle->getIncludeMetaData() && (fields & BADGING_META_DATA)
+                                && tag == "meta-data") {
                             String8 metaDataName = AaptXml::getResolvedAttribute(res, tree,
                                     NAME_ATTR, &error);
                             if (error != "") {
@@ -1791,15 +2068,15 @@ int doDump(Bundle* bundle)
                                         "meta-data:%s\n", error.string());
                                 goto bail;
                             }
-                            printf("meta-data: name='%s' ",
-                                    ResTable::normalizeForOutput(metaDataName.string()).string());
-                            printResolvedResourceAttribute(res, tree, VALUE_ATTR, String8("value"),
+                            out->begin("meta-data", DumpWriter::STYLE_SPACED);
+                            out->attr("name", metaDataName);
+                            printResolvedResourceAttribute(out, res, tree, VALUE_ATTR, "value",
                                     &error);
                             if (error != "") {
                                 // Try looking for a RESOURCE_ATTR
                                 error = "";
-                                printResolvedResourceAttribute(res, tree, RESOURCE_ATTR,
-                                        String8("resource"), &error);
+                                printResolvedResourceAttribute(out, res, tree, RESOURCE_ATTR,
+                                        "resource", &error);
                                 if (error != "") {
                                     fprintf(stderr, "ERROR getting 'android:value' or "
                                             "'android:resource' attribute for "
@@ -1807,7 +2084,7 @@ int doDump(Bundle* bundle)
                                     goto bail;
                                 }
                             }
-                            printf("\n");
+                            out->end();
                         } else if (withinSupportsInput && tag == "input-type") {
                             String8 name = AaptXml::getAttribute(tree, NAME_ATTR, &error);
                             if (name != "" && error == "") {
@@ -1850,7 +2127,7 @@ int doDump(Bundle* bundle)
                             }
                         }
                     }
-                } else if (depth == 4) {
+                } else if (depth == 4 && wantComponents) {
                     if (tag == "intent-filter") {
                         hasIntentFilter = true;
                         withinIntentFilter = true;
@@ -1991,234 +2268,264 @@ int doDump(Bundle* bundle)
                 }
             }
 
-            // Pre-1.6 implicitly granted permission compatibility logic
-            if (targetSdk < 4) {
-                if (!hasWriteExternalStoragePermission) {
-                    printUsesPermission(String8("android.permission.WRITE_EXTERNAL_STORAGE"));
-                    printUsesImpliedPermission(String8("android.permission.WRITE_EXTERNAL_STORAGE"),
-                            String8("targetSdkVersion < 4"));
-                    hasWriteExternalStoragePermission = true;
-                }
-                if (!hasReadPhoneStatePermission) {
-                    printUsesPermission(String8("android.permission.READ_PHONE_STATE"));
-                    printUsesImpliedPermission(String8("android.permission.READ_PHONE_STATE"),
-                            String8("targetSdkVersion < 4"));
+            if (wantPermissions) {
+                // Pre-1.6 implicitly granted permission compatibility logic
+                if (targetSdk < 4) {
+                    if (!hasWriteExternalStoragePermission) {
+                        printUsesPermission(out,
+                                String8("android.permission.WRITE_EXTERNAL_STORAGE"));
+                        printUsesImpliedPermission(out,
+                                String8("android.permission.WRITE_EXTERNAL_STORAGE"),
+                                String8("targetSdkVersion < 4"));
+                        hasWriteExternalStoragePermission = true;
+                    }
+                    if (!hasReadPhoneStatePermission) {
+                        printUsesPermission(out, String8("android.permission.READ_PHONE_STATE"));
+                        printUsesImpliedPermission(out,
+                                String8("android.permission.READ_PHONE_STATE"),
+                                String8("targetSdkVersion < 4"));
+                    }
                 }
-            }
-
-            // If the application has requested WRITE_EXTERNAL_STORAGE, we will
-            // force them to always take READ_EXTERNAL_STORAGE as well.  We always
-            // do this (regardless of target API version) because we can't have
-            // an app with write permission but not read permission.
-            if (!hasReadExternalStoragePermission && hasWriteExternalStoragePermission) {
-                printUsesPermission(String8("android.permission.READ_EXTERNAL_STORAGE"));
-                printUsesImpliedPermission(String8("android.permission.READ_EXTERNAL_STORAGE"),
-                        String8("requested WRITE_EXTERNAL_STORAGE"));
-            }
 
-            // Pre-JellyBean call log permission compatibility.
-            if (targetSdk < 16) {
-                if (!hasReadCallLogPermission && hasReadContactsPermission) {
-                    printUsesPermission(String8("android.permission.READ_CALL_LOG"));
-                    printUsesImpliedPermission(String8("android.permission.READ_CALL_LOG"),
-                            String8("targetSdkVersion < 16 and requested READ_CONTACTS"));
+                // If the application has requested WRITE_EXTERNAL_STORAGE, we will
+                // force them to always take READ_EXTERNAL_STORAGE as well.  We always
+                // do this (regardless of target API version) because we can't have
+                // an app with write permission but not read permission.
+                if (!hasReadExternalStoragePermission && hasWriteExternalStoragePermission) {
+                    printUsesPermission(out, String8("android.permission.READ_EXTERNAL_STORAGE"));
+                    printUsesImpliedPermission(out,
+                            String8("android.permission.READ_EXTERNAL_STORAGE"),
+                            String8("requested WRITE_EXTERNAL_STORAGE"));
                 }
-                if (!hasWriteCallLogPermission && hasWriteContactsPermission) {
-                    printUsesPermission(String8("android.permission.WRITE_CALL_LOG"));
-                    printUsesImpliedPermission(String8("android.permission.WRITE_CALL_LOG"),
-                            String8("targetSdkVersion < 16 and requested WRITE_CONTACTS"));
+
+                // Pre-JellyBean call log permission compatibility.
+                if (targetSdk < 16) {
+                    if (!hasReadCallLogPermission && hasReadContactsPermission) {
+                        printUsesPermission(out, String8("android.permission.READ_CALL_LOG"));
+                        printUsesImpliedPermission(out,
+                                String8("android.permission.READ_CALL_LOG"),
+                                String8("targetSdkVersion < 16 and requested READ_CONTACTS"));
+                    }
+                    if (!hasWriteCallLogPermission && hasWriteContactsPermission) {
+                        printUsesPermission(out, String8("android.permission.WRITE_CALL_LOG"));
+                        printUsesImpliedPermission(out,
+                                String8("android.permission.WRITE_CALL_LOG"),
+                                String8("targetSdkVersion < 16 and requested WRITE_CONTACTS"));
+                    }
                 }
             }
 
-            // If the app hasn't declared the touchscreen as a feature requirement (either
-            // directly or implied, required or not), then the faketouch feature is implied.
-            if (!hasFeature("android.hardware.touchscreen", commonFeatures, impliedFeatures)) {
-                addImpliedFeature(&impliedFeatures, "android.hardware.faketouch",
-                                  String8("default feature for all apps"), false);
-            }
+            if (wantFeatures) {
+                // If the app hasn't declared the touchscreen as a feature requirement (either
+                // directly or implied, required or not), then the faketouch feature is implied.
+                if (!hasFeature("android.hardware.touchscreen", commonFeatures, impliedFeatures)) {
+                    addImpliedFeature(&impliedFeatures, "android.hardware.faketouch",
+                                      String8("default feature for all apps"), false);
+                }
 
-            const size_t numFeatureGroups = featureGroups.size();
-            if (numFeatureGroups == 0) {
-                // If no <feature-group> tags were defined, apply auto-implied features.
-                printDefaultFeatureGroup(commonFeatures, impliedFeatures);
+                const size_t numFeatureGroups = featureGroups.size();
+                if (numFeatureGroups == 0) {
+                    // If no <feature-group> tags were defined, apply auto-implied features.
+                    printDefaultFeatureGroup(out, commonFeatures, impliedFeatures);
 
-            } else {
-                // <feature-group> tags are defined, so we ignore implied features and
-                for (size_t i = 0; i < numFeatureGroups; i++) {
-                    FeatureGroup& grp = featureGroups.editItemAt(i);
+                } else {
+                    // <feature-group> tags are defined, so we ignore implied features and
+                    for (size_t i = 0; i < numFeatureGroups; i++) {
+                        FeatureGroup& grp = featureGroups.editItemAt(i);
 
-                    if (commonFeatures.openGLESVersion > grp.openGLESVersion) {
-                        grp.openGLESVersion = commonFeatures.openGLESVersion;
-                    }
+                        if (commonFeatures.openGLESVersion > grp.openGLESVersion) {
+                            grp.openGLESVersion = commonFeatures.openGLESVersion;
+                        }
 
-                    // Merge the features defined in the top level (not inside a <feature-group>)
-                    // with this feature group.
-                    const size_t numCommonFeatures = commonFeatures.features.size();
-                    for (size_t j = 0; j < numCommonFeatures; j++) {
-                        if (grp.features.indexOfKey(commonFeatures.features.keyAt(j)) < 0) {
-                            grp.features.add(commonFeatures.features.keyAt(j),
-                                    commonFeatures.features[j]);
+                        // Merge the features defined in the top level (not inside a <feature-group>)
+                        // with this feature group.
+                        const size_t numCommonFeatures = commonFeatures.features.size();
+                        for (size_t j = 0; j < numCommonFeatures; j++) {
+                            if (grp.features.indexOfKey(commonFeatures.features.keyAt(j)) < 0) {
+                                grp.features.add(commonFeatures.features.keyAt(j),
+                                        commonFeatures.features[j]);
+                            }
                         }
-                    }
 
-                    if (!grp.features.isEmpty()) {
-                        printFeatureGroup(grp);
+                        if (!grp.features.isEmpty()) {
+                            printFeatureGroup(out, grp);
+                        }
                     }
                 }
             }
 
+            if (wantComponents) {
+                if (hasWidgetReceivers) {
+                    printComponentPresence(out, "app-widget");
+                }
+                if (hasDeviceAdminReceiver) {
+                    printComponentPresence(out, "device-admin");
+                }
+                if (hasImeService) {
+                    printComponentPresence(out, "ime");
+                }
+                if (hasWallpaperService) {
+                    printComponentPresence(out, "wallpaper");
+                }
+                if (hasAccessibilityService) {
+                    printComponentPresence(out, "accessibility");
+                }
+                if (hasPrintService) {
+                    printComponentPresence(out, "print-service");
+                }
+                if (hasPaymentService) {
+                    printComponentPresence(out, "payment");
+                }
+                if (isSearchable) {
+                    printComponentPresence(out, "search");
+                }
+                if (hasDocumentsProvider) {
+                    printComponentPresence(out, "document-provider");
+                }
+                if (hasLauncher) {
+                    printComponentPresence(out, "launcher");
+                }
+                if (hasNotificationListenerService) {
+                    printComponentPresence(out, "notification-listener");
+                }
+                if (hasDreamService) {
+                    printComponentPresence(out, "dream");
+                }
+                if (hasCameraActivity) {
+                    printComponentPresence(out, "camera");
+                }
+                if (hasCameraSecureActivity) {
+                    printComponentPresence(out, "camera-secure");
+                }
 
-            if (hasWidgetReceivers) {
-                printComponentPresence("app-widget");
-            }
-            if (hasDeviceAdminReceiver) {
-                printComponentPresence("device-admin");
-            }
-            if (hasImeService) {
-                printComponentPresence("ime");
-            }
-            if (hasWallpaperService) {
-                printComponentPresence("wallpaper");
-            }
-            if (hasAccessibilityService) {
-                printComponentPresence("accessibility");
-            }
-            if (hasPrintService) {
-                printComponentPresence("print-service");
-            }
-            if (hasPaymentService) {
-                printComponentPresence("payment");
-            }
-            if (isSearchable) {
-                printComponentPresence("search");
-            }
-            if (hasDocumentsProvider) {
-                printComponentPresence("document-provider");
-            }
-            if (hasLauncher) {
-                printComponentPresence("launcher");
-            }
-            if (hasNotificationListenerService) {
-                printComponentPresence("notification-listener");
-            }
-            if (hasDreamService) {
-                printComponentPresence("dream");
-            }
-            if (hasCameraActivity) {
-                printComponentPresence("camera");
-            }
-            if (hasCameraSecureActivity) {
-                printComponentPresence("camera-secure");
-            }
-
-            if (hasMainActivity) {
-                printf("main\n");
-            }
-            if (hasOtherActivities) {
-                printf("other-activities\n");
-            }
-             if (hasOtherReceivers) {
-                printf("other-receivers\n");
-            }
-            if (hasOtherServices) {
-                printf("other-services\n");
+                if (hasMainActivity) {
+                    out->begin("main", DumpWriter::STYLE_FLAG);
+                    out->end();
+                }
+                if (hasOtherActivities) {
+                    out->begin("other-activities", DumpWriter::STYLE_FLAG);
+                    out->end();
+                }
+                 if (hasOtherReceivers) {
+                    out->begin("other-receivers", DumpWriter::STYLE_FLAG);
+                    out->end();
+                }
+                if (hasOtherServices) {
+                    out->begin("other-services", DumpWriter::STYLE_FLAG);
+                    out->end();
+                }
             }
 
-            // For modern apps, if screen size buckets haven't been specified
-            // but the new width ranges have, then infer the buckets from them.
-            if (smallScreen > 0 && normalScreen > 0 && largeScreen > 0 && xlargeScreen > 0
-                    && requiresSmallestWidthDp > 0) {
-                int compatWidth = compatibleWidthLimitDp;
-                if (compatWidth <= 0) {
-                    compatWidth = requiresSmallestWidthDp;
+            if (wantScreens) {
+                // For modern apps, if screen size buckets haven't been specified
+                // but the new width ranges have, then infer the buckets from them.
+                if (smallScreen > 0 && normalScreen > 0 && largeScreen > 0 && xlargeScreen > 0
+                        && requiresSmallestWidthDp > 0) {
+                    int compatWidth = compatibleWidthLimitDp;
+                    if (compatWidth <= 0) {
+                        compatWidth = requiresSmallestWidthDp;
+                    }
+                    if (requiresSmallestWidthDp <= 240 && compatWidth >= 240) {
+                        smallScreen = -1;
+                    } else {
+                        smallScreen = 0;
+                    }
+                    if (requiresSmallestWidthDp <= 320 && compatWidth >= 320) {
+                        normalScreen = -1;
+                    } else {
+                        normalScreen = 0;
+                    }
+                    if (requiresSmallestWidthDp <= 480 && compatWidth >= 480) {
+                        largeScreen = -1;
+                    } else {
+                        largeScreen = 0;
+                    }
+                    if (requiresSmallestWidthDp <= 720 && compatWidth >= 720) {
+                        xlargeScreen = -1;
+                    } else {
+                        xlargeScreen = 0;
+                    }
                 }
-                if (requiresSmallestWidthDp <= 240 && compatWidth >= 240) {
-                    smallScreen = -1;
-                } else {
-                    smallScreen = 0;
+
+                // Determine default values for any unspecified screen sizes,
+                // based on the target SDK of the package.  As of 4 (donut)
+                // the screen size support was introduced, so all default to
+                // enabled.
+                if (smallScreen > 0) {
+                    smallScreen = targetSdk >= 4 ? -1 : 0;
                 }
-                if (requiresSmallestWidthDp <= 320 && compatWidth >= 320) {
+                if (normalScreen > 0) {
                     normalScreen = -1;
-                } else {
-                    normalScreen = 0;
                 }
-                if (requiresSmallestWidthDp <= 480 && compatWidth >= 480) {
-                    largeScreen = -1;
-                } else {
-                    largeScreen = 0;
+                if (largeScreen > 0) {
+                    largeScreen = targetSdk >= 4 ? -1 : 0;
                 }
-                if (requiresSmallestWidthDp <= 720 && compatWidth >= 720) {
-                    xlargeScreen = -1;
-                } else {
-                    xlargeScreen = 0;
+                if (xlargeScreen > 0) {
+                    // Introduced in Gingerbread.
+                    xlargeScreen = targetSdk >= 9 ? -1 : 0;
+                }
+                if (anyDensity > 0) {
+                    anyDensity = (targetSdk >= 4 || requiresSmallestWidthDp > 0
+                            || compatibleWidthLimitDp > 0) ? -1 : 0;
+                }
+                out->begin("supports-screens", DumpWriter::STYLE_SPACED);
+                if (smallScreen != 0) {
+                    out->value(String8("small"), false);
+                }
+                if (normalScreen != 0) {
+                    out->value(String8("normal"), false);
+                }
+                if (largeScreen != 0) {
+                    out->value(String8("large"), false);
+                }
+                if (xlargeScreen != 0) {
+                    out->value(String8("xlarge"), false);
+                }
+                out->end();
+                out->begin("supports-any-density", DumpWriter::STYLE_SPACED);
+                out->value(String8(anyDensity ? "true" : "false"), false);
+                out->end();
+                if (requiresSmallestWidthDp > 0) {
+                    out->begin("requires-smallest-width", DumpWriter::STYLE_COMPACT);
+                    out->value(requiresSmallestWidthDp);
+                    out->end();
+                }
+                if (compatibleWidthLimitDp > 0) {
+                    out->begin("compatible-width-limit", DumpWriter::STYLE_COMPACT);
+                    out->value(compatibleWidthLimitDp);
+                    out->end();
+                }
+                if (largestWidthLimitDp > 0) {
+                    out->begin("largest-width-limit", DumpWriter::STYLE_COMPACT);
+                    out->value(largestWidthLimitDp);
+                    out->end();
                 }
             }
 
-            // Determine default values for any unspecified screen sizes,
-            // based on the target SDK of the package.  As of 4 (donut)
-            // the screen size support was introduced, so all default to
-            // enabled.
-            if (smallScreen > 0) {
-                smallScreen = targetSdk >= 4 ? -1 : 0;
-            }
-            if (normalScreen > 0) {
-                normalScreen = -1;
-            }
-            if (largeScreen > 0) {
-                largeScreen = targetSdk >= 4 ? -1 : 0;
-            }
-            if (xlargeScreen > 0) {
-                // Introduced in Gingerbread.
-                xlargeScreen = targetSdk >= 9 ? -1 : 0;
-            }
-            if (anyDensity > 0) {
-                anyDensity = (targetSdk >= 4 || requiresSmallestWidthDp > 0
-                        || compatibleWidthLimitDp > 0) ? -1 : 0;
-            }
-            printf("supports-screens:");
-            if (smallScreen != 0) {
-                printf(" 'small'");
-            }
-            if (normalScreen != 0) {
-                printf(" 'normal'");
-            }
-            if (largeScreen != 0) {
-                printf(" 'large'");
-            }
-            if (xlargeScreen != 0) {
-                printf(" 'xlarge'");
-            }
-            printf("\n");
-            printf("supports-any-density: '%s'\n", anyDensity ? "true" : "false");
-            if (requiresSmallestWidthDp > 0) {
-                printf("requires-smallest-width:'%d'\n", requiresSmallestWidthDp);
-            }
-            if (compatibleWidthLimitDp > 0) {
-                printf("compatible-width-limit:'%d'\n", compatibleWidthLimitDp);
-            }
-            if (largestWidthLimitDp > 0) {
-                printf("largest-width-limit:'%d'\n", largestWidthLimitDp);
-            }
-
-            printf("locales:");
-            const size_t NL = locales.size();
-            for (size_t i=0; i<NL; i++) {
-                const char* localeStr =  locales[i].string();
-                if (localeStr == NULL || strlen(localeStr) == 0) {
-                    localeStr = "--_--";
+            if (fields & BADGING_LOCALES) {
+                out->begin("locales", DumpWriter::STYLE_SPACED);
+                const size_t NL = locales.size();
+                for (size_t i=0; i<NL; i++) {
+                    const char* localeStr =  locales[i].string();
+                    if (localeStr == NULL || strlen(localeStr) == 0) {
+                        localeStr = "--_--";
+                    }
+                    out->value(String8(localeStr), false);
                 }
-                printf(" '%s'", localeStr);
+                out->end();
             }
-            printf("\n");
 
-            printf("densities:");
-            const size_t ND = densities.size();
-            for (size_t i=0; i<ND; i++) {
-                printf(" '%d'", densities[i]);
+            if (fields & BADGING_DENSITIES) {
+                out->begin("densities", DumpWriter::STYLE_SPACED);
+                const size_t ND = densities.size();
+                for (size_t i=0; i<ND; i++) {
+                    out->value(densities[i]);
+                }
+                out->end();
             }
-            printf("\n");
 
-            AssetDir* dir = assets.openNonAssetDir(assetsCookie, "lib");
+            AssetDir* dir = (fields & BADGING_NATIVE_CODE)
+                    ? assets.openNonAssetDir(assetsCookie, "lib") : NULL;
             if (dir != NULL) {
                 if (dir->getFileCount() > 0) {
                     SortedVector<String8> architectures;
@@ -2252,7 +2559,9 @@ int doDump(Bundle* bundle)
                         }
 
                         if (index >= 0) {
-                            printf("native-code: '%s'\n", architectures[index].string());
+                            out->begin("native-code", DumpWriter::STYLE_SPACED);
+                            out->value(architectures[index], false);
+                            out->end();
                             architectures.removeAt(index);
                             outputAltNativeCode = true;
                         }
@@ -2260,14 +2569,12 @@ int doDump(Bundle* bundle)
 
                     const size_t archCount = architectures.size();
                     if (archCount > 0) {
-                        if (outputAltNativeCode) {
-                            printf("alt-");
-                        }
-                        printf("native-code:");
+                        out->begin(outputAltNativeCode ? "alt-native-code" : "native-code",
+                                DumpWriter::STYLE_SPACED);
                         for (size_t i = 0; i < archCount; i++) {
-                            printf(" '%s'", architectures[i].string());
+                            out->value(architectures[i], false);
                         }
-                        printf("\n");
+                        out->end();
                     }
                 }
                 delete dir;
@@ -2293,9 +2600,107 @@ bail:
     if (asset) {
         delete asset;
     }
+    if (out->flush() != NO_ERROR && result == NO_ERROR) {
+        fprintf(stderr, "ERROR: failed writing dump output\n");
+        result = UNKNOWN_ERROR;
+    }
+    delete out;
     return (result != NO_ERROR);
 }
 
+/*
+ * Run "dump badging" through the result cache.  On a hit, the output of an
+ * earlier run is printed without opening the APK.  On a miss, the dump
+ * runs with stdout going to a temporary file so that what it prints can
+ * be both shown and kept.  Only successful runs are kept.
+ */
+static int dumpBadgingCached(Bundle* bundle)
+{
+    const char* filename = bundle->getFileSpecEntry(1);
+    const String8 cachePath = ResultCache::getDefaultPath();
+    if (cachePath.isEmpty()) {
+        return dumpArchive(bundle);
+    }
+
+    ResultCache cache;
+    ResultCache::ApkIdentity identity;
+    if (cache.open(cachePath, bundle->getRebuildResultCache()) != NO_ERROR
+            || ResultCache::getIdentity(filename, &identity) != NO_ERROR) {
+        return dumpArchive(bundle);
+    }
+
+    // The same APK dumps differently with different options.
+    String8 kind("dump badging");
+    if (bundle->getIncludeMetaData()) {
+        kind.append(" --include-meta-data");
+    }
+    if (bundle->getBadgingFields() != BADGING_ALL) {
+        kind.appendFormat(" --fields=%#x", bundle->getBadgingFields());
+    }
+    if (bundle->getDumpFormat() != kDumpFormatText) {
+        kind.appendFormat(" --format=%d", bundle->getDumpFormat());
+    }
+    String8 output;
+    if (cache.find(identity, kind.string(), &output)) {
+        fwrite(output.string(), 1, output.length(), stdout);
+        return 0;
+    }
+
+    FILE* tmp = tmpfile();
+    if (tmp == NULL) {
+        return dumpArchive(bundle);
+    }
+    fflush(stdout);
+    int savedStdout = dup(fileno(stdout));
+    if (savedStdout < 0 || dup2(fileno(tmp), fileno(stdout)) < 0) {
+        if (savedStdout >= 0) {
+            close(savedStdout);
+        }
+        fclose(tmp);
+        return dumpArchive(bundle);
+    }
+
+    int result = dumpArchive(bundle);
+
+    fflush(stdout);
+    dup2(savedStdout, fileno(stdout));
+    close(savedStdout);
+
+    long len = ftell(tmp);
+    bool captured = len >= 0 && fseek(tmp, 0, SEEK_SET) == 0;
+    if (captured) {
+        char* buf = output.lockBuffer(len);
+        captured = buf != NULL && fread(buf, 1, len, tmp) == (size_t) len;
+        output.unlockBuffer(captured ? len : 0);
+    }
+    fclose(tmp);
+
+    fwrite(output.string(), 1, output.length(), stdout);
+    if (result == 0 && captured) {
+        cache.put(identity, kind.string(), output);
+        cache.flush();
+    }
+    return result;
+}
+
+/*
+ * Handle the "dump" command, to extract select data from an archive.
+ */
+int doDump(Bundle* bundle)
+{
+    int result;
+    if (bundle->getUseResultCache() && bundle->getFileSpecCount() >= 2
+            && strcmp("badging", bundle->getFileSpecEntry(0)) == 0) {
+        result = dumpBadgingCached(bundle);
+    } else {
+        result = dumpArchive(bundle);
+    }
+    if (bundle->getVerbose()) {
+        reportPeakMemory();
+    }
+    return result;
+}
+
 
 /*
  * Handle the "add" command, which wants to add files to a new or
@@ -2329,6 +2734,7 @@ int doAdd(Bundle* bundle)
         fprintf(stderr, "ERROR: failed opening/creating '%s' as Zip file\n", zipFileName);
         goto bail;
     }
+    zip->setCompressionLevel(bundle->getCompressionLevel());
 
     for (int i = 1; i < bundle->getFileSpecCount(); i++) {
         const char* fileName = bundle->getFileSpecEntry(i);
@@ -2503,6 +2909,8 @@ int doPackage(Bundle* bundle)
         bundle->setPseudolocalize(bundle->getPseudolocalize() | PSEUDO_BIDI);
     }
 
+    ResourceIdCache::setMaxEntries(bundle->getResourceIdCacheSize());
+
     N = bundle->getFileSpecCount();
     if (N < 1 && bundle->getResourceSourceDirs().size() == 0 && bundle->getJarFiles().size() == 0
             && bundle->getAndroidManifestFile() == NULL && bundle->getAssetSourceDirs().size() == 0) {
@@ -2710,6 +3118,9 @@ bail:
     if (SourcePos::hasErrors()) {
         SourcePos::printErrors(stderr);
     }
+    if (bundle->getVerbose()) {
+        ResourceIdCache::dump();
+    }
     return retVal;
 }
 
@@ -2756,11 +3167,67 @@ int doSingleCrunch(Bundle* bundle)
     return NO_ERROR;
 }
 
+/*
+ * Run a full "package" or "dump" command line inside the daemon.  The
+ * request is a line holding the argument count followed by one line per
+ * argument (so empty arguments, e.g. for -0, survive).  The command name
+ * itself is implied by the request and is not repeated.
+ */
+static int runDaemonCommandLine(const char* command) {
+    std::string countLine;
+    if (!std::getline(std::cin, countLine)) {
+        return -1;
+    }
+    const int count = atoi(countLine.c_str());
+    if (count < 0) {
+        return -1;
+    }
+
+    std::vector<std::string> args;
+    args.push_back("aapt");
+    args.push_back(command);
+    for (int i = 0; i < count; i++) {
+        std::string arg;
+        if (!std::getline(std::cin, arg)) {
+            return -1;
+        }
+        args.push_back(arg);
+    }
+
+    // Bundle keeps pointers into argv, so "args" must outlive the command.
+    std::vector<char*> argv;
+    for (size_t i = 0; i < args.size(); i++) {
+        argv.push_back(const_cast<char*>(args[i].c_str()));
+    }
+    argv.push_back(NULL);
+
+    int result = runCommandLine(static_cast<int>(args.size()), &argv[0]);
+
+    // Errors and cached resource IDs belong to this request only; the
+    // included resource tables are what we want to keep around.
+    SourcePos::clearErrors();
+    ResourceIdCache::clear();
+    return result;
+}
+
+/*
+ * Daemon protocol, one command per line on stdin:
+ *   s      single crunch, followed by the input and output file lines
+ *   p      package, followed by a counted argument list
+ *   d      dump, followed by a counted argument list
+ *   quit   leave daemon mode
+ * Every request is answered with "Done", preceded by "Error" on failure.
+ */
 int runInDaemonMode(Bundle* bundle) {
+    // Keep the -I resource tables loaded from one package request to the next.
+    AaptAssets::setRetainIncludedResources(true);
+
+    int result = -1;
     std::cout << "Ready" << std::endl;
     for (std::string cmd; std::getline(std::cin, cmd);) {
         if (cmd == "quit") {
-            return NO_ERROR;
+            result = NO_ERROR;
+            break;
         } else if (cmd == "s") {
             // Two argument crunch
             std::string inputFile, outputFile;
@@ -2773,13 +3240,23 @@ int runInDaemonMode(Bundle* bundle) {
                 std::cout << "Error" << std::endl;
             }
             std::cout << "Done" << std::endl;
+        } else if (cmd == "p" || cmd == "d") {
+            int err = runDaemonCommandLine(cmd == "p" ? "package" : "dump");
+            // The command itself writes through stdio.
+            fflush(stdout);
+            if (err != NO_ERROR) {
+                std::cout << "Error" << std::endl;
+            }
+            std::cout << "Done" << std::endl;
         } else {
             // in case of invalid command, just bail out.
             std::cerr << "Unknown command" << std::endl;
-            return -1;
+            break;
         }
     }
-    return -1;
+
+    AaptAssets::setRetainIncludedResources(false);
+    return result;
 }
 
 char CONSOLE_DATA[2925] = {
@@ -13,11 +13,73 @@
 #include "FileFinder.h"
 #include "CacheUpdater.h"
 #include "CrunchCache.h"
+#include "WorkStealingPool.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
 
 using namespace android;
 
+// The manifest lives in the cache directory.  It is a header line, then
+// one line per source file: content hash, options hash, size, mtime and
+// the path relative to the source directory.
+static const char* kManifestName = ".crunch-manifest";
+static const char* kManifestHeader = "aapt-crunch-manifest 1\n";
+
+// Source files are handed to the threads this many at a time.
+static const size_t kBatchSize = 8;
+
+// 64-bit FNV-1a
+static const uint64_t kHashSeed = 14695981039346656037ull;
+
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ p[i]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/*
+ * Checks, and if need be crunches, a range of the source files.  Each
+ * item is only touched by the unit that owns it.
+ */
+class CrunchCache::CrunchUnit : public WorkQueue::WorkUnit {
+public:
+    CrunchUnit(const CrunchCache* cache, CacheUpdater* cu, CrunchItem* items,
+            size_t start, size_t end, uint64_t optionsHash, bool forceOverwrite) :
+            mCache(cache), mUpdater(cu), mItems(items), mStart(start), mEnd(end),
+            mOptionsHash(optionsHash), mForceOverwrite(forceOverwrite) {
+    }
+
+    virtual bool run() {
+        for (size_t i = mStart; i < mEnd; i++) {
+            CrunchItem& item = mItems[i];
+            // Always check, so that the manifest entry is filled in.
+            if (mCache->needsUpdating(&item, mOptionsHash) || mForceOverwrite) {
+                mUpdater->processImage(mCache->mSourcePath.appendPathCopy(item.relativePath),
+                                       mCache->mDestPath.appendPathCopy(item.relativePath));
+                item.updated = true;
+            }
+        }
+        return true;
+    }
+
+private:
+    const CrunchCache* const mCache;
+    CacheUpdater* const mUpdater;
+    CrunchItem* const mItems;
+    const size_t mStart;
+    const size_t mEnd;
+    const uint64_t mOptionsHash;
+    const bool mForceOverwrite;
+};
+
 CrunchCache::CrunchCache(String8 sourcePath, String8 destPath, FileFinder* ff)
-    : mSourcePath(sourcePath), mDestPath(destPath), mSourceFiles(0), mDestFiles(0), mFileFinder(ff)
+    : mSourcePath(sourcePath), mDestPath(destPath), mSourceFiles(0), mDestFiles(0),
+      mJobs(1), mFileFinder(ff)
 {
     // We initialize the default value to return to 0 so if a file doesn't exist
     // then all files are automatically "newer" than it.
@@ -31,46 +93,87 @@ CrunchCache::CrunchCache(String8 sourcePath, String8 destPath, FileFinder* ff)
 
 size_t CrunchCache::crunch(CacheUpdater* cu, bool forceOverwrite)
 {
-    size_t numFilesUpdated = 0;
+    readManifest();
+    const uint64_t optionsHash = hashBytes(kHashSeed, mOptions.string(), mOptions.length());
+
+    // Line each source file up with its cached copy and its manifest
+    // entry.  All three lists are sorted, so each is a lookup; the cached
+    // copies that no source file claims are left over afterwards.
+    const size_t N = mSourceFiles.size();
+    Vector<CrunchItem> items;
+    items.insertAt(CrunchItem(), 0, N);
+    Vector<bool> destWanted;
+    destWanted.insertAt(false, 0, mDestFiles.size());
+    for (size_t i = 0; i < N; i++) {
+        CrunchItem& item = items.editItemAt(i);
 
-    // Iterate through the source files and compare to cache.
-    // After processing a file, remove it from the source files and
-    // from the dest files.
-    // We're done when we're out of files in source.
-    String8 relativePath;
-    while (mSourceFiles.size() > 0) {
         // Get the full path to the source file, then convert to a c-string
         // and offset our beginning pointer to the length of the sourcePath
         // This efficiently strips the source directory prefix from our path.
         // Also, String8 doesn't have a substring method so this is what we've
         // got to work with.
-        const char* rPathPtr = mSourceFiles.keyAt(0).string()+mSourcePath.length();
+        const char* rPathPtr = mSourceFiles.keyAt(i).string()+mSourcePath.length();
         // Strip leading slash if present
-        int offset = 0;
         if (rPathPtr[0] == OS_PATH_SEPARATOR)
-            offset = 1;
-        relativePath = String8(rPathPtr + offset);
+            rPathPtr++;
+        item.relativePath = String8(rPathPtr);
+        item.sourceTime = mSourceFiles.valueAt(i);
+
+        ssize_t destIndex = mDestFiles.indexOfKey(mDestPath.appendPathCopy(item.relativePath));
+        if (destIndex >= 0) {
+            item.destTime = mDestFiles.valueAt(destIndex);
+            destWanted.editItemAt(destIndex) = true;
+        }
+
+        ssize_t entryIndex = mManifest.indexOfKey(item.relativePath);
+        if (entryIndex >= 0) {
+            item.hasEntry = true;
+            item.entry = mManifest.valueAt(entryIndex);
+        }
+    }
 
-        if (forceOverwrite || needsUpdating(relativePath)) {
-            cu->processImage(mSourcePath.appendPathCopy(relativePath),
-                             mDestPath.appendPathCopy(relativePath));
+    CrunchItem* const array = items.editArray();
+    if (mJobs == 1 || N <= kBatchSize) {
+        CrunchUnit(this, cu, array, 0, N, optionsHash, forceOverwrite).run();
+    } else {
+        WorkStealingPool wq(mJobs);
+        for (size_t start = 0; start < N; start += kBatchSize) {
+            const size_t end = start + kBatchSize < N ? start + kBatchSize : N;
+            CrunchUnit* w = new CrunchUnit(this, cu, array, start, end,
+                                           optionsHash, forceOverwrite);
+            if (wq.schedule(w) != OK) {
+                w->run();
+                delete w;
+            }
+        }
+        wq.finish();
+    }
+
+    // Remember what every source file looks like now.  Items are in
+    // order, so each entry goes on the end.
+    size_t numFilesUpdated = 0;
+    mManifest.clear();
+    mManifest.setCapacity(N);
+    for (size_t i = 0; i < N; i++) {
+        const CrunchItem& item = items[i];
+        if (item.updated) {
             numFilesUpdated++;
-            // crunchFile(relativePath);
         }
-        // Delete this file from the source files and (if it exists) from the
-        // dest files.
-        mSourceFiles.removeItemsAt(0);
-        mDestFiles.removeItem(mDestPath.appendPathCopy(relativePath));
+        if (item.hasEntry) {
+            mManifest.add(item.relativePath, item.entry);
+        }
     }
 
-    // Iterate through what's left of destFiles and delete leftovers
-    while (mDestFiles.size() > 0) {
-        cu->deleteFile(mDestFiles.keyAt(0));
-        mDestFiles.removeItemsAt(0);
+    // Delete the cached files that no longer have a source
+    for (size_t i = 0; i < mDestFiles.size(); i++) {
+        if (!destWanted[i]) {
+            cu->deleteFile(mDestFiles.keyAt(i));
+        }
     }
 
+    writeManifest();
+
     // Update our knowledge of the files cache
-    // both source and dest should be empty by now.
     loadFiles();
 
     return numFilesUpdated;
@@ -94,12 +197,106 @@ void CrunchCache::loadFiles()
     delete dw;
 }
 
-bool CrunchCache::needsUpdating(String8 relativePath) const
+void CrunchCache::readManifest()
 {
-    // Retrieve modification dates for this file entry under the source and
-    // cache directory trees. The vectors will return a modification date of 0
-    // if the file doesn't exist.
-    time_t sourceDate = mSourceFiles.valueFor(mSourcePath.appendPathCopy(relativePath));
-    time_t destDate = mDestFiles.valueFor(mDestPath.appendPathCopy(relativePath));
-    return sourceDate > destDate;
+    mManifest.clear();
+
+    FILE* fp = fopen(mDestPath.appendPathCopy(kManifestName).string(), "r");
+    if (fp == NULL) {
+        return;
+    }
+
+    char line[4096];
+    if (fgets(line, sizeof(line), fp) != NULL && strcmp(line, kManifestHeader) == 0) {
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            size_t len = strlen(line);
+            if (len == 0 || line[len-1] != '\n') {
+                break;      // truncated, or a path longer than we allow
+            }
+            line[len-1] = '\0';
+
+            ManifestEntry entry;
+            int pathStart = -1;
+            if (sscanf(line, "%" SCNx64 " %" SCNx64 " %" SCNd64 " %" SCNd64 " %n",
+                       &entry.contentHash, &entry.optionsHash, &entry.size, &entry.mtime,
+                       &pathStart) < 4 || pathStart < 0) {
+                break;
+            }
+            mManifest.add(String8(line + pathStart), entry);
+        }
+    }
+    fclose(fp);
+}
+
+void CrunchCache::writeManifest() const
+{
+    // Write a new copy and move it over the old, so that an interrupted
+    // build never leaves half a manifest behind.
+    const String8 path(mDestPath.appendPathCopy(kManifestName));
+    String8 tmpPath(path);
+    tmpPath.append(".tmp");
+
+    FILE* fp = fopen(tmpPath.string(), "w");
+    if (fp == NULL) {
+        // The cache directory isn't there when there is nothing to cache.
+        return;
+    }
+
+    fputs(kManifestHeader, fp);
+    for (size_t i = 0; i < mManifest.size(); i++) {
+        const ManifestEntry& entry = mManifest.valueAt(i);
+        fprintf(fp, "%016" PRIx64 " %016" PRIx64 " %" PRId64 " %" PRId64 " %s\n",
+                entry.contentHash, entry.optionsHash, entry.size, entry.mtime,
+                mManifest.keyAt(i).string());
+    }
+
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "ERROR WRITING %s\n", tmpPath.string());
+        remove(tmpPath.string());
+        return;
+    }
+    if (rename(tmpPath.string(), path.string()) != 0) {
+        // Windows won't rename over an existing file.
+        remove(path.string());
+        if (rename(tmpPath.string(), path.string()) != 0) {
+            fprintf(stderr, "ERROR WRITING %s\n", path.string());
+            remove(tmpPath.string());
+        }
+    }
+}
+
+bool CrunchCache::needsUpdating(CrunchItem* item, uint64_t optionsHash) const
+{
+    const String8 sourcePath(mSourcePath.appendPathCopy(item->relativePath));
+    const bool hadEntry = item->hasEntry;
+    const ManifestEntry old = item->entry;
+
+    // Everything about the source file comes through the FileFinder.
+    ManifestEntry current;
+    current.optionsHash = optionsHash;
+    current.mtime = item->sourceTime;
+    if (!mFileFinder->getFileSize(sourcePath, &current.size)) {
+        current.size = -1;
+    }
+
+    if (hadEntry && current.size >= 0 && current.size == old.size
+            && current.mtime == old.mtime) {
+        // Untouched since we last hashed it.
+        current.contentHash = old.contentHash;
+        item->hasEntry = true;
+    } else {
+        item->hasEntry = mFileFinder->hashFile(sourcePath, &current.contentHash);
+    }
+    item->entry = current;
+
+    // The modification dates come from the file finder; a cached file
+    // that doesn't exist has a date of 0.
+    if (item->destTime == 0 || !item->hasEntry) {
+        return true;
+    }
+    if (hadEntry) {
+        return old.optionsHash != optionsHash || old.contentHash != current.contentHash;
+    }
+    // A cache from before the manifest: all we can go on is the dates.
+    return item->sourceTime > item->destTime;
 }
@@ -11,6 +11,7 @@
 
 #include <utils/KeyedVector.h>
 #include <utils/String8.h>
+#include <stdint.h>
 #include "FileFinder.h"
 #include "CacheUpdater.h"
 
@@ -21,6 +22,11 @@ using namespace android;
  *  them in a mirror-cache. It's capable of doing incremental updates to its
  *  cache.
  *
+ *  A manifest in the cache directory records the content hash of each
+ *  source file and the crunch options it was processed with, so a file is
+ *  only re-crunched when what it holds or how it is crunched changes, not
+ *  just its modification time.
+ *
  *  Usage:
  *      Create an instance initialized with the root of the source tree, the
  *      root location to store the cache files, and an instance of a file finder.
@@ -36,6 +42,18 @@ public:
 
     // Default Copy Constructor and Destructor are fine
 
+    /** setJobs sets how many images crunch() processes at once: 1 (the
+     * default) does them one after another, 0 uses one thread per CPU.
+     * With more than one job, the CacheUpdater's processImage is called
+     * from several threads at once.
+     */
+    void setJobs(int jobs) { mJobs = jobs; }
+
+    /** setOptions describes the settings images are crunched with. A
+     * cached image that was crunched with different options is stale.
+     */
+    void setOptions(const String8& options) { mOptions = options; }
+
     /** crunch is the workhorse of this class.
      * It goes through all the files found in the sourcePath and compares
      * them to the cached versions in the destPath. If the optional
@@ -43,7 +61,7 @@ public:
      * re-crunched even if they have not been modified recently. Otherwise,
      * source files are only crunched when they needUpdating. Afterwards,
      * we delete any leftover files in the cache that are no longer present
-     * in source.
+     * in source, and write out the manifest.
      *
      * PRECONDITIONS:
      *      No setup besides construction is needed
@@ -55,6 +73,37 @@ public:
     size_t crunch(CacheUpdater* cu, bool forceOverwrite=false);
 
 private:
+    // What the manifest remembers about one source file.
+    struct ManifestEntry {
+        ManifestEntry() : contentHash(0), optionsHash(0), size(-1), mtime(0) {}
+
+        uint64_t contentHash;
+        uint64_t optionsHash;
+        int64_t size;
+        int64_t mtime;
+    };
+
+    // One source file being brought up to date by crunch().
+    struct CrunchItem {
+        CrunchItem() : sourceTime(0), destTime(0), hasEntry(false), updated(false) {}
+
+        String8 relativePath;
+        time_t sourceTime;
+        time_t destTime;        // 0 if there is no cached copy
+        bool hasEntry;          // entry holds a valid manifest entry
+        ManifestEntry entry;
+        bool updated;
+    };
+
+    class CrunchUnit;
+
+    /** readManifest and writeManifest load mManifest from, and save it
+     * to, the manifest file in the cache directory. A missing or
+     * unreadable manifest reads as empty.
+     */
+    void readManifest();
+    void writeManifest() const;
+
     /** loadFiles is a wrapper to the FileFinder that places matching
      * files into mSourceFiles and mDestFiles.
      *
@@ -65,23 +114,30 @@ private:
      */
     void loadFiles();
 
-    /** needsUpdating takes a file path
-     * and returns true if the file represented by this path is newer in the
-     * sourceFiles than in the cache (mDestFiles).
+    /** needsUpdating takes a source file being crunched and returns true
+     * if its cached copy is stale. The source is only hashed, through the
+     * FileFinder, when its size or modification time differ from what the
+     * manifest says.
+     * It only touches "item", so several items can be checked at once.
      *
      * PRECONDITIONS:
-     *      mSourceFiles and mDestFiles must be initialized and filled.
+     *      mSourceFiles, mDestFiles and mManifest must be loaded, and item
+     *      filled in from them.
      * POSTCONDITIONS:
-     *      returns true if and only if source file's modification time
-     *      is greater than the cached file's mod-time. Otherwise returns false.
+     *      returns true if there is no cached copy, the manifest entry was
+     *      made with other options or from different contents, or there is
+     *      no manifest entry and the source file's modification time is
+     *      greater than the cached file's mod-time. item->entry then
+     *      describes the source file as it is now; item->hasEntry is false
+     *      if it couldn't be read.
      *
      * USAGE:
      *      Should be used something like the following:
-     *      if (needsUpdating(filePath))
+     *      if (needsUpdating(&item, optionsHash))
      *          // Recrunch sourceFile out to destFile.
      *
      */
-    bool needsUpdating(String8 relativePath) const;
+    bool needsUpdating(CrunchItem* item, uint64_t optionsHash) const;
 
     // DATA MEMBERS ====================================================
 
@@ -95,6 +151,12 @@ private:
     DefaultKeyedVector<String8,time_t> mSourceFiles;
     DefaultKeyedVector<String8,time_t> mDestFiles;
 
+    // Manifest entries, keyed by path relative to mSourcePath.
+    KeyedVector<String8,ManifestEntry> mManifest;
+
+    String8 mOptions;
+    int mJobs;
+
     // Pointer to a FileFinder to use
     FileFinder* mFileFinder;
 };
@@ -0,0 +1,127 @@
+//
+// Copyright 2026 The Android Open Source Project
+//
+// Implementation file for DirectoryScanner
+// This file defines functions laid out and documented in
+// DirectoryScanner.h
+
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+#include <errno.h>
+#include <string.h>
+
+#include "DirectoryScanner.h"
+#include "DirectoryWalker.h"
+#include "WorkStealingPool.h"
+
+using namespace android;
+
+// Reads one directory on a pool thread.
+class DirectoryScanner::ScanUnit : public WorkQueue::WorkUnit {
+public:
+    ScanUnit(DirectoryScanner* scanner, Dir* dir) : mScanner(scanner), mDir(dir) {}
+
+    virtual bool run() {
+        mScanner->scanDir(mDir);
+        return true;
+    }
+
+private:
+    DirectoryScanner* const mScanner;
+    Dir* const mDir;
+};
+
+DirectoryScanner::Dir::~Dir()
+{
+    for (size_t i = 0; i < entries.size(); i++) {
+        delete entries[i].dir;
+    }
+}
+
+DirectoryScanner::DirectoryScanner(DirectoryWalker* walker, int jobs)
+    : mWalker(walker), mJobs(jobs), mFilter(NULL), mPool(NULL), mRoot(NULL)
+{
+}
+
+DirectoryScanner::~DirectoryScanner()
+{
+    delete mRoot;
+}
+
+const DirectoryScanner::Dir* DirectoryScanner::scan(const String8& path, Filter* filter)
+{
+    Filter everything;
+
+    delete mRoot;
+    mRoot = new Dir(path);
+    mFilter = filter != NULL ? filter : &everything;
+
+    if (mJobs == 1) {
+        scanDir(mRoot);
+    } else {
+        // Subdirectories are scheduled as they are found, and finish()
+        // keeps going until there are none left.
+        WorkStealingPool pool(mJobs);
+        mPool = &pool;
+        scanDir(mRoot);
+        pool.finish();
+        mPool = NULL;
+    }
+
+    mFilter = NULL;
+    return mRoot;
+}
+
+void DirectoryScanner::scanDir(Dir* dir)
+{
+    DirectoryWalker* dw = mWalker->clone();
+    errno = 0;
+    if (!dw->openDir(dir->path)) {
+        dir->error = errno != 0 ? errno : EIO;
+        delete dw;
+        return;
+    }
+
+    struct dirent* entry;
+    while ((entry = dw->nextEntry()) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+
+        Entry e;
+        e.name = String8(entry->d_name);
+        e.type = dw->entryType();
+        if (e.type == kFileTypeRegular && mFilter->wantStats(dir->path, entry->d_name)) {
+            const struct stat* stats = dw->entryStats();
+            if (stats != NULL) {
+                e.size = stats->st_size;
+                e.mtime = stats->st_mtime;
+            } else {
+                // Gone (or unreadable) since the directory was read; it
+                // has no size or mtime to hand back.
+                e.type = kFileTypeNonexistent;
+            }
+        }
+        dir->entries.add(e);
+    }
+    dw->closeDir();
+    delete dw;
+
+    // Only look for subdirectories once the list is complete, so that
+    // nothing else holds on to it while it may still grow.
+    const size_t N = dir->entries.size();
+    for (size_t i = 0; i < N; i++) {
+        Entry& e = dir->entries.editItemAt(i);
+        if (e.type != kFileTypeDirectory || !mFilter->wantDir(dir->path, e.name.string()))
+            continue;
+
+        e.dir = new Dir(dir->path.appendPathCopy(e.name));
+        if (mPool != NULL) {
+            ScanUnit* w = new ScanUnit(this, e.dir);
+            if (mPool->schedule(w, 0) == OK)
+                continue;
+            delete w;
+        }
+        scanDir(e.dir);
+    }
+}
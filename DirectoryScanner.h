@@ -0,0 +1,108 @@
+//
+// Copyright 2026 The Android Open Source Project
+//
+// Reads a whole directory tree in one pass, on several threads.
+
+#ifndef DIRECTORYSCANNER_H
+#define DIRECTORYSCANNER_H
+
+#include <utils/String8.h>
+#include <utils/Vector.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "DirectoryWalker.h"
+
+namespace android {
+class WorkStealingPool;
+}
+
+using namespace android;
+
+/** DirectoryScanner
+ *  Walks a directory tree and records, for every entry, its name, type and
+ *  (where asked for) size and modification time. Each directory is read
+ *  once with a clone of the given DirectoryWalker, which supplies the type
+ *  without a stat() where it can. Subdirectories are read in parallel.
+ *
+ *  The tree is handed back as it was found: the entries of each directory
+ *  are in the order the walker returned them, so callers that build their
+ *  own structures from it see the same order a serial walk would give.
+ *
+ *  Usage:
+ *      DirectoryScanner scanner(&walker, jobs);
+ *      const DirectoryScanner::Dir* root = scanner.scan(path, &filter);
+ *      // root (and everything under it) lives as long as the scanner.
+ */
+class DirectoryScanner {
+public:
+    // Decides how much of the tree to read. Called from the scanning
+    // threads, so implementations must be safe to call concurrently.
+    class Filter {
+    public:
+        virtual ~Filter() {};
+        // Whether to read the subdirectory "name" of "dirPath"
+        virtual bool wantDir(const String8& /* dirPath */, const char* /* name */) {
+            return true;
+        };
+        // Whether to fill in the size and mtime of the file "name"
+        virtual bool wantStats(const String8& /* dirPath */, const char* /* name */) {
+            return false;
+        };
+    };
+
+    struct Dir;
+
+    struct Entry {
+        Entry() : type(kFileTypeUnknown), size(-1), mtime(0), dir(NULL) {}
+
+        String8 name;
+        FileType type;      // follows symlinks
+        int64_t size;       // -1 unless the filter asked for stats
+        time_t mtime;       // 0 unless the filter asked for stats
+        Dir* dir;           // the contents, for a directory that was read
+    };
+
+    struct Dir {
+        Dir(const String8& dirPath) : path(dirPath), error(0) {}
+        ~Dir();
+
+        String8 path;
+        int error;          // errno if the directory couldn't be opened
+        Vector<Entry> entries;
+
+    private:
+        // these are private and not defined
+        Dir(const Dir& src);
+        Dir& operator=(const Dir& src);
+    };
+
+    // "walker" is cloned for each directory read. With "jobs" of 1 the
+    // tree is read on the calling thread; 0 means one thread per CPU.
+    DirectoryScanner(DirectoryWalker* walker, int jobs = 1);
+    ~DirectoryScanner();
+
+    // Reads the tree under "path". With no filter, everything is read and
+    // nothing is stat()ed that the walker doesn't need to. Returns the
+    // root, which stays valid until the next scan or the scanner goes.
+    const Dir* scan(const String8& path, Filter* filter = NULL);
+
+private:
+    class ScanUnit;
+
+    // these are private and not defined
+    DirectoryScanner(const DirectoryScanner& src);
+    DirectoryScanner& operator=(const DirectoryScanner& src);
+
+    // Reads one directory, then hands each subdirectory to the pool (or
+    // reads it right away when there is no pool).
+    void scanDir(Dir* dir);
+
+    DirectoryWalker* mWalker;
+    int mJobs;
+    Filter* mFilter;
+    WorkStealingPool* mPool;
+    Dir* mRoot;
+};
+
+#endif // DIRECTORYSCANNER_H
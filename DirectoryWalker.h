@@ -8,10 +8,13 @@
 #define DIRECTORYWALKER_H
 
 #include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/param.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <androidfw/misc.h>
 #include <utils/String8.h>
 
 #include <stdio.h>
@@ -29,8 +32,20 @@ public:
     virtual bool openDir(const char* path) = 0;
     // Advance to next directory entry
     virtual struct dirent* nextEntry() = 0;
-    // Get the stats for the current entry
+    // Get the stats for the current entry, or NULL if they can't be read
     virtual struct stat*   entryStats() = 0;
+    // Get the type of the current entry, following symlinks. Walkers that
+    // can tell without stat()ing the entry should override this.
+    virtual FileType entryType() {
+        struct stat* stats = entryStats();
+        if (stats == NULL)
+            return kFileTypeUnknown;
+        if (S_ISREG(stats->st_mode))
+            return kFileTypeRegular;
+        if (S_ISDIR(stats->st_mode))
+            return kFileTypeDirectory;
+        return kFileTypeUnknown;
+    };
     // Clean Up
     virtual void closeDir() = 0;
     // This class is able to replicate itself on the heap
@@ -49,11 +64,17 @@ public:
 // This is an implementation of the above abstraction that calls
 // real system calls and is fully functional.
 // functions are inlined since they're very short and simple
+//
+// An entry is only stat()ed when its stats are asked for, or when the
+// directory entry itself doesn't say what type it is. The stat is done
+// relative to the open directory, so the full path isn't looked up again.
 
 class SystemDirectoryWalker : public DirectoryWalker {
 
-    // Default constructor, copy constructor, and destructor are fine
+    // Default copy constructor and destructor are fine
 public:
+    SystemDirectoryWalker() : dir(NULL), mStatsError(0), mHaveStats(false) {};
+
     virtual bool openDir(String8 path) {
         mBasePath = path;
         dir = NULL;
@@ -76,14 +97,34 @@ public:
             return NULL;
 
         mEntry = *entryPtr;
-        // Get stats
-        String8 fullPath = mBasePath.appendPathCopy(mEntry.d_name);
-        stat(fullPath.string(),&mStats);
+        mHaveStats = false;
         return &mEntry;
     };
-    // Get the stats for the current entry
+    // Get the stats for the current entry, or NULL if the stat failed
     virtual struct stat*   entryStats() {
-        return &mStats;
+        if (!mHaveStats) {
+#if defined(_WIN32)
+            String8 fullPath = mBasePath.appendPathCopy(mEntry.d_name);
+            mStatsError = stat(fullPath.string(),&mStats) == 0 ? 0 : errno;
+#else
+            mStatsError = fstatat(dirfd(dir), mEntry.d_name, &mStats, 0) == 0 ? 0 : errno;
+#endif
+            mHaveStats = true;
+        }
+        return mStatsError == 0 ? &mStats : NULL;
+    };
+    // Get the type of the current entry, following symlinks
+    virtual FileType entryType() {
+#ifdef _DIRENT_HAVE_D_TYPE
+        if (mEntry.d_type == DT_REG)
+            return kFileTypeRegular;
+        if (mEntry.d_type == DT_DIR)
+            return kFileTypeDirectory;
+#endif
+        entryStats();
+        if (mStatsError != 0)
+            return mStatsError == ENOENT ? kFileTypeNonexistent : kFileTypeUnknown;
+        return DirectoryWalker::entryType();
     };
     virtual void closeDir() {
         closedir(dir);
@@ -93,6 +134,9 @@ public:
     };
 private:
     DIR* dir;
+    // errno from the stat of the current entry, once mHaveStats is set
+    int mStatsError;
+    bool mHaveStats;
 };
 
 #endif // DIRECTORYWALKER_H
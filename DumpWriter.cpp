@@ -0,0 +1,416 @@
+//
+// Copyright 2026 The Android Open Source Project
+//
+// Output for "aapt dump", as text, JSON or binary records.
+//
+
+#include "DumpWriter.h"
+
+#include <androidfw/ResourceTypes.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+static const size_t kBufferSize = 64 * 1024;
+
+static const char kBinaryMagic[4] = { 'A', 'D', 'M', 'P' };
+static const uint32_t kBinaryVersion = 1;
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Prints records the way aapt always has.
+ */
+class TextDumpWriter : public DumpWriter {
+public:
+    TextDumpWriter(FILE* fp) : DumpWriter(kDumpFormatText, fp) {}
+
+protected:
+    virtual void writeRecord();
+
+private:
+    void writeQualifier(const Item& item);
+};
+
+/*
+ * Spells a qualifier the way it used to be written into the record name:
+ *     locale=fr        application-label-fr
+ *     density=240      application-icon-240
+ *     required=false   uses-feature-not-required, uses-library-not-required
+ *     sdk23=true       uses-feature-sdk-23, uses-implied-feature-sdk-23
+ */
+void TextDumpWriter::writeQualifier(const Item& item)
+{
+    if (item.key == "required") {
+        if (item.value == "false") {
+            write("-not-required");
+        }
+    } else if (item.key == "sdk23") {
+        if (item.value == "true") {
+            write("-sdk-23");
+        }
+    } else if (item.value.length() > 0) {
+        write("-");
+        write(item.value);
+    }
+}
+
+void TextDumpWriter::writeRecord()
+{
+    for (int i = 0; i < mDepth; i++) {
+        write("  ");
+    }
+    write(mName);
+
+    const size_t N = mItems.size();
+    for (size_t i = 0; i < N; i++) {
+        const Item& item = mItems.itemAt(i);
+        if (item.qualifier) {
+            writeQualifier(item);
+        }
+    }
+
+    bool first = true;
+    bool padded = false;
+    for (size_t i = 0; i < N; i++) {
+        const Item& item = mItems.itemAt(i);
+        if (item.kind == ITEM_PAD) {
+            padded = true;
+            continue;
+        }
+        if (item.qualifier) {
+            continue;
+        }
+        String8 value = item.normalize
+                ? ResTable::normalizeForOutput(item.value.string()) : item.value;
+
+        switch (mStyle) {
+            case STYLE_FLAG:
+                break;
+            case STYLE_SPACED:
+                write(first ? ": " : padded ? "  " : " ");
+                if (item.kind == ITEM_ATTR) {
+                    write(item.key);
+                    write("=");
+                }
+                write("'");
+                write(value);
+                write("'");
+                break;
+            case STYLE_COMPACT:
+                write(first ? ":'" : ",'");
+                write(value);
+                write("'");
+                break;
+            case STYLE_ASSIGN:
+                write("='");
+                write(value);
+                write("'");
+                break;
+            case STYLE_PLAIN:
+                write(first ? ": " : " ");
+                write(value);
+                break;
+        }
+        first = false;
+        padded = false;
+    }
+
+    // an empty list still gets its colon: "compatible-screens:"
+    if (first && (mStyle == STYLE_SPACED || mStyle == STYLE_COMPACT)) {
+        write(":");
+    }
+    write("\n");
+}
+
+// ---------------------------------------------------------------------------
+
+/*
+ * One JSON object per record, one record per line.
+ */
+class JsonDumpWriter : public DumpWriter {
+public:
+    JsonDumpWriter(FILE* fp) : DumpWriter(kDumpFormatJson, fp) {}
+
+protected:
+    virtual void writeRecord();
+
+private:
+    void writeString(const String8& str);
+};
+
+void JsonDumpWriter::writeString(const String8& str)
+{
+    static const char kHex[] = "0123456789abcdef";
+
+    write("\"");
+    const char* p = str.string();
+    const char* run = p;
+    const char* end = p + str.length();
+    for (; p < end; p++) {
+        const unsigned char c = *p;
+        if (c != '"' && c != '\\' && c >= 0x20) {
+            continue;
+        }
+        write(run, p - run);
+        run = p + 1;
+        switch (c) {
+            case '"':  write("\\\""); break;
+            case '\\': write("\\\\"); break;
+            case '\n': write("\\n"); break;
+            case '\r': write("\\r"); break;
+            case '\t': write("\\t"); break;
+            default: {
+                char esc[7] = { '\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0xf], 0 };
+                write(esc, 6);
+                break;
+            }
+        }
+    }
+    write(run, p - run);
+    write("\"");
+}
+
+void JsonDumpWriter::writeRecord()
+{
+    write("{\"record\":");
+    writeString(mName);
+    if (mDepth > 0) {
+        write(",\"depth\":");
+        write(String8::format("%d", mDepth));
+    }
+
+    bool hasValues = false;
+    const size_t N = mItems.size();
+    for (size_t i = 0; i < N; i++) {
+        const Item& item = mItems.itemAt(i);
+        if (item.kind == ITEM_ATTR) {
+            write(",");
+            writeString(item.key);
+            write(":");
+            writeString(item.value);
+        } else if (item.kind == ITEM_VALUE) {
+            hasValues = true;
+        }
+    }
+
+    if (hasValues) {
+        write(",\"values\":[");
+        bool first = true;
+        for (size_t i = 0; i < N; i++) {
+            const Item& item = mItems.itemAt(i);
+            if (item.kind != ITEM_VALUE) {
+                continue;
+            }
+            if (!first) {
+                write(",");
+            }
+            writeString(item.value);
+            first = false;
+        }
+        write("]");
+    }
+    write("}\n");
+}
+
+// ---------------------------------------------------------------------------
+
+/*
+ * Length-prefixed records; see DumpWriter.h for the layout.
+ */
+class BinaryDumpWriter : public DumpWriter {
+public:
+    BinaryDumpWriter(FILE* fp) : DumpWriter(kDumpFormatBinary, fp) {
+        write(kBinaryMagic, sizeof(kBinaryMagic));
+        write32(kBinaryVersion);
+    }
+
+protected:
+    virtual void writeRecord();
+
+private:
+    void writeString(const String8& str) {
+        write32(str.length());
+        write(str);
+    }
+};
+
+void BinaryDumpWriter::writeRecord()
+{
+    uint32_t length = 1 + 4 + mName.length() + 2;
+    uint16_t count = 0;
+    const size_t N = mItems.size();
+    for (size_t i = 0; i < N; i++) {
+        const Item& item = mItems.itemAt(i);
+        if (item.kind == ITEM_PAD) {
+            continue;
+        }
+        length += 1 + 4 + item.value.length();
+        if (item.kind == ITEM_ATTR) {
+            length += 4 + item.key.length();
+        }
+        count++;
+    }
+
+    write32(length);
+    const char depth = (char) mDepth;
+    write(&depth, 1);
+    writeString(mName);
+    const char countBytes[2] = { (char) (count & 0xff), (char) (count >> 8) };
+    write(countBytes, 2);
+
+    for (size_t i = 0; i < N; i++) {
+        const Item& item = mItems.itemAt(i);
+        if (item.kind == ITEM_PAD) {
+            continue;
+        }
+        const char kind = (char) item.kind;
+        write(&kind, 1);
+        if (item.kind == ITEM_ATTR) {
+            writeString(item.key);
+        }
+        writeString(item.value);
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+DumpWriter* DumpWriter::create(DumpFormat format, FILE* fp)
+{
+    switch (format) {
+        case kDumpFormatJson:
+            return new JsonDumpWriter(fp);
+        case kDumpFormatBinary:
+            return new BinaryDumpWriter(fp);
+        case kDumpFormatText:
+        default:
+            return new TextDumpWriter(fp);
+    }
+}
+
+DumpWriter::DumpWriter(DumpFormat format, FILE* fp)
+    : mStyle(STYLE_FLAG), mDepth(0), mFormat(format), mFp(fp),
+      mBuf((char*) malloc(kBufferSize)), mLen(0), mError(false)
+{
+}
+
+DumpWriter::~DumpWriter()
+{
+    flush();
+    free(mBuf);
+}
+
+void DumpWriter::begin(const char* name, TextStyle style, int depth)
+{
+    mName.setTo(name);
+    mStyle = style;
+    mDepth = depth;
+    mItems.clear();
+}
+
+void DumpWriter::attr(const char* key, const String8& value, bool normalize)
+{
+    Item item;
+    item.kind = ITEM_ATTR;
+    item.key.setTo(key);
+    item.value = value;
+    item.normalize = normalize;
+    mItems.add(item);
+}
+
+void DumpWriter::attr(const char* key, int32_t value)
+{
+    attr(key, String8::format("%d", value), false);
+}
+
+void DumpWriter::qualifier(const char* key, const String8& value)
+{
+    attr(key, value, false);
+    mItems.editTop().qualifier = true;
+}
+
+void DumpWriter::qualifier(const char* key, int32_t value)
+{
+    qualifier(key, String8::format("%d", value));
+}
+
+void DumpWriter::qualifier(const char* key, bool value)
+{
+    qualifier(key, String8(value ? "true" : "false"));
+}
+
+void DumpWriter::value(const String8& value, bool normalize)
+{
+    Item item;
+    item.value = value;
+    item.normalize = normalize;
+    mItems.add(item);
+}
+
+void DumpWriter::value(int32_t value)
+{
+    this->value(String8::format("%d", value), false);
+}
+
+void DumpWriter::pad()
+{
+    Item item;
+    item.kind = ITEM_PAD;
+    mItems.add(item);
+}
+
+void DumpWriter::end()
+{
+    writeRecord();
+    mItems.clear();
+}
+
+status_t DumpWriter::flush()
+{
+    flushBuffer();
+    if (fflush(mFp) != 0) {
+        mError = true;
+    }
+    return mError ? UNKNOWN_ERROR : NO_ERROR;
+}
+
+void DumpWriter::flushBuffer()
+{
+    if (mLen > 0 && !mError) {
+        if (fwrite(mBuf, 1, mLen, mFp) != mLen) {
+            mError = true;
+        }
+    }
+    mLen = 0;
+}
+
+void DumpWriter::write(const char* data, size_t len)
+{
+    if (mBuf == NULL || len >= kBufferSize) {
+        // too big to be worth copying
+        flushBuffer();
+        if (len > 0 && fwrite(data, 1, len, mFp) != len) {
+            mError = true;
+        }
+        return;
+    }
+    if (mLen + len > kBufferSize) {
+        flushBuffer();
+    }
+    memcpy(mBuf + mLen, data, len);
+    mLen += len;
+}
+
+void DumpWriter::write(const char* str)
+{
+    write(str, strlen(str));
+}
+
+void DumpWriter::write32(uint32_t value)
+{
+    const char bytes[4] = {
+        (char) (value & 0xff), (char) ((value >> 8) & 0xff),
+        (char) ((value >> 16) & 0xff), (char) (value >> 24)
+    };
+    write(bytes, sizeof(bytes));
+}
@@ -0,0 +1,138 @@
+//
+// Copyright 2026 The Android Open Source Project
+//
+// Output for "aapt dump", as text, JSON or binary records.
+//
+
+#ifndef __DUMP_WRITER_H
+#define __DUMP_WRITER_H
+
+#include "Bundle.h"
+
+#include <utils/Errors.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+using namespace android;
+
+/*
+ * Writes dump output as a series of records.  A record has a name, a
+ * nesting depth and a list of items; an item is either a named attribute
+ * or a bare value.  In text form a record is one line, shaped by its
+ * TextStyle exactly as aapt has always printed it.
+ *
+ * Record names are fixed; anything that varies goes in an attribute.  A
+ * few attributes (added with qualifier()) were spelled into the record
+ * name by older versions of aapt, e.g. "application-label-fr" or
+ * "uses-feature-not-required"; text output still spells them that way
+ * and leaves them out of the item list.
+ *
+ * JSON is one object per line:
+ *     {"record":NAME, "depth":N, ATTR:VALUE, ..., "values":[VALUE, ...]}
+ * "depth" is left out when it is 0 and "values" when there are none.  All
+ * values are strings, and are never escaped the way text output is.
+ *
+ * Binary starts with the magic "ADMP" and a version, then each record is
+ *     u32 length of the rest of the record
+ *     u8  depth
+ *     str name
+ *     u16 item count, then per item:
+ *         u8 kind (0 attribute, 1 value), str key (attributes only), str value
+ * where "str" is a u32 byte count followed by UTF-8 bytes, and all numbers
+ * are little-endian.
+ *
+ * Output is collected in a buffer and written out in large blocks, so
+ * nothing else should write to the same stream until flush().
+ */
+class DumpWriter {
+public:
+    enum TextStyle {
+        STYLE_FLAG,         // name
+        STYLE_SPACED,       // name: key='value' 'value'
+        STYLE_COMPACT,      // name:'value','value'
+        STYLE_ASSIGN,       // name='value'
+        STYLE_PLAIN         // name: value
+    };
+
+    static DumpWriter* create(DumpFormat format, FILE* fp);
+    virtual ~DumpWriter();
+
+    DumpFormat getFormat() const { return mFormat; }
+
+    /* Starts a record; it is written by end(). */
+    void begin(const char* name, TextStyle style, int depth = 0);
+
+    /*
+     * Adds an item to the current record.  "normalize" escapes the value
+     * with ResTable::normalizeForOutput() in text output.
+     */
+    void attr(const char* key, const String8& value, bool normalize = true);
+    void attr(const char* key, int32_t value);
+
+    /*
+     * Adds an attribute that text output folds into the record name (see
+     * TextDumpWriter).  Booleans are "true" or "false".
+     */
+    void qualifier(const char* key, const String8& value);
+    void qualifier(const char* key, int32_t value);
+    void qualifier(const char* key, bool value);
+    void value(const String8& value, bool normalize = true);
+    void value(int32_t value);
+
+    /* An extra space before the next item, in text output only. */
+    void pad();
+
+    void end();
+
+    /* Writes out whatever is buffered. */
+    status_t flush();
+
+protected:
+    enum ItemKind {
+        ITEM_ATTR = 0,
+        ITEM_VALUE = 1,
+        ITEM_PAD = 2
+    };
+
+    struct Item {
+        Item() : kind(ITEM_VALUE), normalize(false), qualifier(false) {}
+
+        ItemKind kind;
+        String8 key;
+        String8 value;
+        bool normalize;
+        bool qualifier;     // an ITEM_ATTR that text output puts in the name
+    };
+
+    DumpWriter(DumpFormat format, FILE* fp);
+
+    virtual void writeRecord() = 0;
+
+    void write(const char* data, size_t len);
+    void write(const String8& str) { write(str.string(), str.length()); }
+    void write(const char* str);
+    void write32(uint32_t value);
+
+    String8 mName;
+    TextStyle mStyle;
+    int mDepth;
+    Vector<Item> mItems;
+
+private:
+    /* these are private and not defined */
+    DumpWriter(const DumpWriter& src);
+    DumpWriter& operator=(const DumpWriter& src);
+
+    void flushBuffer();
+
+    const DumpFormat mFormat;
+    FILE* mFp;
+    char* mBuf;
+    size_t mLen;
+    bool mError;
+};
+
+#endif // __DUMP_WRITER_H
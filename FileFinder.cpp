@@ -10,8 +10,10 @@
 #include <utils/KeyedVector.h>
 
 #include <dirent.h>
+#include <stdio.h>
 #include <sys/stat.h>
 
+#include "DirectoryScanner.h"
 #include "DirectoryWalker.h"
 #include "FileFinder.h"
 
@@ -19,80 +21,108 @@
 
 using android::String8;
 
-// Private function to check whether a file is a directory or not
-bool isDirectory(const char* filename) {
-    struct stat fileStat;
-    if (stat(filename, &fileStat) == -1) {
-        return false;
-    }
-    return(S_ISDIR(fileStat.st_mode));
-}
+// Skips hidden files and directories, and only asks for the stats of
+// the files we are going to keep.
+class SystemFileFinder::ExtensionFilter : public DirectoryScanner::Filter {
+public:
+    ExtensionFilter(const Vector<String8>& extensions) : mExtensions(extensions) {}
 
+    virtual bool wantDir(const String8& /* dirPath */, const char* name) {
+        return name[0] != '.';
+    }
 
-// Private function to check whether a file is a regular file or not
-bool isFile(const char* filename) {
-    struct stat fileStat;
-    if (stat(filename, &fileStat) == -1) {
-        return false;
+    virtual bool wantStats(const String8& /* dirPath */, const char* name) {
+        return name[0] != '.' && hasMatchingExtension(String8(name), mExtensions);
     }
-    return(S_ISREG(fileStat.st_mode));
-}
+
+private:
+    const Vector<String8>& mExtensions;
+};
 
 bool SystemFileFinder::findFiles(String8 basePath, Vector<String8>& extensions,
                                  KeyedVector<String8,time_t>& fileStore,
                                  DirectoryWalker* dw)
 {
-    // Scan the directory pointed to by basePath
-    // check files and recurse into subdirectories.
-    if (!dw->openDir(basePath)) {
+    // Scan the directory pointed to by basePath and everything under it,
+    // then pick out the matching files.
+    ExtensionFilter filter(extensions);
+    DirectoryScanner scanner(dw, mJobs);
+    const DirectoryScanner::Dir* root = scanner.scan(basePath, &filter);
+    if (root->error != 0) {
         return false;
     }
-    /*
-     *  Go through all directory entries. Check each file using checkAndAddFile
-     *  and recurse into sub-directories.
-     */
-    struct dirent* entry;
-    while ((entry = dw->nextEntry()) != NULL) {
-        String8 entryName(entry->d_name);
-        if (entry->d_name[0] == '.') // Skip hidden files and directories
+
+    addFiles(root, extensions, fileStore);
+    return true;
+}
+
+void SystemFileFinder::addFiles(const DirectoryScanner::Dir* dir,
+                                const Vector<String8>& extensions,
+                                KeyedVector<String8,time_t>& fileStore)
+{
+    const size_t N = dir->entries.size();
+    for (size_t i = 0; i < N; i++) {
+        const DirectoryScanner::Entry& entry = dir->entries[i];
+        if (entry.name.string()[0] == '.') // Skip hidden files and directories
             continue;
 
-        String8 fullPath = basePath.appendPathCopy(entryName);
         // If this entry is a directory we'll recurse into it
-        if (isDirectory(fullPath.string()) ) {
-            DirectoryWalker* copy = dw->clone();
-            findFiles(fullPath, extensions, fileStore,copy);
-            delete copy;
+        if (entry.dir != NULL) {
+            addFiles(entry.dir, extensions, fileStore);
         }
 
-        // If this entry is a file, we'll pass it over to checkAndAddFile
-        if (isFile(fullPath.string()) ) {
-            checkAndAddFile(fullPath,dw->entryStats(),extensions,fileStore);
+        // If this entry is a matching file, add it with its modification time
+        if (entry.type == kFileTypeRegular && hasMatchingExtension(entry.name, extensions)) {
+            fileStore.add(dir->path.appendPathCopy(entry.name), entry.mtime);
         }
     }
-
-    // Clean up
-    dw->closeDir();
-
-    return true;
 }
 
-void SystemFileFinder::checkAndAddFile(String8 path, const struct stat* stats,
-                                       Vector<String8>& extensions,
-                                       KeyedVector<String8,time_t>& fileStore)
+bool SystemFileFinder::hasMatchingExtension(const String8& name,
+                                            const Vector<String8>& extensions)
 {
     // Loop over the extensions, checking for a match
-    bool done = false;
-    String8 ext(path.getPathExtension());
+    String8 ext(name.getPathExtension());
     ext.toLower();
-    for (size_t i = 0; i < extensions.size() && !done; ++i) {
+    for (size_t i = 0; i < extensions.size(); ++i) {
         String8 ext2 = extensions[i].getPathExtension();
         ext2.toLower();
-        // Compare the extensions. If a match is found, add to storage.
+        // Compare the extensions.
         if (ext == ext2) {
-            done = true;
-            fileStore.add(path,stats->st_mtime);
+            return true;
         }
     }
+    return false;
 }
 
+bool SystemFileFinder::getFileSize(const String8& path, int64_t* outSize)
+{
+    struct stat st;
+    if (stat(path.string(), &st) != 0) {
+        return false;
+    }
+    *outSize = st.st_size;
+    return true;
+}
+
+bool SystemFileFinder::hashFile(const String8& path, uint64_t* outHash)
+{
+    FILE* fp = fopen(path.string(), "rb");
+    if (fp == NULL) {
+        return false;
+    }
+
+    unsigned char buf[16384];
+    uint64_t hash = 14695981039346656037ull;
+    size_t count;
+    while ((count = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            hash = (hash ^ buf[i]) * 1099511628211ull;
+        }
+    }
+    const bool ok = !ferror(fp);
+    fclose(fp);
+
+    *outHash = hash;
+    return ok;
+}
@@ -13,7 +13,9 @@
 #include <utils/Vector.h>
 #include <utils/KeyedVector.h>
 #include <utils/String8.h>
+#include <stdint.h>
 
+#include "DirectoryScanner.h"
 #include "DirectoryWalker.h"
 
 using namespace android;
@@ -26,11 +28,23 @@ public:
                            KeyedVector<String8,time_t>& fileStore,
                            DirectoryWalker* dw) = 0;
 
+    // These two may be called from several threads at once.
+
+    // Size in bytes of the file at path; false if it can't be found.
+    virtual bool getFileSize(const String8& path, int64_t* outSize) = 0;
+
+    // 64-bit FNV-1a hash of the contents of the file at path; false if it
+    // can't be read.
+    virtual bool hashFile(const String8& path, uint64_t* outHash) = 0;
+
     virtual ~FileFinder() {};
 };
 
 class SystemFileFinder : public FileFinder {
 public:
+    // "jobs" is how many threads to read directories on: 1 (the default)
+    // reads them on the calling thread, 0 uses one thread per CPU.
+    SystemFileFinder(int jobs = 1) : mJobs(jobs) {};
 
     /* findFiles takes a path, a Vector of extensions, and a destination KeyedVector
      *           and places path/modification date key/values pointing to
@@ -50,31 +64,38 @@ public:
      *                as keys in the KeyedVector. Each key has the modification time
      *                of the file as its value.
      *
-     * Calls checkAndAddFile on each file encountered in the directory tree
-     * Recursively descends into subdirectories.
+     * Reads the whole tree with a DirectoryScanner, using clones of dw,
+     * and only stats the files whose extension matches.
      */
     virtual bool findFiles(String8 basePath, Vector<String8>& extensions,
                            KeyedVector<String8,time_t>& fileStore,
                            DirectoryWalker* dw);
 
+    virtual bool getFileSize(const String8& path, int64_t* outSize);
+    virtual bool hashFile(const String8& path, uint64_t* outHash);
+
 private:
+    class ExtensionFilter;
+
     /**
-     * checkAndAddFile looks at a single file path and stat combo
-     * to determine whether it is a matching file (by looking at
-     * the extension)
+     * hasMatchingExtension looks at a single file name to determine
+     * whether it is a matching file (by looking at the extension)
      *
      * PRECONDITIONS
      *    no setup is needed
      *
      * POSTCONDITIONS
-     *    If the given file has a matching extension then a new entry
-     *    is added to the KeyedVector with the path as the key and the modification
-     *    time as the value.
+     *    Returns true if the given file has one of the extensions.
      *
      */
-    static void checkAndAddFile(String8 path, const struct stat* stats,
-                                Vector<String8>& extensions,
-                                KeyedVector<String8,time_t>& fileStore);
+    static bool hasMatchingExtension(const String8& name,
+                                     const Vector<String8>& extensions);
+
+    // Collects the matching files found under dir into fileStore
+    static void addFiles(const DirectoryScanner::Dir* dir,
+                         const Vector<String8>& extensions,
+                         KeyedVector<String8,time_t>& fileStore);
 
+    int mJobs;
 };
 #endif // FILEFINDER_H
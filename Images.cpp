@@ -14,6 +14,10 @@
 #include <png.h>
 #include <zlib.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
 // Change this to true for noisy debug output.
 static const bool kIsDebug = false;
 
@@ -871,6 +875,171 @@ static void dump_image(int w, int h, png_bytepp rows, int color_type)
 #define MAX(a,b) ((a)>(b)?(a):(b))
 #define ABS(a)   ((a)<0?-(a):(a))
 
+// What analyze_image() needs to know about the pixels of a row, apart from
+// its colors.
+struct pixel_stats
+{
+    int maxGrayDeviation;   // largest |r - g|, |g - b| or |b - r|
+    bool isOpaque;          // every alpha is 0xff
+};
+
+// Zeroes the color of every pixel with zero alpha in an RGBA row, and
+// folds the row into "stats".  A row is gray exactly when its deviation
+// is zero.
+typedef void (*scan_row_func)(png_bytep row, int w, pixel_stats* stats);
+
+static void scan_row_scalar(png_bytep row, int w, pixel_stats* stats)
+{
+    int maxGrayDeviation = stats->maxGrayDeviation;
+    bool isOpaque = stats->isOpaque;
+    for (int i = 0; i < w; i++, row += 4) {
+        const int aa = row[3];
+        if (aa == 0) {
+            row[0] = 0;
+            row[1] = 0;
+            row[2] = 0;
+            isOpaque = false;
+            continue;
+        }
+        const int rr = row[0];
+        const int gg = row[1];
+        const int bb = row[2];
+        maxGrayDeviation = MAX(ABS(rr - gg), maxGrayDeviation);
+        maxGrayDeviation = MAX(ABS(gg - bb), maxGrayDeviation);
+        maxGrayDeviation = MAX(ABS(bb - rr), maxGrayDeviation);
+        isOpaque = isOpaque && aa == 0xff;
+    }
+    stats->maxGrayDeviation = maxGrayDeviation;
+    stats->isOpaque = isOpaque;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// The vector kernels work on whole pixels, one per 32-bit lane: a pixel
+// with zero alpha is cleared with a compare and a mask, and the channel
+// differences come from comparing each pixel with itself rotated by one
+// and two bytes (R-G and G-B in the low two bytes, B-R in the low byte).
+// Whatever doesn't fill a vector goes through the scalar kernel.
+
+__attribute__((target("sse2")))
+static void scan_row_sse2(png_bytep row, int w, pixel_stats* stats)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lowTwo = _mm_set1_epi32(0x0000ffff);
+    const __m128i lowOne = _mm_set1_epi32(0x000000ff);
+    __m128i alphaAnd = _mm_set1_epi32(-1);
+    __m128i dev = zero;
+
+    int i = 0;
+    for (; i + 4 <= w; i += 4, row += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*) row);
+        const __m128i transparent = _mm_cmpeq_epi32(_mm_srli_epi32(v, 24), zero);
+        v = _mm_andnot_si128(transparent, v);
+        _mm_storeu_si128((__m128i*) row, v);
+
+        alphaAnd = _mm_and_si128(alphaAnd, v);
+
+        const __m128i rot8 = _mm_or_si128(_mm_srli_epi32(v, 8), _mm_slli_epi32(v, 24));
+        const __m128i rot16 = _mm_or_si128(_mm_srli_epi32(v, 16), _mm_slli_epi32(v, 16));
+        const __m128i d1 = _mm_or_si128(_mm_subs_epu8(v, rot8), _mm_subs_epu8(rot8, v));
+        const __m128i d2 = _mm_or_si128(_mm_subs_epu8(v, rot16), _mm_subs_epu8(rot16, v));
+        dev = _mm_max_epu8(dev, _mm_and_si128(d1, lowTwo));
+        dev = _mm_max_epu8(dev, _mm_and_si128(d2, lowOne));
+    }
+
+    uint8_t devBytes[16];
+    uint8_t alphaBytes[16];
+    _mm_storeu_si128((__m128i*) devBytes, dev);
+    _mm_storeu_si128((__m128i*) alphaBytes, alphaAnd);
+    for (int k = 0; k < 16; k++) {
+        stats->maxGrayDeviation = MAX((int) devBytes[k], stats->maxGrayDeviation);
+    }
+    for (int k = 3; k < 16; k += 4) {
+        stats->isOpaque = stats->isOpaque && alphaBytes[k] == 0xff;
+    }
+
+    scan_row_scalar(row, w - i, stats);
+}
+
+__attribute__((target("avx2")))
+static void scan_row_avx2(png_bytep row, int w, pixel_stats* stats)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i lowTwo = _mm256_set1_epi32(0x0000ffff);
+    const __m256i lowOne = _mm256_set1_epi32(0x000000ff);
+    __m256i alphaAnd = _mm256_set1_epi32(-1);
+    __m256i dev = zero;
+
+    int i = 0;
+    for (; i + 8 <= w; i += 8, row += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) row);
+        const __m256i transparent = _mm256_cmpeq_epi32(_mm256_srli_epi32(v, 24), zero);
+        v = _mm256_andnot_si256(transparent, v);
+        _mm256_storeu_si256((__m256i*) row, v);
+
+        alphaAnd = _mm256_and_si256(alphaAnd, v);
+
+        const __m256i rot8 = _mm256_or_si256(_mm256_srli_epi32(v, 8), _mm256_slli_epi32(v, 24));
+        const __m256i rot16 = _mm256_or_si256(_mm256_srli_epi32(v, 16), _mm256_slli_epi32(v, 16));
+        const __m256i d1 = _mm256_or_si256(_mm256_subs_epu8(v, rot8), _mm256_subs_epu8(rot8, v));
+        const __m256i d2 = _mm256_or_si256(_mm256_subs_epu8(v, rot16), _mm256_subs_epu8(rot16, v));
+        dev = _mm256_max_epu8(dev, _mm256_and_si256(d1, lowTwo));
+        dev = _mm256_max_epu8(dev, _mm256_and_si256(d2, lowOne));
+    }
+
+    uint8_t devBytes[32];
+    uint8_t alphaBytes[32];
+    _mm256_storeu_si256((__m256i*) devBytes, dev);
+    _mm256_storeu_si256((__m256i*) alphaBytes, alphaAnd);
+    for (int k = 0; k < 32; k++) {
+        stats->maxGrayDeviation = MAX((int) devBytes[k], stats->maxGrayDeviation);
+    }
+    for (int k = 3; k < 32; k += 4) {
+        stats->isOpaque = stats->isOpaque && alphaBytes[k] == 0xff;
+    }
+
+    scan_row_scalar(row, w - i, stats);
+}
+
+#endif // defined(__x86_64__) || defined(__i386__)
+
+static scan_row_func select_scan_row()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return scan_row_avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return scan_row_sse2;
+    }
+#endif
+    return scan_row_scalar;
+}
+
+// Returns the index of "col" among the first 256 distinct colors seen,
+// adding it if it is new.  "slots" is a 512-entry open-addressing hash of
+// color to index, initialized to -1; it never holds more than 256 colors,
+// so it is never more than half full.  Past 256 colors the count keeps
+// going but nothing more is stored, and the returned index is the count.
+static int find_palette_color(uint32_t col, uint32_t* colors, int16_t* slots, int* numColors)
+{
+    uint32_t h = (col * 2654435761u) >> 23;
+    for (; slots[h] >= 0; h = (h + 1) & 511) {
+        if (colors[slots[h]] == col) {
+            return slots[h];
+        }
+    }
+
+    const int idx = *numColors;
+    if (idx < 256) {
+        colors[idx] = col;
+        slots[h] = idx;
+    }
+    (*numColors)++;
+    return idx;
+}
+
 static void analyze_image(const char *imageName, image_info &imageInfo, int grayscaleTolerance,
                           png_colorp rgbPalette, png_bytep alphaPalette,
                           int *paletteEntries, int *alphaPaletteEntries, bool *hasTransparency,
@@ -878,15 +1047,13 @@ static void analyze_image(const char *imageName, image_info &imageInfo, int gray
 {
     int w = imageInfo.width;
     int h = imageInfo.height;
-    int i, j, rr, gg, bb, aa, idx;;
+    int i, j, rr, gg, bb, aa, idx;
     uint32_t opaqueColors[256], alphaColors[256];
+    int16_t opaqueSlots[512], alphaSlots[512];
     uint32_t col;
     int numOpaqueColors = 0, numAlphaColors = 0;
-    int maxGrayDeviation = 0;
 
-    bool isOpaque = true;
     bool isPalette = true;
-    bool isGrayscale = true;
 
     // Scan the entire image and determine if:
     // 1. Every pixel has R == G == B (grayscale)
@@ -896,134 +1063,72 @@ static void analyze_image(const char *imageName, image_info &imageInfo, int gray
     //        alpha.  This allows us to reencode the color table more
     //        efficiently (color tables entries without a corresponding
     //        alpha value are assumed to be opaque).
+    //
+    // The first two, and zeroing transparent pixels, are done a row at a
+    // time by the fastest scan_row kernel this CPU has.
 
     if (kIsDebug) {
         printf("Initial image data:\n");
         dump_image(w, h, imageInfo.rows, PNG_COLOR_TYPE_RGB_ALPHA);
     }
 
+    static const scan_row_func scan_row = select_scan_row();
+    pixel_stats stats;
+    stats.maxGrayDeviation = 0;
+    stats.isOpaque = true;
+
+    memset(opaqueSlots, 0xff, sizeof(opaqueSlots));
+    memset(alphaSlots, 0xff, sizeof(alphaSlots));
+
     for (j = 0; j < h; j++) {
         png_bytep row = imageInfo.rows[j];
         png_bytep out = outRows[j];
-        for (i = 0; i < w; i++) {
 
-            // Make sure any zero alpha pixels are fully zeroed.  On average,
-            // each of our PNG assets seem to have about four distinct pixels
-            // with zero alpha.
-            // There are several advantages to setting these to zero:
-            // (1) Images are more likely able to be encodable with a palette.
-            // (2) Image palettes will be smaller.
-            // (3) Premultiplied and unpremultiplied PNG decodes can skip
-            //     writing zeros to memory, often saving significant numbers
-            //     of memory pages.
-            aa = *(row + 3);
-            if (aa == 0) {
-                rr = 0;
-                gg = 0;
-                bb = 0;
-
-                // Also set red, green, and blue to zero in "row".  If we later
-                // decide to encode the PNG as RGB or RGBA, we will use the
-                // values stored there.
-                *(row) = 0;
-                *(row + 1) = 0;
-                *(row + 2) = 0;
+        // Make sure any zero alpha pixels are fully zeroed.  On average,
+        // each of our PNG assets seem to have about four distinct pixels
+        // with zero alpha.
+        // There are several advantages to setting these to zero:
+        // (1) Images are more likely able to be encodable with a palette.
+        // (2) Image palettes will be smaller.
+        // (3) Premultiplied and unpremultiplied PNG decodes can skip
+        //     writing zeros to memory, often saving significant numbers
+        //     of memory pages.
+        // They are zeroed in "row" itself, so that if we later decide to
+        // encode the PNG as RGB or RGBA, we will use the zeroed values.
+        scan_row(row, w, &stats);
+
+        // Check if image is really <= 256 colors
+        for (i = 0; isPalette && i < w; i++, row += 4) {
+            rr = row[0];
+            gg = row[1];
+            bb = row[2];
+            aa = row[3];
+            col = (uint32_t) ((rr << 24) | (gg << 16) | (bb << 8) | aa);
+
+            // Write the palette index for the pixel to outRows optimistically.
+            // We might overwrite it later if we decide to encode as gray or
+            // gray + alpha.  We may also need to overwrite it when we combine
+            // opaque colors into a single palette.
+            if (aa == 0xff) {
+                idx = find_palette_color(col, opaqueColors, opaqueSlots, &numOpaqueColors);
             } else {
-                rr = *(row);
-                gg = *(row + 1);
-                bb = *(row + 2);
+                idx = find_palette_color(col, alphaColors, alphaSlots, &numAlphaColors);
             }
-            row += 4;
+            *out++ = idx;
 
-            int odev = maxGrayDeviation;
-            maxGrayDeviation = MAX(ABS(rr - gg), maxGrayDeviation);
-            maxGrayDeviation = MAX(ABS(gg - bb), maxGrayDeviation);
-            maxGrayDeviation = MAX(ABS(bb - rr), maxGrayDeviation);
-            if (maxGrayDeviation > odev) {
+            if (numOpaqueColors + numAlphaColors > 256) {
                 if (kIsDebug) {
-                    printf("New max dev. = %d at pixel (%d, %d) = (%d %d %d %d)\n",
-                            maxGrayDeviation, i, j, rr, gg, bb, aa);
-                }
-            }
-
-            // Check if image is really grayscale
-            if (isGrayscale) {
-                if (rr != gg || rr != bb) {
-                    if (kIsDebug) {
-                        printf("Found a non-gray pixel at %d, %d = (%d %d %d %d)\n",
-                                i, j, rr, gg, bb, aa);
-                    }
-                    isGrayscale = false;
-                }
-            }
-
-            // Check if image is really opaque
-            if (isOpaque) {
-                if (aa != 0xff) {
-                    if (kIsDebug) {
-                        printf("Found a non-opaque pixel at %d, %d = (%d %d %d %d)\n",
-                                i, j, rr, gg, bb, aa);
-                    }
-                    isOpaque = false;
-                }
-            }
-
-            // Check if image is really <= 256 colors
-            if (isPalette) {
-                col = (uint32_t) ((rr << 24) | (gg << 16) | (bb << 8) | aa);
-                bool match = false;
-
-                if (aa == 0xff) {
-                    for (idx = 0; idx < numOpaqueColors; idx++) {
-                        if (opaqueColors[idx] == col) {
-                            match = true;
-                            break;
-                        }
-                    }
-
-                    if (!match) {
-                        if (numOpaqueColors < 256) {
-                            opaqueColors[numOpaqueColors] = col;
-                        }
-                        numOpaqueColors++;
-                    }
-
-                    // Write the palette index for the pixel to outRows optimistically.
-                    // We might overwrite it later if we decide to encode as gray or
-                    // gray + alpha.  We may also need to overwrite it when we combine
-                    // into a single palette.
-                    *out++ = idx;
-                } else {
-                    for (idx = 0; idx < numAlphaColors; idx++) {
-                        if (alphaColors[idx] == col) {
-                            match = true;
-                            break;
-                        }
-                    }
-
-                    if (!match) {
-                        if (numAlphaColors < 256) {
-                            alphaColors[numAlphaColors] = col;
-                        }
-                        numAlphaColors++;
-                    }
-
-                    // Write the palette index for the pixel to outRows optimistically.
-                    // We might overwrite it later if we decide to encode as gray or
-                    // gray + alpha.
-                    *out++ = idx;
-                }
-
-                if (numOpaqueColors + numAlphaColors > 256) {
-                    if (kIsDebug) {
-                        printf("Found 257th color at %d, %d\n", i, j);
-                    }
-                    isPalette = false;
+                    printf("Found 257th color at %d, %d\n", i, j);
                 }
+                isPalette = false;
             }
         }
     }
 
+    const int maxGrayDeviation = stats.maxGrayDeviation;
+    const bool isOpaque = stats.isOpaque;
+    const bool isGrayscale = maxGrayDeviation == 0;
+
     // If we decide to encode the image using a palette, we will reset these counts
     // to the appropriate values later.  Initializing them here avoids compiler
     // complaints about uses of possibly uninitialized variables.
@@ -1418,6 +1523,9 @@ status_t preProcessImage(const Bundle* bundle, const sp<AaptAssets>& /* assets *
         goto bail;
     }
 
+    // libpng writes in small pieces and the result goes straight into the
+    // package, so collect it in chunks rather than one growing buffer.
+    file->setChunked(true);
     png_set_write_fn(write_ptr, (void*)file.get(),
                      png_write_aapt_file, png_flush_aapt_file);
 
@@ -37,6 +37,108 @@ void convertPath(char *path) {
   }
 }
 
+/*
+ * Parse a --compression-rule argument, either ".ext=LEVEL" or ">SIZE=LEVEL".
+ * Returns false if the rule is malformed.
+ */
+static bool parseCompressionRule(const char* arg, CompressionRule* rule)
+{
+    const char* eq = strrchr(arg, '=');
+    if (eq == NULL || eq == arg || eq[1] == '\0') {
+        return false;
+    }
+
+    char* end;
+    long level = strtol(eq + 1, &end, 10);
+    if (*end != '\0' || level < 0 || level > 9) {
+        return false;
+    }
+    rule->level = (int) level;
+
+    if (arg[0] == '>') {
+        if (eq == arg + 1) {
+            return false;
+        }
+        long minSize = strtol(arg + 1, &end, 10);
+        if (end != eq || minSize < 0) {
+            return false;
+        }
+        rule->minSize = minSize;
+    } else if (arg[0] == '.') {
+        rule->extension.setTo(arg, eq - arg);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Parse a --fields argument: a comma-separated list of "dump badging"
+ * output groups.  Returns false if a name isn't recognized.
+ */
+static bool parseBadgingFields(const char* arg, uint32_t* fields)
+{
+    static const struct {
+        const char* name;
+        uint32_t field;
+    } kFields[] = {
+        { "package", BADGING_PACKAGE },
+        { "sdk", BADGING_SDK },
+        { "label", BADGING_LABEL },
+        { "icon", BADGING_ICON },
+        { "application", BADGING_APPLICATION },
+        { "permissions", BADGING_PERMISSIONS },
+        { "features", BADGING_FEATURES },
+        { "components", BADGING_COMPONENTS },
+        { "libraries", BADGING_LIBRARIES },
+        { "meta-data", BADGING_META_DATA },
+        { "screens", BADGING_SCREENS },
+        { "locales", BADGING_LOCALES },
+        { "densities", BADGING_DENSITIES },
+        { "native-code", BADGING_NATIVE_CODE },
+        { "other", BADGING_OTHER },
+        { "all", BADGING_ALL },
+    };
+
+    *fields = 0;
+    while (*arg != '\0') {
+        const char* end = strchr(arg, ',');
+        size_t len = end != NULL ? (size_t) (end - arg) : strlen(arg);
+        size_t i;
+        for (i = 0; i < sizeof(kFields) / sizeof(kFields[0]); i++) {
+            if (strlen(kFields[i].name) == len && strncmp(kFields[i].name, arg, len) == 0) {
+                *fields |= kFields[i].field;
+                break;
+            }
+        }
+        if (i == sizeof(kFields) / sizeof(kFields[0])) {
+            return false;
+        }
+        arg += len;
+        if (*arg == ',') {
+            arg++;
+        }
+    }
+    return *fields != 0;
+}
+
+/*
+ * Parse a --format argument for "dump".
+ */
+static bool parseDumpFormat(const char* arg, DumpFormat* format)
+{
+    if (strcmp(arg, "text") == 0) {
+        *format = kDumpFormatText;
+    } else if (strcmp(arg, "json") == 0) {
+        *format = kDumpFormatJson;
+    } else if (strcmp(arg, "binary") == 0) {
+        *format = kDumpFormatBinary;
+    } else {
+        return false;
+    }
+    return true;
+}
+
 /*
  * Print usage info.
  */
@@ -48,7 +150,9 @@ void usage(void)
         " %s l[ist] [-v] [-a] file.{zip,jar,apk}\n"
         "   List contents of Zip-compatible archive.\n\n", gProgName);
     fprintf(stderr,
-        " %s d[ump] [--values] [--include-meta-data] WHAT file.{apk} [asset [asset ...]]\n"
+        " %s d[ump] [--values] [--include-meta-data] [--fields FIELD,...] \\\n"
+        "        [--format text|json|binary] [--no-cache] [--rebuild-cache] \\\n"
+        "        WHAT file.{apk} [asset [asset ...]]\n"
         "   strings          Print the contents of the resource table string pool in the APK.\n"
         "   badging          Print the label and icon for the app declared in APK.\n"
         "   permissions      Print the permissions from the APK.\n"
@@ -65,6 +169,8 @@ void usage(void)
         "        [--rename-instrumentation-target-package PACKAGE] \\\n"
         "        [--utf16] [--auto-add-overlay] \\\n"
         "        [--max-res-version VAL] \\\n"
+        "        [--compression-level LEVEL] [--compression-rule RULE ...] \\\n"
+        "        [--max-fragmentation RATIO] [--resource-id-cache-size N] \\\n"
         "        [-I base-package [-I base-package ...]] \\\n"
         "        [-A asset-source-dir]  [-G class-list-file] [-P public-definitions-file] \\\n"
         "        [-D main-dex-class-list-file] \\\n"
@@ -95,6 +201,10 @@ void usage(void)
     fprintf(stderr,
         " %s s[ingleCrunch] [-v] -i input-file -o outputfile\n"
         "   Do PNG preprocessing on a single file.\n\n", gProgName);
+    fprintf(stderr,
+        " %s m[Daemon]\n"
+        "   Read crunch, package and dump requests from stdin, keeping included\n"
+        "   packages (-I) loaded between requests.\n\n", gProgName);
     fprintf(stderr,
         " %s v[ersion]\n"
         "   Print program version.\n\n", gProgName);
@@ -115,7 +225,8 @@ void usage(void)
         "   -k  junk path of file(s) added\n"
         "   -m  make package directories under location specified by -J\n"
         "   -u  update existing packages (add new, replace older, remove deleted files)\n"
-        "   -v  verbose output\n"
+        "   -v  verbose output; with \"dump\", reports on stderr whether resources.arsc\n"
+        "       could be mapped or had to be copied, and the peak memory used\n"
         "   -x  create extending (non-application) resource IDs\n"
         "   -z  require localization of resource attributes marked with\n"
         "       localization=\"suggested\"\n"
@@ -137,6 +248,24 @@ void usage(void)
         "       manifest, making the application debuggable even on production devices.\n"
         "   --include-meta-data\n"
         "       when used with \"dump badging\" also includes meta-data tags.\n"
+        "   --fields\n"
+        "       when used with \"dump badging\", prints only the given groups of lines,\n"
+        "       and skips the work needed for the others.  Groups are package, sdk,\n"
+        "       label, icon, application, permissions, features, components,\n"
+        "       libraries, meta-data, screens, locales, densities, native-code, other\n"
+        "       and all.  Default is all.\n"
+        "   --format\n"
+        "       when used with \"dump\" badging, permissions, resources, strings or\n"
+        "       xmltree, selects the output format: text (the default), json, with one\n"
+        "       object per line, or binary, with length-prefixed records.\n"
+        "   --no-cache\n"
+        "       when used with \"dump badging\", neither reads nor updates the result\n"
+        "       cache.  \"dump badging\" otherwise remembers its output for each APK in\n"
+        "       $AAPT_RESULT_CACHE, or aapt/results under the user's cache directory,\n"
+        "       and reuses it while the APK is unchanged.\n"
+        "   --rebuild-cache\n"
+        "       when used with \"dump badging\", ignores the result cache's contents and\n"
+        "       writes it out again.\n"
         "   --pseudo-localize\n"
         "       generate resources for pseudo-locales (en-XA and ar-XB).\n"
         "   --min-sdk-version\n"
@@ -223,6 +352,26 @@ void usage(void)
         "       localization\n"
         "   --no-version-vectors\n"
         "       Do not automatically generate versioned copies of vector XML resources.\n"
+        "   --jobs\n"
+        "       Number of threads used to crunch images and to compress files while\n"
+        "       writing the APK.  The output is the same whatever the value.  Default\n"
+        "       is 1.\n"
+        "   --compression-level\n"
+        "       zlib level (0-9) used for compressed files in the APK.  0 stores every\n"
+        "       file; 1 is fastest.  Default is 9.\n"
+        "   --compression-rule\n"
+        "       Overrides the compression level for some files.  RULE is either\n"
+        "       .ext=LEVEL, for files ending in .ext, or >SIZE=LEVEL, for files larger\n"
+        "       than SIZE bytes.  May be repeated; the first matching rule wins.\n"
+        "       Files that are never compressed (see -0) are not affected.\n"
+        "   --max-fragmentation\n"
+        "       With -u, replaced and removed files leave free space in the APK that\n"
+        "       later files reuse, instead of the rest of the APK being shifted down.\n"
+        "       Once free space exceeds RATIO of the APK, it is rewritten compactly.\n"
+        "       0 always compacts.  Default is 0.25.\n"
+        "   --resource-id-cache-size\n"
+        "       Number of resource name to ID lookups to remember while compiling.\n"
+        "       0 turns the cache off.  Default is 32768.\n"
         "   --private-symbols\n"
         "       Java package name to use when generating R.java for private resources.\n",
         gDefaultIgnoreAssets);
@@ -255,16 +404,21 @@ int handleCommand(Bundle* bundle)
 }
 
 /*
- * Parse args.
+ * Parse args and run the requested command.  This is the whole of main(),
+ * split out so that the daemon mode can run full command lines against the
+ * resources it already has loaded.
  */
-int main(int argc, char* const argv[])
+int runCommandLine(int argc, char* const argv[])
 {
-    char *prog = argv[0];
+    const char *prog = argv[0];
     Bundle bundle;
     bool wantUsage = false;
     int result = 1;    // pessimistically assume an error.
     int tolerance = 0;
 
+    /* may still point into a previous daemon request's arguments */
+    gUserIgnoreAssets = NULL;
+
     /* default to compression */
     bundle.setCompressionMethod(ZipEntry::kCompressDeflated);
 
@@ -579,6 +733,52 @@ int main(int argc, char* const argv[])
                     bundle.setValues(true);
                 } else if (strcmp(cp, "-include-meta-data") == 0) {
                     bundle.setIncludeMetaData(true);
+                } else if (strcmp(cp, "-fields") == 0 || strncmp(cp, "-fields=", 8) == 0) {
+                    const char* list = cp + 7;
+                    if (*list == '=') {
+                        list++;
+                    } else {
+                        argc--;
+                        argv++;
+                        if (!argc) {
+                            fprintf(stderr, "ERROR: No argument supplied for '--fields' option\n");
+                            wantUsage = true;
+                            goto bail;
+                        }
+                        list = argv[0];
+                    }
+                    uint32_t fields;
+                    if (!parseBadgingFields(list, &fields)) {
+                        fprintf(stderr, "ERROR: Invalid badging fields '%s'\n", list);
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    bundle.setBadgingFields(fields);
+                } else if (strcmp(cp, "-format") == 0 || strncmp(cp, "-format=", 8) == 0) {
+                    const char* name = cp + 7;
+                    if (*name == '=') {
+                        name++;
+                    } else {
+                        argc--;
+                        argv++;
+                        if (!argc) {
+                            fprintf(stderr, "ERROR: No argument supplied for '--format' option\n");
+                            wantUsage = true;
+                            goto bail;
+                        }
+                        name = argv[0];
+                    }
+                    DumpFormat format;
+                    if (!parseDumpFormat(name, &format)) {
+                        fprintf(stderr, "ERROR: Unknown dump format '%s'\n", name);
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    bundle.setDumpFormat(format);
+                } else if (strcmp(cp, "-no-cache") == 0) {
+                    bundle.setUseResultCache(false);
+                } else if (strcmp(cp, "-rebuild-cache") == 0) {
+                    bundle.setRebuildResultCache(true);
                 } else if (strcmp(cp, "-custom-package") == 0) {
                     argc--;
                     argv++;
@@ -704,6 +904,83 @@ int main(int argc, char* const argv[])
                     bundle.setPseudolocalize(PSEUDO_ACCENTED | PSEUDO_BIDI);
                 } else if (strcmp(cp, "-no-version-vectors") == 0) {
                     bundle.setNoVersionVectors(true);
+                } else if (strcmp(cp, "-jobs") == 0) {
+                    argc--;
+                    argv++;
+                    if (!argc) {
+                        fprintf(stderr, "ERROR: No argument supplied for '--jobs' option\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    if (atoi(argv[0]) < 1) {
+                        fprintf(stderr, "ERROR: '--jobs' needs a positive number\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    bundle.setJobs(atoi(argv[0]));
+                } else if (strcmp(cp, "-compression-level") == 0) {
+                    argc--;
+                    argv++;
+                    if (!argc) {
+                        fprintf(stderr, "ERROR: No argument supplied for '--compression-level' option\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    char* end;
+                    long level = strtol(argv[0], &end, 10);
+                    if (*argv[0] == '\0' || *end != '\0' || level < 0 || level > 9) {
+                        fprintf(stderr, "ERROR: '--compression-level' needs a number from 0 to 9\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    bundle.setCompressionLevel((int) level);
+                } else if (strcmp(cp, "-compression-rule") == 0) {
+                    argc--;
+                    argv++;
+                    if (!argc) {
+                        fprintf(stderr, "ERROR: No argument supplied for '--compression-rule' option\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    CompressionRule rule;
+                    if (!parseCompressionRule(argv[0], &rule)) {
+                        fprintf(stderr, "ERROR: Invalid compression rule '%s'\n", argv[0]);
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    bundle.addCompressionRule(rule);
+                } else if (strcmp(cp, "-max-fragmentation") == 0) {
+                    argc--;
+                    argv++;
+                    if (!argc) {
+                        fprintf(stderr, "ERROR: No argument supplied for '--max-fragmentation' option\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    char* end;
+                    double ratio = strtod(argv[0], &end);
+                    if (*argv[0] == '\0' || *end != '\0' || ratio < 0) {
+                        fprintf(stderr, "ERROR: '--max-fragmentation' needs a non-negative number\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    bundle.setMaxFragmentation(ratio);
+                } else if (strcmp(cp, "-resource-id-cache-size") == 0) {
+                    argc--;
+                    argv++;
+                    if (!argc) {
+                        fprintf(stderr, "ERROR: No argument supplied for '--resource-id-cache-size' option\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    char* end;
+                    long size = strtol(argv[0], &end, 10);
+                    if (*argv[0] == '\0' || *end != '\0' || size < 0) {
+                        fprintf(stderr, "ERROR: '--resource-id-cache-size' needs a non-negative number\n");
+                        wantUsage = true;
+                        goto bail;
+                    }
+                    bundle.setResourceIdCacheSize(size);
                 } else if (strcmp(cp, "-private-symbols") == 0) {
                     argc--;
                     argv++;
@@ -749,3 +1026,8 @@ bail:
     //printf("--> returning %d\n", result);
     return result;
 }
+
+int main(int argc, char* const argv[])
+{
+    return runCommandLine(argc, argv);
+}
@@ -38,6 +38,8 @@ extern int doCrunch(Bundle* bundle);
 extern int doSingleCrunch(Bundle* bundle);
 extern int runInDaemonMode(Bundle* bundle);
 
+extern int runCommandLine(int argc, char* const argv[]);
+
 extern int calcPercent(long uncompressedLen, long compressedLen);
 
 extern android::status_t writeAPK(Bundle* bundle,
@@ -8,6 +8,7 @@
 #include "OutputSet.h"
 #include "ResourceTable.h"
 #include "ResourceFilter.h"
+#include "WorkStealingPool.h"
 
 #include <androidfw/misc.h>
 
@@ -21,6 +22,7 @@
 #include <dirent.h>
 #include <ctype.h>
 #include <errno.h>
+#include <sys/stat.h>
 
 using namespace android;
 
@@ -38,7 +40,15 @@ static const char* kNoCompressExt[] = {
 
 /* fwd decls, so I can write this downward */
 ssize_t processAssets(Bundle* bundle, ZipFile* zip, const sp<const OutputSet>& outputSet);
-bool processFile(Bundle* bundle, ZipFile* zip, String8 storageName, const sp<const AaptFile>& file);
+ssize_t processAssetsInParallel(Bundle* bundle, ZipFile* zip,
+        const sp<const OutputSet>& outputSet);
+bool processFile(Bundle* bundle, ZipFile* zip, String8 storageName, const sp<const AaptFile>& file,
+        const ZipFile::PreparedEntry* prepared = NULL);
+bool isExcludedFile(const String8& storageName);
+int getCompressionMethod(Bundle* bundle, const String8& storageName,
+        const sp<const AaptFile>& file, int* pLevel);
+int getCompressionLevel(Bundle* bundle, const String8& storageName,
+        const sp<const AaptFile>& file);
 bool okayToCompress(Bundle* bundle, const String8& pathName);
 ssize_t processJarFiles(Bundle* bundle, ZipFile* zip);
 
@@ -104,6 +114,10 @@ status_t writeAPK(Bundle* bundle, const String8& outputFile, const sp<OutputSet>
                 outputFile.string());
         goto bail;
     }
+    if (bundle->getUpdate()) {
+        // Replace changed files in place rather than shifting the whole archive.
+        zip->setIncremental(bundle->getMaxFragmentation());
+    }
 
     if (bundle->getVerbose()) {
         printf("Writing all files...\n");
@@ -217,6 +231,10 @@ bail:
 
 ssize_t processAssets(Bundle* bundle, ZipFile* zip, const sp<const OutputSet>& outputSet)
 {
+    if (bundle->getJobs() != 1) {
+        return processAssetsInParallel(bundle, zip, outputSet);
+    }
+
     ssize_t count = 0;
     const std::set<OutputEntry>& entries = outputSet->getEntries();
     std::set<OutputEntry>::const_iterator iter = entries.begin();
@@ -236,6 +254,150 @@ ssize_t processAssets(Bundle* bundle, ZipFile* zip, const sp<const OutputSet>& o
     return count;
 }
 
+/*
+ * One output file on its way into the archive.  The data is read and
+ * compressed by a PrepareAssetWorkUnit while earlier files are still
+ * being written.
+ */
+struct PendingAsset {
+    PendingAsset() : prepared(NULL), done(false) {}
+    ~PendingAsset() { delete prepared; }
+
+    String8 storagePath;
+    sp<const AaptFile> file;
+    ZipFile::PreparedEntry* prepared;   // NULL if processFile() does it all
+    bool done;
+};
+
+class PrepareAssetWorkUnit : public WorkQueue::WorkUnit {
+public:
+    PrepareAssetWorkUnit(PendingAsset* asset, int compressionMethod,
+            int compressionLevel, Mutex* lock, Condition* doneCondition) :
+            mAsset(asset), mCompressionMethod(compressionMethod),
+            mCompressionLevel(compressionLevel),
+            mLock(lock), mDoneCondition(doneCondition) {
+    }
+
+    virtual bool run() {
+        const sp<const AaptFile>& file = mAsset->file;
+        if (file->hasData()) {
+            Vector<ZipFile::DataChunk> chunks;
+            file->getChunks(&chunks);
+            ZipFile::prepare(NULL, chunks.array(), chunks.size(),
+                    mCompressionMethod, mCompressionLevel, mAsset->prepared);
+        } else {
+            ZipFile::prepare(file->getSourceFile().string(), NULL, 0,
+                    mCompressionMethod, mCompressionLevel, mAsset->prepared);
+        }
+
+        AutoMutex _l(*mLock);
+        mAsset->done = true;
+        mDoneCondition->broadcast();
+        return true;
+    }
+
+private:
+    PendingAsset* mAsset;
+    int mCompressionMethod;
+    int mCompressionLevel;
+    Mutex* mLock;
+    Condition* mDoneCondition;
+};
+
+/*
+ * Same as processAssets(), but files are compressed on bundle->getJobs()
+ * threads (one per CPU by default).  This thread stays the only writer
+ * and adds the entries in the same order, so the archive is identical to
+ * one written serially.
+ */
+ssize_t processAssetsInParallel(Bundle* bundle, ZipFile* zip,
+        const sp<const OutputSet>& outputSet)
+{
+    const std::set<OutputEntry>& entries = outputSet->getEntries();
+    const size_t N = entries.size();
+
+    // Work units point into these; freed only once the pool has drained.
+    PendingAsset* assets = new PendingAsset[N];
+    Mutex lock;
+    Condition doneCondition;
+
+    size_t i = 0;
+    std::set<OutputEntry>::const_iterator iter = entries.begin();
+    for (; iter != entries.end(); iter++, i++) {
+        assets[i].file = iter->getFile();
+        if (assets[i].file != NULL) {
+            assets[i].storagePath = iter->getPath();
+            assets[i].storagePath.convertToResPath();
+        }
+    }
+
+    ssize_t count = 0;
+    {
+        WorkStealingPool wq(bundle->getJobs());
+        // Only this many files are held in memory, compressed, at a time.
+        const size_t window = wq.getThreadCount() * 4;
+        size_t next = 0;
+        for (i = 0; i < N; i++) {
+            // Keep the workers busy ahead of the file we're writing.
+            for (; next < N && next < i + window; next++) {
+                PendingAsset& asset = assets[next];
+                if (asset.file == NULL || isExcludedFile(asset.storagePath)
+                        || strcasecmp(asset.storagePath.getPathExtension().string(), ".gz") == 0) {
+                    asset.done = true;
+                    continue;
+                }
+
+                int level;
+                int method = getCompressionMethod(bundle, asset.storagePath, asset.file,
+                        &level);
+                asset.prepared = new ZipFile::PreparedEntry();
+                PrepareAssetWorkUnit* w = new PrepareAssetWorkUnit(&asset, method, level,
+                        &lock, &doneCondition);
+                if (wq.schedule(w, 0) != NO_ERROR) {
+                    // Let processFile() handle it on this thread instead.
+                    delete w;
+                    delete asset.prepared;
+                    asset.prepared = NULL;
+                    asset.done = true;
+                }
+            }
+
+            PendingAsset& asset = assets[i];
+            for (;;) {
+                {
+                    AutoMutex _l(lock);
+                    if (asset.done) {
+                        break;
+                    }
+                }
+                // Rather than just wait, compress something ourselves.
+                if (!wq.runOne()) {
+                    AutoMutex _l(lock);
+                    while (!asset.done) {
+                        doneCondition.wait(lock);
+                    }
+                }
+            }
+
+            if (asset.file == NULL) {
+                fprintf(stderr, "warning: null file being processed.\n");
+                continue;
+            }
+            if (!processFile(bundle, zip, asset.storagePath, asset.file, asset.prepared)) {
+                count = UNKNOWN_ERROR;
+                wq.cancel();
+                break;
+            }
+            delete asset.prepared;
+            asset.prepared = NULL;
+            count++;
+        }
+    } // waits for the pool to drain
+
+    delete[] assets;
+    return count;
+}
+
 /*
  * Process a regular file, adding it to the archive if appropriate.
  *
@@ -243,7 +405,8 @@ ssize_t processAssets(Bundle* bundle, ZipFile* zip, const sp<const OutputSet>& o
  * delete the existing entry before adding the new one.
  */
 bool processFile(Bundle* bundle, ZipFile* zip,
-                 String8 storageName, const sp<const AaptFile>& file)
+                 String8 storageName, const sp<const AaptFile>& file,
+                 const ZipFile::PreparedEntry* prepared)
 {
     const bool hasData = file->hasData();
 
@@ -251,24 +414,7 @@ bool processFile(Bundle* bundle, ZipFile* zip,
     bool fromGzip = false;
     status_t result;
 
-    /*
-     * See if the filename ends in ".EXCLUDE".  We can't use
-     * String8::getPathExtension() because the length of what it considers
-     * to be an extension is capped.
-     *
-     * The Asset Manager doesn't check for ".EXCLUDE" in Zip archives,
-     * so there's no value in adding them (and it makes life easier on
-     * the AssetManager lib if we don't).
-     *
-     * NOTE: this restriction has been removed.  If you're in this code, you
-     * should clean this up, but I'm in here getting rid of Path Name, and I
-     * don't want to make other potentially breaking changes --joeo
-     */
-    int fileNameLen = storageName.length();
-    int excludeExtensionLen = strlen(kExcludeExtension);
-    if (fileNameLen > excludeExtensionLen
-            && (0 == strcmp(storageName.string() + (fileNameLen - excludeExtensionLen),
-                            kExcludeExtension))) {
+    if (isExcludedFile(storageName)) {
         fprintf(stderr, "warning: '%s' not added to Zip\n", storageName.string());
         return true;
     }
@@ -322,17 +468,21 @@ bool processFile(Bundle* bundle, ZipFile* zip,
 
     if (fromGzip) {
         result = zip->addGzip(file->getSourceFile().string(), storageName.string(), &entry);
-    } else if (!hasData) {
-        /* don't compress certain files, e.g. PNGs */
-        int compressionMethod = bundle->getCompressionMethod();
-        if (!okayToCompress(bundle, storageName)) {
-            compressionMethod = ZipEntry::kCompressStored;
-        }
-        result = zip->add(file->getSourceFile().string(), storageName.string(), compressionMethod,
-                            &entry);
+    } else if (prepared != NULL) {
+        result = zip->addPrepared(*prepared, storageName.string(), &entry);
     } else {
-        result = zip->add(file->getData(), file->getSize(), storageName.string(),
-                           file->getCompressionMethod(), &entry);
+        int level;
+        int method = getCompressionMethod(bundle, storageName, file, &level);
+        zip->setCompressionLevel(level);
+        if (!hasData) {
+            result = zip->add(file->getSourceFile().string(), storageName.string(),
+                                method, &entry);
+        } else {
+            Vector<ZipFile::DataChunk> chunks;
+            file->getChunks(&chunks);
+            result = zip->add(chunks.array(), chunks.size(), storageName.string(),
+                               method, &entry);
+        }
     }
     if (result == NO_ERROR) {
         if (bundle->getVerbose()) {
@@ -359,6 +509,97 @@ bool processFile(Bundle* bundle, ZipFile* zip,
     return true;
 }
 
+/*
+ * See if the filename ends in ".EXCLUDE".  We can't use
+ * String8::getPathExtension() because the length of what it considers
+ * to be an extension is capped.
+ *
+ * The Asset Manager doesn't check for ".EXCLUDE" in Zip archives,
+ * so there's no value in adding them (and it makes life easier on
+ * the AssetManager lib if we don't).
+ *
+ * NOTE: this restriction has been removed.  If you're in this code, you
+ * should clean this up, but I'm in here getting rid of Path Name, and I
+ * don't want to make other potentially breaking changes --joeo
+ */
+bool isExcludedFile(const String8& storageName)
+{
+    int fileNameLen = storageName.length();
+    int excludeExtensionLen = strlen(kExcludeExtension);
+    return fileNameLen > excludeExtensionLen
+            && (0 == strcmp(storageName.string() + (fileNameLen - excludeExtensionLen),
+                            kExcludeExtension));
+}
+
+/*
+ * Pick the compression method for a file that isn't already gzipped.
+ * Generated files carry their own; files on disk use the bundle's,
+ * except for types that don't compress, e.g. PNGs.  "*pLevel" gets the
+ * zlib level to deflate with; a level of 0 means the file is stored.
+ */
+int getCompressionMethod(Bundle* bundle, const String8& storageName,
+        const sp<const AaptFile>& file, int* pLevel)
+{
+    int method;
+    if (file->hasData()) {
+        method = file->getCompressionMethod();
+    } else if (!okayToCompress(bundle, storageName)) {
+        method = ZipEntry::kCompressStored;
+    } else {
+        method = bundle->getCompressionMethod();
+    }
+
+    *pLevel = ZipFile::kDefaultCompressionLevel;
+    if (method == ZipEntry::kCompressDeflated) {
+        *pLevel = getCompressionLevel(bundle, storageName, file);
+        if (*pLevel == 0) {
+            method = ZipEntry::kCompressStored;
+        }
+    }
+    return method;
+}
+
+/*
+ * Look up the zlib level for a file in the --compression-rule table.
+ * The first rule that matches wins; files no rule matches get the
+ * --compression-level value.
+ */
+int getCompressionLevel(Bundle* bundle, const String8& storageName,
+        const sp<const AaptFile>& file)
+{
+    const Vector<CompressionRule>& rules = bundle->getCompressionRules();
+    const size_t N = rules.size();
+    off_t fileSize = -1;
+    for (size_t i = 0; i < N; i++) {
+        const CompressionRule& rule = rules[i];
+        if (rule.extension.length() > 0) {
+            const size_t nameLen = storageName.length();
+            const size_t extLen = rule.extension.length();
+            if (nameLen >= extLen && strcasecmp(storageName.string() + nameLen - extLen,
+                    rule.extension.string()) == 0) {
+                return rule.level;
+            }
+            continue;
+        }
+
+        if (fileSize < 0) {
+            if (file->hasData()) {
+                fileSize = file->getSize();
+            } else {
+                struct stat st;
+                if (stat(file->getSourceFile().string(), &st) != 0) {
+                    continue;
+                }
+                fileSize = st.st_size;
+            }
+        }
+        if (fileSize > rule.minSize) {
+            return rule.level;
+        }
+    }
+    return bundle->getCompressionLevel();
+}
+
 /*
  * Determine whether or not we want to try to compress this file based
  * on the file extension.
@@ -408,16 +649,15 @@ ssize_t processJarFile(ZipFile* jar, ZipFile* out)
         ZipEntry* entry = jar->getEntryByIndex(i);
         const char* storageName = entry->getFileName();
         if (endsWith(storageName, ".class")) {
-            int compressionMethod = entry->getCompressionMethod();
-            size_t size = entry->getUncompressedLen();
-            const void* data = jar->uncompress(entry);
-            if (data == NULL) {
-                fprintf(stderr, "ERROR: unable to uncompress entry '%s'\n",
+            // Copy the compressed data as it is; there's no point
+            // recompressing it.  The headers are rebuilt, so the jar's
+            // timestamps and extra fields don't end up in the APK.
+            if (out->getEntryByName(storageName) == NULL &&
+                    out->addNormalized(jar, entry, NULL) != NO_ERROR) {
+                fprintf(stderr, "ERROR: unable to copy entry '%s'\n",
                     storageName);
                 return -1;
             }
-            out->add(data, size, storageName, compressionMethod, NULL);
-            free((void*)data);
         }
         count++;
     }
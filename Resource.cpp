@@ -15,7 +15,7 @@
 #include "ResourceTable.h"
 #include "StringPool.h"
 #include "Symbol.h"
-#include "WorkQueue.h"
+#include "WorkStealingPool.h"
 #include "XMLNode.h"
 
 #include <algorithm>
@@ -35,9 +35,6 @@
 // Set to true for noisy debug output.
 static const bool kIsDebug = false;
 
-// Number of threads to use for preprocessing images.
-static const size_t MAX_THREADS = 4;
-
 // ==========================================================================
 // ==========================================================================
 // ==========================================================================
@@ -371,7 +368,7 @@ static status_t preProcessImages(const Bundle* bundle, const sp<AaptAssets>& ass
     volatile bool hasErrors = false;
     ssize_t res = NO_ERROR;
     if (bundle->getUseCrunchCache() == false) {
-        WorkQueue wq(MAX_THREADS, false);
+        WorkStealingPool wq(bundle->getJobs());
         ResourceDirIterator it(set, String8(type));
         while ((res=it.next()) == NO_ERROR) {
             PreProcessImageWorkUnit* w = new PreProcessImageWorkUnit(
@@ -594,6 +591,213 @@ static void checkForIds(const String8& path, ResXMLParser& parser)
     }
 }
 
+/*
+ * An XML resource file waiting to be compiled by compileXmlFiles().
+ */
+struct XmlCompileItem {
+    XmlCompileItem() : options(0), checkIds(false), hasErrors(false), status(NO_ERROR) {}
+
+    String16 resourceName;
+    sp<AaptFile> file;
+    sp<XMLNode> root;           // parsed from "file" if NULL
+    String8 resPath;            // for generated files, where they go in the APK
+    int options;
+    bool checkIds;              // warn about plain 'id' attributes
+    bool hasErrors;             // attribute IDs could not be assigned
+    status_t status;
+};
+
+/*
+ * One of the stages of compileXmlFiles() that may run on many files at
+ * once.  run() hands every item that hasn't failed yet to the pool, and
+ * returns when they are all done.
+ */
+class XmlCompileStage {
+public:
+    enum Step {
+        PARSE,
+        ASSIGN_IDS,
+        FLATTEN
+    };
+
+    XmlCompileStage(Step step, const sp<AaptAssets>& assets, const ResourceTable* table) :
+            mStep(step), mAssets(assets), mTable(table), mRemaining(0) {
+    }
+
+    void run(WorkStealingPool* pool, XmlCompileItem* items, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            if (items[i].status == NO_ERROR) {
+                mRemaining++;
+            }
+        }
+        for (size_t i = 0; i < count; i++) {
+            if (items[i].status != NO_ERROR) {
+                continue;
+            }
+            StageWorkUnit* w = new StageWorkUnit(this, &items[i]);
+            if (pool->schedule(w, 0) != OK) {
+                delete w;
+                runItem(&items[i]);
+                itemDone();
+            }
+        }
+
+        // Help with the work, then wait for whatever the workers still hold.
+        while (pool->runOne()) {
+        }
+        AutoMutex _l(mLock);
+        while (mRemaining > 0) {
+            mCondition.wait(mLock);
+        }
+    }
+
+private:
+    class StageWorkUnit : public WorkQueue::WorkUnit {
+    public:
+        StageWorkUnit(XmlCompileStage* stage, XmlCompileItem* item) :
+                mStage(stage), mItem(item) {
+        }
+
+        virtual bool run() {
+            mStage->runItem(mItem);
+            mStage->itemDone();
+            return true; // continue even if there are errors
+        }
+
+    private:
+        XmlCompileStage* mStage;
+        XmlCompileItem* mItem;
+    };
+
+    void runItem(XmlCompileItem* item) {
+        switch (mStep) {
+        case PARSE:
+            if (item->root == NULL) {
+                item->root = XMLNode::parse(item->file);
+                if (item->root == NULL) {
+                    item->status = UNKNOWN_ERROR;
+                }
+            }
+            break;
+        case ASSIGN_IDS:
+            if (assignXmlResourceIds(mAssets, item->root, mTable, item->options) != NO_ERROR) {
+                item->hasErrors = true;
+            }
+            break;
+        case FLATTEN:
+            item->status = flattenXmlTree(item->root, item->file, item->options);
+            break;
+        }
+    }
+
+    void itemDone() {
+        AutoMutex _l(mLock);
+        if (--mRemaining == 0) {
+            mCondition.broadcast();
+        }
+    }
+
+    const Step mStep;
+    const sp<AaptAssets> mAssets;
+    const ResourceTable* mTable;
+
+    Mutex mLock;
+    Condition mCondition;
+    size_t mRemaining;
+};
+
+/*
+ * Adds every file in "set", which may be NULL, to "items".  Sets
+ * "*hasErrors" if a file name is malformed.
+ */
+static void collectXmlFiles(const sp<ResourceTypeSet>& set, const char* resType,
+        int options, bool checkIds, Vector<XmlCompileItem>* items, bool* hasErrors)
+{
+    if (set == NULL) {
+        return;
+    }
+
+    ResourceDirIterator it(set, String8(resType));
+    ssize_t err;
+    while ((err=it.next()) == NO_ERROR) {
+        XmlCompileItem item;
+        item.resourceName = String16(it.getBaseName());
+        item.file = it.getFile();
+        item.options = options;
+        item.checkIds = checkIds;
+        items->add(item);
+    }
+    if (err < NO_ERROR) {
+        *hasErrors = true;
+    }
+}
+
+/*
+ * Compiles "items" with the same results as calling compileXmlFile() on
+ * each in turn, leaving each one's result in its "status".
+ *
+ * Only the stages that add to the table or its string pools have to run
+ * one file at a time, and they run in the order of "items" so resource
+ * IDs don't depend on the thread timing.  Parsing, assigning attribute IDs
+ * and flattening run on bundle->getJobs() threads.  Returns true if any
+ * file failed.
+ */
+static bool compileXmlFiles(const Bundle* bundle, const sp<AaptAssets>& assets,
+        ResourceTable* table, Vector<XmlCompileItem>& items)
+{
+    const size_t N = items.size();
+    XmlCompileItem* const array = items.editArray();
+
+    if (bundle->getJobs() == 1 || N < 2) {
+        for (size_t i = 0; i < N; i++) {
+            XmlCompileItem& item = array[i];
+            if (item.root != NULL) {
+                item.status = compileXmlFile(bundle, assets, item.resourceName, item.root,
+                        item.file, table, item.options);
+            } else {
+                item.status = compileXmlFile(bundle, assets, item.resourceName,
+                        item.file, table, item.options);
+            }
+        }
+    } else {
+        WorkStealingPool wq(bundle->getJobs());
+
+        XmlCompileStage(XmlCompileStage::PARSE, assets, table).run(&wq, array, N);
+        for (size_t i = 0; i < N; i++) {
+            XmlCompileItem& item = array[i];
+            if (item.status == NO_ERROR) {
+                item.status = prepareXmlTree(bundle, item.resourceName, item.root,
+                        item.file, table, item.options);
+            }
+        }
+
+        XmlCompileStage(XmlCompileStage::ASSIGN_IDS, assets, table).run(&wq, array, N);
+        for (size_t i = 0; i < N; i++) {
+            XmlCompileItem& item = array[i];
+            if (item.status == NO_ERROR) {
+                item.status = parseXmlValues(bundle, assets, item.resourceName, item.root,
+                        item.file, table, item.options, item.hasErrors);
+            }
+        }
+
+        XmlCompileStage(XmlCompileStage::FLATTEN, assets, table).run(&wq, array, N);
+        wq.finish();
+    }
+
+    bool hasErrors = false;
+    for (size_t i = 0; i < N; i++) {
+        const XmlCompileItem& item = array[i];
+        if (item.status != NO_ERROR) {
+            hasErrors = true;
+        } else if (item.checkIds) {
+            ResXMLTree block;
+            block.setTo(item.file->getData(), item.file->getSize(), true);
+            checkForIds(item.file->getPrintableSource(), block);
+        }
+    }
+    return hasErrors;
+}
+
 static bool applyFileOverlay(Bundle *bundle,
                              const sp<AaptAssets>& assets,
                              sp<ResourceTypeSet> *baseSet,
@@ -1075,8 +1279,13 @@ status_t updatePreProcessedCache(Bundle* bundle)
     String8 source(bundle->getResourceSourceDirs()[0]);
     String8 dest(bundle->getCrunchedOutputDir());
 
-    FileFinder* ff = new SystemFileFinder();
+    FileFinder* ff = new SystemFileFinder(bundle->getJobs());
     CrunchCache cc(source,dest,ff);
+    cc.setJobs(bundle->getJobs());
+    // Everything about the bundle that changes how write_png() encodes.
+    cc.setOptions(String8::format("grayscaleTolerance=%d jellyBeanMr1=%d",
+            bundle->getGrayscaleTolerance(),
+            bundle->isMinSdkAtLeast(SDK_JELLY_BEAN_MR1) ? 1 : 0));
 
     CacheUpdater* cu = new SystemCacheUpdater(bundle);
     size_t numFiles = cc.crunch(cu);
@@ -1400,105 +1609,17 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets, sp<ApkBuil
     // resources.
     // --------------------------------------------------------------
 
-    if (layouts != NULL) {
-        ResourceDirIterator it(layouts, String8("layout"));
-        while ((err=it.next()) == NO_ERROR) {
-            String8 src = it.getFile()->getPrintableSource();
-            err = compileXmlFile(bundle, assets, String16(it.getBaseName()),
-                    it.getFile(), &table, xmlFlags);
-            if (err == NO_ERROR) {
-                ResXMLTree block;
-                block.setTo(it.getFile()->getData(), it.getFile()->getSize(), true);
-                checkForIds(src, block);
-            } else {
-                hasErrors = true;
-            }
-        }
-
-        if (err < NO_ERROR) {
-            hasErrors = true;
-        }
-        err = NO_ERROR;
-    }
-
-    if (anims != NULL) {
-        ResourceDirIterator it(anims, String8("anim"));
-        while ((err=it.next()) == NO_ERROR) {
-            err = compileXmlFile(bundle, assets, String16(it.getBaseName()),
-                    it.getFile(), &table, xmlFlags);
-            if (err != NO_ERROR) {
-                hasErrors = true;
-            }
-        }
-
-        if (err < NO_ERROR) {
-            hasErrors = true;
-        }
-        err = NO_ERROR;
-    }
-
-    if (animators != NULL) {
-        ResourceDirIterator it(animators, String8("animator"));
-        while ((err=it.next()) == NO_ERROR) {
-            err = compileXmlFile(bundle, assets, String16(it.getBaseName()),
-                    it.getFile(), &table, xmlFlags);
-            if (err != NO_ERROR) {
-                hasErrors = true;
-            }
-        }
-
-        if (err < NO_ERROR) {
-            hasErrors = true;
-        }
-        err = NO_ERROR;
-    }
-
-    if (interpolators != NULL) {
-        ResourceDirIterator it(interpolators, String8("interpolator"));
-        while ((err=it.next()) == NO_ERROR) {
-            err = compileXmlFile(bundle, assets, String16(it.getBaseName()),
-                    it.getFile(), &table, xmlFlags);
-            if (err != NO_ERROR) {
-                hasErrors = true;
-            }
-        }
-
-        if (err < NO_ERROR) {
-            hasErrors = true;
-        }
-        err = NO_ERROR;
-    }
-
-    if (transitions != NULL) {
-        ResourceDirIterator it(transitions, String8("transition"));
-        while ((err=it.next()) == NO_ERROR) {
-            err = compileXmlFile(bundle, assets, String16(it.getBaseName()),
-                    it.getFile(), &table, xmlFlags);
-            if (err != NO_ERROR) {
-                hasErrors = true;
-            }
-        }
-
-        if (err < NO_ERROR) {
-            hasErrors = true;
-        }
-        err = NO_ERROR;
-    }
-
-    if (xmls != NULL) {
-        ResourceDirIterator it(xmls, String8("xml"));
-        while ((err=it.next()) == NO_ERROR) {
-            err = compileXmlFile(bundle, assets, String16(it.getBaseName()),
-                    it.getFile(), &table, xmlFlags);
-            if (err != NO_ERROR) {
-                hasErrors = true;
-            }
-        }
-
-        if (err < NO_ERROR) {
-            hasErrors = true;
-        }
-        err = NO_ERROR;
+    // Drawables are compiled one by one, so the XML files are done in two
+    // batches: those of the types that come before them, and those after.
+    Vector<XmlCompileItem> xmlFiles;
+    collectXmlFiles(layouts, "layout", xmlFlags, true, &xmlFiles, &hasErrors);
+    collectXmlFiles(anims, "anim", xmlFlags, false, &xmlFiles, &hasErrors);
+    collectXmlFiles(animators, "animator", xmlFlags, false, &xmlFiles, &hasErrors);
+    collectXmlFiles(interpolators, "interpolator", xmlFlags, false, &xmlFiles, &hasErrors);
+    collectXmlFiles(transitions, "transition", xmlFlags, false, &xmlFiles, &hasErrors);
+    collectXmlFiles(xmls, "xml", xmlFlags, false, &xmlFiles, &hasErrors);
+    if (compileXmlFiles(bundle, assets, &table, xmlFiles)) {
+        hasErrors = true;
     }
 
     if (drawables != NULL) {
@@ -1516,65 +1637,51 @@ status_t buildResources(Bundle* bundle, const sp<AaptAssets>& assets, sp<ApkBuil
         err = NO_ERROR;
     }
 
-    if (colors != NULL) {
-        ResourceDirIterator it(colors, String8("color"));
-        while ((err=it.next()) == NO_ERROR) {
-            err = compileXmlFile(bundle, assets, String16(it.getBaseName()),
-                    it.getFile(), &table, xmlFlags);
-            if (err != NO_ERROR) {
-                hasErrors = true;
-            }
-        }
-
-        if (err < NO_ERROR) {
-            hasErrors = true;
-        }
-        err = NO_ERROR;
-    }
-
-    if (menus != NULL) {
-        ResourceDirIterator it(menus, String8("menu"));
-        while ((err=it.next()) == NO_ERROR) {
-            String8 src = it.getFile()->getPrintableSource();
-            err = compileXmlFile(bundle, assets, String16(it.getBaseName()),
-                    it.getFile(), &table, xmlFlags);
-            if (err == NO_ERROR) {
-                ResXMLTree block;
-                block.setTo(it.getFile()->getData(), it.getFile()->getSize(), true);
-                checkForIds(src, block);
-            } else {
-                hasErrors = true;
-            }
-        }
-
-        if (err < NO_ERROR) {
-            hasErrors = true;
-        }
-        err = NO_ERROR;
+    xmlFiles.clear();
+    collectXmlFiles(colors, "color", xmlFlags, false, &xmlFiles, &hasErrors);
+    collectXmlFiles(menus, "menu", xmlFlags, true, &xmlFiles, &hasErrors);
+    if (compileXmlFiles(bundle, assets, &table, xmlFiles)) {
+        hasErrors = true;
     }
 
-    // Now compile any generated resources.
+    // Now compile any generated resources.  Compiling them may generate
+    // more, so go round until there are none left.
     std::queue<CompileResourceWorkItem>& workQueue = table.getWorkQueue();
     while (!workQueue.empty()) {
-        CompileResourceWorkItem& workItem = workQueue.front();
-        int xmlCompilationFlags = xmlFlags | XML_COMPILE_PARSE_VALUES
-                | XML_COMPILE_ASSIGN_ATTRIBUTE_IDS;
-        if (!workItem.needsCompiling) {
-            xmlCompilationFlags &= ~XML_COMPILE_ASSIGN_ATTRIBUTE_IDS;
-            xmlCompilationFlags &= ~XML_COMPILE_PARSE_VALUES;
+        Vector<XmlCompileItem> generated;
+        while (!workQueue.empty()) {
+            CompileResourceWorkItem& workItem = workQueue.front();
+            int xmlCompilationFlags = xmlFlags | XML_COMPILE_PARSE_VALUES
+                    | XML_COMPILE_ASSIGN_ATTRIBUTE_IDS;
+            if (!workItem.needsCompiling) {
+                xmlCompilationFlags &= ~XML_COMPILE_ASSIGN_ATTRIBUTE_IDS;
+                xmlCompilationFlags &= ~XML_COMPILE_PARSE_VALUES;
+            }
+
+            XmlCompileItem item;
+            item.resourceName = workItem.resourceName;
+            item.file = workItem.file;
+            item.root = workItem.xmlRoot;
+            item.resPath = workItem.resPath;
+            item.options = xmlCompilationFlags;
+            generated.add(item);
+            workQueue.pop();
+        }
+
+        if (compileXmlFiles(bundle, assets, &table, generated)) {
+            hasErrors = true;
         }
-        err = compileXmlFile(bundle, assets, workItem.resourceName, workItem.xmlRoot,
-                             workItem.file, &table, xmlCompilationFlags);
 
-        if (err == NO_ERROR) {
-            assets->addResource(workItem.resPath.getPathLeaf(),
-                                workItem.resPath,
-                                workItem.file,
-                                workItem.file->getResourceType());
-        } else {
-            hasErrors = true;
+        const size_t N = generated.size();
+        for (size_t i = 0; i < N; i++) {
+            const XmlCompileItem& item = generated[i];
+            if (item.status == NO_ERROR) {
+                assets->addResource(item.resPath.getPathLeaf(),
+                                    item.resPath,
+                                    item.file,
+                                    item.file->getResourceType());
+            }
         }
-        workQueue.pop();
     }
 
     if (table.validateLocalizations()) {
@@ -7,76 +7,121 @@
 
 #include <utils/String16.h>
 #include <utils/Log.h>
+#include <utils/threads.h>
 #include "ResourceIdCache.h"
-#include <map>
 
-static size_t mHits = 0;
-static size_t mMisses = 0;
-static size_t mCollisions = 0;
+#include <atomic>
 
-static const size_t MAX_CACHE_ENTRIES = 2048;
-static const android::String16 TRUE16("1");
-static const android::String16 FALSE16("0");
+using android::Mutex;
+using android::String16;
+
+// The cache is an open-addressing hash table, split into shards with a lock
+// each so that XML files compiled on different threads rarely wait for each
+// other.  Entries are never removed one at a time: once the few slots a key
+// may live in are all taken, storing it evicts one of them, preferring one
+// that hasn't been hit since the last eviction looked at it.
+
+static const size_t SHARD_BITS = 4;
+static const size_t SHARD_COUNT = 1 << SHARD_BITS;
+static const size_t MAX_PROBES = 8;
 
 struct CacheEntry {
-    // concatenation of the relevant strings into a single instance
-    android::String16 hashedName;
+    CacheEntry() : hash(0), id(0), onlyPublic(false), used(false), referenced(false) { }
+
+    // String16 shares its buffer, so keeping a copy of the key is cheap.
+    String16 package;
+    String16 type;
+    String16 name;
+    uint32_t hash;
     uint32_t id;
+    bool onlyPublic;
+    bool used;
+    bool referenced;
+};
+
+struct CacheShard {
+    CacheShard() : entries(NULL), capacity(0), size(0) { }
 
-    CacheEntry() {}
-    CacheEntry(const android::String16& name, uint32_t resId) : hashedName(name), id(resId) { }
+    Mutex lock;
+    CacheEntry* entries;    // allocated on the first store
+    size_t capacity;        // a power of two, or 0 if the cache is off
+    size_t size;
 };
 
-static std::map< uint32_t, CacheEntry > mIdMap;
+static CacheShard mShards[SHARD_COUNT];
+static size_t mShardCapacity = android::ResourceIdCache::kDefaultMaxEntries / SHARD_COUNT;
 
+static std::atomic<size_t> mHits(0);
+static std::atomic<size_t> mMisses(0);
+static std::atomic<size_t> mEvictions(0);
 
-// djb2; reasonable choice for strings when collisions aren't particularly important
-static inline uint32_t hashround(uint32_t hash, int c) {
-    return ((hash << 5) + hash) + c;    /* hash * 33 + c */
+// FNV-1a, run straight over the parts of the key so nothing is allocated.
+static inline uint32_t hashround(uint32_t hash, uint32_t c) {
+    return (hash ^ c) * 16777619u;
 }
 
-static uint32_t hash(const android::String16& hashableString) {
-    uint32_t hash = 5381;
-    const char16_t* str = hashableString.string();
-    while (int c = *str++) hash = hashround(hash, c);
-    return hash;
+static uint32_t hashString(uint32_t hash, const String16& str) {
+    const char16_t* p = str.string();
+    const char16_t* const end = p + str.size();
+    while (p < end) hash = hashround(hash, *p++);
+    return hashround(hash, 0);     // keep "ab"+"c" apart from "a"+"bc"
 }
 
-namespace android {
+static uint32_t hashKey(const String16& package, const String16& type,
+        const String16& name, bool onlyPublic) {
+    uint32_t hash = 2166136261u;
+    hash = hashString(hash, name);
+    hash = hashString(hash, type);
+    hash = hashString(hash, package);
+    return hashround(hash, onlyPublic ? 1 : 0);
+}
 
-static inline String16 makeHashableName(const android::String16& package,
-        const android::String16& type,
-        const android::String16& name,
-        bool onlyPublic) {
-    String16 hashable = String16(name);
-    hashable += type;
-    hashable += package;
-    hashable += (onlyPublic ? TRUE16 : FALSE16);
-    return hashable;
+static inline bool matches(const CacheEntry& entry, uint32_t hashcode,
+        const String16& package, const String16& type,
+        const String16& name, bool onlyPublic) {
+    return entry.hash == hashcode && entry.onlyPublic == onlyPublic
+            && entry.name == name && entry.type == type && entry.package == package;
+}
+
+// The top bits pick the shard, the bottom bits the slot within it.
+static inline CacheShard& shardFor(uint32_t hashcode) {
+    return mShards[hashcode >> (32 - SHARD_BITS)];
+}
+
+static size_t roundUpToPowerOfTwo(size_t n) {
+    size_t result = 1;
+    while (result < n) result <<= 1;
+    return result;
 }
 
+namespace android {
+
 uint32_t ResourceIdCache::lookup(const android::String16& package,
         const android::String16& type,
         const android::String16& name,
         bool onlyPublic) {
-    const String16 hashedName = makeHashableName(package, type, name, onlyPublic);
-    const uint32_t hashcode = hash(hashedName);
-    std::map<uint32_t, CacheEntry>::iterator item = mIdMap.find(hashcode);
-    if (item == mIdMap.end()) {
-        // cache miss
-        mMisses++;
-        return 0;
-    }
-
-    // legit match?
-    if (hashedName == (*item).second.hashedName) {
-        mHits++;
-        return (*item).second.id;
+    const uint32_t hashcode = hashKey(package, type, name, onlyPublic);
+    CacheShard& shard = shardFor(hashcode);
+    AutoMutex _l(shard.lock);
+    if (shard.entries != NULL) {
+        const size_t mask = shard.capacity - 1;
+        const size_t probes = shard.capacity < MAX_PROBES ? shard.capacity : MAX_PROBES;
+        for (size_t i = 0; i < probes; i++) {
+            CacheEntry& entry = shard.entries[(hashcode + i) & mask];
+            if (!entry.used) {
+                // Slots are never emptied, so the key isn't further along.
+                break;
+            }
+            if (matches(entry, hashcode, package, type, name, onlyPublic)) {
+                entry.referenced = true;
+                mHits++;
+                return entry.id;
+            }
+        }
     }
 
-    // collision
-    mCollisions++;
-    mIdMap.erase(hashcode);
+    // cache miss
+    mMisses++;
     return 0;
 }
 
@@ -86,20 +131,107 @@ uint32_t ResourceIdCache::store(const android::String16& package,
         const android::String16& name,
         bool onlyPublic,
         uint32_t resId) {
-    if (mIdMap.size() < MAX_CACHE_ENTRIES) {
-        const String16 hashedName = makeHashableName(package, type, name, onlyPublic);
-        const uint32_t hashcode = hash(hashedName);
-        mIdMap[hashcode] = CacheEntry(hashedName, resId);
+    const uint32_t hashcode = hashKey(package, type, name, onlyPublic);
+    CacheShard& shard = shardFor(hashcode);
+    AutoMutex _l(shard.lock);
+    if (shard.entries == NULL) {
+        shard.capacity = mShardCapacity;
+        if (shard.capacity == 0) {
+            return resId;
+        }
+        shard.entries = new CacheEntry[shard.capacity];
+    }
+
+    const size_t mask = shard.capacity - 1;
+    const size_t probes = shard.capacity < MAX_PROBES ? shard.capacity : MAX_PROBES;
+    CacheEntry* slot = NULL;
+    for (size_t i = 0; i < probes; i++) {
+        CacheEntry& entry = shard.entries[(hashcode + i) & mask];
+        if (!entry.used || matches(entry, hashcode, package, type, name, onlyPublic)) {
+            slot = &entry;
+            break;
+        }
+    }
+
+    if (slot == NULL) {
+        // Every slot is taken: give each a second chance, in probe order.
+        for (size_t i = 0; slot == NULL && i < probes; i++) {
+            CacheEntry& entry = shard.entries[(hashcode + i) & mask];
+            if (entry.referenced) {
+                entry.referenced = false;
+            } else {
+                slot = &entry;
+            }
+        }
+        if (slot == NULL) {
+            slot = &shard.entries[hashcode & mask];
+        }
+        mEvictions++;
+    } else if (!slot->used) {
+        shard.size++;
     }
+
+    slot->package = package;
+    slot->type = type;
+    slot->name = name;
+    slot->hash = hashcode;
+    slot->id = resId;
+    slot->onlyPublic = onlyPublic;
+    slot->used = true;
+    slot->referenced = false;
     return resId;
 }
 
+void ResourceIdCache::setMaxEntries(size_t maxEntries) {
+    size_t shardCapacity = 0;
+    if (maxEntries > 0) {
+        shardCapacity = roundUpToPowerOfTwo((maxEntries + SHARD_COUNT - 1) / SHARD_COUNT);
+    }
+
+    for (size_t i = 0; i < SHARD_COUNT; i++) {
+        mShards[i].lock.lock();
+    }
+    if (shardCapacity != mShardCapacity) {
+        mShardCapacity = shardCapacity;
+        for (size_t i = 0; i < SHARD_COUNT; i++) {
+            delete[] mShards[i].entries;
+            mShards[i].entries = NULL;
+            mShards[i].capacity = 0;
+            mShards[i].size = 0;
+        }
+    }
+    for (size_t i = 0; i < SHARD_COUNT; i++) {
+        mShards[i].lock.unlock();
+    }
+}
+
 void ResourceIdCache::dump() {
+    size_t size = 0;
+    size_t capacity = 0;
+    for (size_t i = 0; i < SHARD_COUNT; i++) {
+        AutoMutex _l(mShards[i].lock);
+        size += mShards[i].size;
+        capacity += mShards[i].capacity;
+    }
     printf("ResourceIdCache dump:\n");
-    printf("Size: %zd\n", mIdMap.size());
-    printf("Hits:   %zd\n", mHits);
-    printf("Misses: %zd\n", mMisses);
-    printf("(Collisions: %zd)\n", mCollisions);
+    printf("Size: %zd\n", size);
+    printf("Capacity: %zd\n", capacity);
+    printf("Hits:   %zd\n", mHits.load());
+    printf("Misses: %zd\n", mMisses.load());
+    printf("Evictions: %zd\n", mEvictions.load());
+}
+
+void ResourceIdCache::clear() {
+    for (size_t i = 0; i < SHARD_COUNT; i++) {
+        AutoMutex _l(mShards[i].lock);
+        delete[] mShards[i].entries;
+        mShards[i].entries = NULL;
+        mShards[i].capacity = 0;
+        mShards[i].size = 0;
+    }
+    mHits = 0;
+    mMisses = 0;
+    mEvictions = 0;
 }
 
 }
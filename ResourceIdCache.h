@@ -12,6 +12,10 @@ namespace android {
 
 class ResourceIdCache {
 public:
+    enum {
+        kDefaultMaxEntries = 32768
+    };
+
     static uint32_t lookup(const String16& package,
             const String16& type,
             const String16& name,
@@ -23,7 +27,13 @@ public:
             bool onlyPublic,
             uint32_t resId);
 
+    // Sizes the cache for about "maxEntries" IDs, rounded up to a power
+    // of two.  0 turns the cache off.  Clears the cache if the size changes.
+    static void setMaxEntries(size_t maxEntries);
+
     static void dump(void);
+
+    static void clear(void);
 };
 
 }
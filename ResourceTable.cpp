@@ -77,6 +77,29 @@ status_t compileXmlFile(const Bundle* bundle,
                         const sp<AaptFile>& target,
                         ResourceTable* table,
                         int options)
+{
+    status_t err = prepareXmlTree(bundle, resourceName, root, target, table, options);
+    if (err != NO_ERROR) {
+        return err;
+    }
+
+    bool hasErrors = assignXmlResourceIds(assets, root, table, options) != NO_ERROR;
+
+    err = parseXmlValues(bundle, assets, resourceName, root, target, table, options,
+            hasErrors);
+    if (err != NO_ERROR) {
+        return err;
+    }
+
+    return flattenXmlTree(root, target, options);
+}
+
+status_t prepareXmlTree(const Bundle* bundle,
+                        const String16& resourceName,
+                        const sp<XMLNode>& root,
+                        const sp<AaptFile>& target,
+                        ResourceTable* table,
+                        int options)
 {
     if ((options&XML_COMPILE_STRIP_WHITESPACE) != 0) {
         root->removeWhitespace(true, NULL);
@@ -91,15 +114,32 @@ status_t compileXmlFile(const Bundle* bundle,
     if (table->processBundleFormat(bundle, resourceName, target, root) != NO_ERROR) {
         return UNKNOWN_ERROR;
     }
-    
-    bool hasErrors = false;
+    return NO_ERROR;
+}
+
+status_t assignXmlResourceIds(const sp<AaptAssets>& assets,
+                              const sp<XMLNode>& root,
+                              const ResourceTable* table,
+                              int options)
+{
     if ((options&XML_COMPILE_ASSIGN_ATTRIBUTE_IDS) != 0) {
         status_t err = root->assignResourceIds(assets, table);
         if (err != NO_ERROR) {
-            hasErrors = true;
+            return UNKNOWN_ERROR;
         }
     }
+    return NO_ERROR;
+}
 
+status_t parseXmlValues(const Bundle* bundle,
+                        const sp<AaptAssets>& assets,
+                        const String16& resourceName,
+                        const sp<XMLNode>& root,
+                        const sp<AaptFile>& target,
+                        ResourceTable* table,
+                        int options,
+                        bool hasErrors)
+{
     if ((options&XML_COMPILE_PARSE_VALUES) != 0) {
         status_t err = root->parseValues(assets, table);
         if (err != NO_ERROR) {
@@ -114,7 +154,13 @@ status_t compileXmlFile(const Bundle* bundle,
     if (table->modifyForCompat(bundle, resourceName, target, root) != NO_ERROR) {
         return UNKNOWN_ERROR;
     }
+    return NO_ERROR;
+}
 
+status_t flattenXmlTree(const sp<XMLNode>& root,
+                        const sp<AaptFile>& target,
+                        int options)
+{
     if (kIsDebug) {
         printf("Input XML Resource:\n");
         root->print();
@@ -2956,6 +3002,7 @@ status_t ResourceTable::flatten(Bundle* bundle, const sp<const ResourceFilter>&
     // Iterate through all data, collecting all values (strings,
     // references, etc).
     StringPool valueStrings(useUTF8);
+    valueStrings.setJobs(bundle->getJobs());
     Vector<sp<Entry> > allEntries;
     for (pi=0; pi<N; pi++) {
         sp<Package> p = mOrderedPackages.itemAt(pi);
@@ -3377,6 +3424,16 @@ status_t ResourceTable::flatten(Bundle* bundle, const sp<const ResourceFilter>&
         fprintf(stderr, "**** total strings: %zd\n", SSIZE(strAmt));
     }
 
+    size_t packagesSize = 0;
+    for (pi=0; pi<flatPackages.size(); pi++) {
+        packagesSize += flatPackages[pi]->getSize();
+    }
+    err = dest->reserveData(dest->getSize() + packagesSize);
+    if (err != NO_ERROR) {
+        fprintf(stderr, "ERROR: out of memory creating package chunk for ResTable_header\n");
+        return err;
+    }
+
     for (pi=0; pi<flatPackages.size(); pi++) {
         err = dest->writeData(flatPackages[pi]->getData(),
                               flatPackages[pi]->getSize());
@@ -3384,6 +3441,8 @@ status_t ResourceTable::flatten(Bundle* bundle, const sp<const ResourceFilter>&
             fprintf(stderr, "ERROR: out of memory creating package chunk for ResTable_header\n");
             return err;
         }
+        // Don't hold on to a second copy of the package once it's in "dest".
+        flatPackages.editItemAt(pi)->clearData();
     }
 
     ResTable_header* header = (ResTable_header*)
@@ -57,6 +57,41 @@ status_t compileXmlFile(const Bundle* bundle,
                         ResourceTable* table,
                         int options = XML_COMPILE_STANDARD_RESOURCE);
 
+/*
+ * The stages of compileXmlFile(), for callers that compile many files at
+ * once.  prepareXmlTree() and parseXmlValues() add to "table" and must be
+ * called for one file at a time, in the same order for every build, so
+ * that resource IDs come out the same.  assignXmlResourceIds() only reads
+ * the table, and flattenXmlTree() doesn't use it at all; both may run on
+ * several files in parallel.  "hasErrors" tells parseXmlValues() that an
+ * earlier stage failed: values are still parsed so that their errors get
+ * reported too, but the file goes no further.
+ */
+status_t prepareXmlTree(const Bundle* bundle,
+                        const String16& resourceName,
+                        const sp<XMLNode>& xmlTree,
+                        const sp<AaptFile>& target,
+                        ResourceTable* table,
+                        int options);
+
+status_t assignXmlResourceIds(const sp<AaptAssets>& assets,
+                              const sp<XMLNode>& xmlTree,
+                              const ResourceTable* table,
+                              int options);
+
+status_t parseXmlValues(const Bundle* bundle,
+                        const sp<AaptAssets>& assets,
+                        const String16& resourceName,
+                        const sp<XMLNode>& xmlTree,
+                        const sp<AaptFile>& target,
+                        ResourceTable* table,
+                        int options,
+                        bool hasErrors);
+
+status_t flattenXmlTree(const sp<XMLNode>& xmlTree,
+                        const sp<AaptFile>& target,
+                        int options);
+
 status_t compileResourceFile(Bundle* bundle,
                              const sp<AaptAssets>& assets,
                              const sp<AaptFile>& in,
@@ -0,0 +1,475 @@
+//
+// Copyright 2026 The Android Open Source Project
+//
+// Remembers what "apkname" and "dump badging" printed for an APK.
+
+#define LOG_TAG "ResultCache"
+
+#include <utils/Log.h>
+#include "ResultCache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#ifndef AAPT_VERSION
+    #define AAPT_VERSION ""
+#endif
+
+namespace android {
+
+// The file is a Header, then Entry[entryCount] sorted by hash, then the
+// path, kind and value bytes the entries point into.  Numbers are in the
+// byte order of the host that wrote it; anywhere else the magic won't
+// match and the cache just looks empty.  So does a cache written by
+// another build of aapt, whose output may differ from ours; the next
+// flush() replaces it.
+
+static const uint32_t kMagic = 0x41525331;     // "ARS1"
+static const uint32_t kVersion = 2;
+
+struct ResultCache::Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t dataSize;
+    uint64_t toolHash;      // hash of the AAPT_VERSION that wrote it
+};
+
+static uint64_t getToolHash() {
+    uint64_t hash = 14695981039346656037ull;
+    for (const char* s = AAPT_VERSION; *s != '\0'; s++) {
+        hash = (hash ^ (unsigned char) *s) * 1099511628211ull;
+    }
+    return hash;
+}
+
+struct ResultCache::Entry {
+    uint64_t hash;
+    uint64_t size;
+    int64_t mtime;
+    uint32_t cdCrc;
+    uint32_t pathOffset;
+    uint32_t pathLength;
+    uint32_t kindOffset;
+    uint32_t kindLength;
+    uint32_t valueOffset;
+    uint32_t valueLength;
+    uint32_t reserved;
+};
+
+ResultCache::ResultCache() :
+        mMap(NULL), mEntryCount(0), mDataSize(0) {
+}
+
+ResultCache::~ResultCache() {
+    delete mMap;
+}
+
+String8 ResultCache::getDefaultPath() {
+    const char* path = getenv("AAPT_RESULT_CACHE");
+    if (path != NULL) {
+        return String8(path);
+    }
+
+    String8 result;
+    const char* dir = getenv("XDG_CACHE_HOME");
+    if (dir != NULL && *dir != '\0') {
+        result = dir;
+    } else if ((dir = getenv("HOME")) != NULL && *dir != '\0') {
+        result = dir;
+        result.appendPath(".cache");
+    } else {
+        return String8();
+    }
+    result.appendPath("aapt");
+    result.appendPath("results");
+    return result;
+}
+
+status_t ResultCache::open(const String8& path, bool rebuild) {
+    mPath = path;
+    if (rebuild || path.isEmpty()) {
+        return NO_ERROR;
+    }
+
+    int fd = ::open(path.string(), O_RDONLY | O_BINARY);
+    if (fd < 0) {
+        return NO_ERROR;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (uint64_t) st.st_size >= sizeof(Header)) {
+        FileMap* map = new FileMap();
+        if (map->create(path.string(), fd, 0, st.st_size, true)) {
+            mMap = map;
+        } else {
+            delete map;
+        }
+    }
+    close(fd);
+
+    if (mMap == NULL) {
+        return NO_ERROR;
+    }
+
+    const Header* header = (const Header*) mMap->getDataPtr();
+    const uint64_t size = mMap->getDataLength();
+    if (header->magic != kMagic || header->version != kVersion
+            || sizeof(Header) + (uint64_t) header->entryCount * sizeof(Entry)
+                    + header->dataSize > size) {
+        ALOGW("ignoring unrecognized result cache '%s'\n", path.string());
+        delete mMap;
+        mMap = NULL;
+        return NO_ERROR;
+    }
+    if (header->toolHash != getToolHash()) {
+        ALOGV("ignoring result cache '%s' from another version of aapt\n", path.string());
+        delete mMap;
+        mMap = NULL;
+        return NO_ERROR;
+    }
+    mEntryCount = header->entryCount;
+    mDataSize = header->dataSize;
+    return NO_ERROR;
+}
+
+static inline uint32_t get4LE(const unsigned char* buf) {
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t) buf[3] << 24);
+}
+
+static bool readFully(int fd, off_t offset, unsigned char* buf, size_t len) {
+    if (lseek(fd, offset, SEEK_SET) != offset) {
+        return false;
+    }
+    while (len > 0) {
+        ssize_t n = read(fd, buf, len);
+        if (n <= 0) {
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+/*
+ * CRC the central directory: it changes whenever any entry does, and is
+ * small next to the rest of the APK.
+ */
+static status_t getCentralDirectoryCrc(int fd, uint64_t fileSize, uint32_t* outCrc) {
+    const size_t kEOCDLen = 22;
+    const size_t kMaxCommentLen = 65535;
+    const size_t kBufSize = 65536;
+
+    if (fileSize < kEOCDLen) {
+        return BAD_VALUE;
+    }
+
+    status_t result = BAD_VALUE;
+    size_t tailLen = fileSize < kEOCDLen + kMaxCommentLen
+            ? (size_t) fileSize : kEOCDLen + kMaxCommentLen;
+    unsigned char* buf = new unsigned char[tailLen > kBufSize ? tailLen : kBufSize];
+    uint64_t cdOffset = 0;
+    uint64_t cdSize = 0;
+    uLong crc;
+
+    if (!readFully(fd, fileSize - tailLen, buf, tailLen)) {
+        result = UNKNOWN_ERROR;
+        goto bail;
+    }
+
+    for (ssize_t i = tailLen - kEOCDLen; i >= 0; i--) {
+        if (buf[i] == 'P' && buf[i + 1] == 'K' && buf[i + 2] == 5 && buf[i + 3] == 6) {
+            cdSize = get4LE(buf + i + 12);
+            cdOffset = get4LE(buf + i + 16);
+            result = NO_ERROR;
+            break;
+        }
+    }
+    if (result != NO_ERROR || cdOffset + cdSize > fileSize) {
+        result = BAD_VALUE;
+        goto bail;
+    }
+
+    crc = crc32(0L, Z_NULL, 0);
+    while (cdSize > 0) {
+        size_t len = cdSize > kBufSize ? kBufSize : (size_t) cdSize;
+        if (!readFully(fd, cdOffset, buf, len)) {
+            result = UNKNOWN_ERROR;
+            goto bail;
+        }
+        crc = crc32(crc, buf, len);
+        cdOffset += len;
+        cdSize -= len;
+    }
+    *outCrc = crc;
+
+bail:
+    delete[] buf;
+    return result;
+}
+
+status_t ResultCache::getIdentity(const char* apkPath, ApkIdentity* outIdentity) {
+    int fd = ::open(apkPath, O_RDONLY | O_BINARY);
+    if (fd < 0) {
+        return errno == ENOENT ? NAME_NOT_FOUND : UNKNOWN_ERROR;
+    }
+
+    struct stat st;
+    status_t result = UNKNOWN_ERROR;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        outIdentity->size = st.st_size;
+        outIdentity->mtime = st.st_mtime;
+        result = getCentralDirectoryCrc(fd, st.st_size, &outIdentity->cdCrc);
+    }
+    close(fd);
+
+#ifndef _WIN32
+    char* absolute = realpath(apkPath, NULL);
+    if (absolute != NULL) {
+        outIdentity->path = absolute;
+        free(absolute);
+    } else
+#endif
+    {
+        outIdentity->path = apkPath;
+    }
+    return result;
+}
+
+// FNV-1a.
+uint64_t ResultCache::hashKey(const String8& path, const char* kind) {
+    uint64_t hash = 14695981039346656037ull;
+    const char* s = path.string();
+    for (size_t i = 0; i < path.length(); i++) {
+        hash = (hash ^ (unsigned char) s[i]) * 1099511628211ull;
+    }
+    hash = hash * 1099511628211ull;     // the '\0' between the two
+    for (; *kind != '\0'; kind++) {
+        hash = (hash ^ (unsigned char) *kind) * 1099511628211ull;
+    }
+    return hash;
+}
+
+const ResultCache::Entry* ResultCache::getEntries() const {
+    return (const Entry*) ((const char*) mMap->getDataPtr() + sizeof(Header));
+}
+
+const char* ResultCache::getData() const {
+    return (const char*) (getEntries() + mEntryCount);
+}
+
+bool ResultCache::getString(uint32_t offset, uint32_t length, String8* outString) const {
+    if ((uint64_t) offset + length > mDataSize) {
+        return false;
+    }
+    outString->setTo(getData() + offset, length);
+    return true;
+}
+
+bool ResultCache::find(const ApkIdentity& identity, const char* kind,
+        String8* outValue) const {
+    if (mMap == NULL) {
+        return false;
+    }
+
+    const uint64_t hash = hashKey(identity.path, kind);
+    const Entry* entries = getEntries();
+    const Entry* end = entries + mEntryCount;
+    const Entry* e = std::lower_bound(entries, end, hash,
+            [](const Entry& entry, uint64_t h) { return entry.hash < h; });
+
+    for (; e != end && e->hash == hash; e++) {
+        String8 path, entryKind;
+        if (!getString(e->pathOffset, e->pathLength, &path)
+                || !getString(e->kindOffset, e->kindLength, &entryKind)
+                || path != identity.path || entryKind != kind) {
+            continue;
+        }
+        // Same APK, but changed since: a miss.
+        if (e->size != identity.size || e->mtime != identity.mtime
+                || e->cdCrc != identity.cdCrc) {
+            return false;
+        }
+        return getString(e->valueOffset, e->valueLength, outValue);
+    }
+    return false;
+}
+
+void ResultCache::put(const ApkIdentity& identity, const char* kind, const String8& value) {
+    Record record;
+    record.hash = hashKey(identity.path, kind);
+    record.identity = identity;
+    record.kind = kind;
+    record.value = value;
+
+    AutoMutex _l(mLock);
+    mPending.add(record);
+}
+
+static void makeParentDirs(const String8& path) {
+    String8 dir = path.getPathDir();
+    if (dir.isEmpty()) {
+        return;
+    }
+    struct stat st;
+    if (stat(dir.string(), &st) == 0) {
+        return;
+    }
+    makeParentDirs(dir);
+#ifdef _WIN32
+    _mkdir(dir.string());
+#else
+    mkdir(dir.string(), S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH);
+#endif
+}
+
+status_t ResultCache::flush() {
+    AutoMutex _l(mLock);
+    if (mPending.isEmpty() || mPath.isEmpty()) {
+        return NO_ERROR;
+    }
+
+    // Keep the old entries we have nothing newer for, as long as their
+    // APK is still there.
+    Vector<Record> records(mPending);
+    for (size_t i = 0; i < mEntryCount; i++) {
+        const Entry& e = getEntries()[i];
+        Record record;
+        if (!getString(e.pathOffset, e.pathLength, &record.identity.path)
+                || !getString(e.kindOffset, e.kindLength, &record.kind)
+                || !getString(e.valueOffset, e.valueLength, &record.value)) {
+            continue;
+        }
+
+        bool replaced = false;
+        for (size_t j = 0; j < mPending.size() && !replaced; j++) {
+            const Record& pending = mPending[j];
+            replaced = pending.hash == e.hash && pending.kind == record.kind
+                    && pending.identity.path == record.identity.path;
+        }
+        struct stat st;
+        if (replaced || stat(record.identity.path.string(), &st) != 0) {
+            continue;
+        }
+
+        record.hash = e.hash;
+        record.identity.size = e.size;
+        record.identity.mtime = e.mtime;
+        record.identity.cdCrc = e.cdCrc;
+        records.add(record);
+    }
+
+    std::vector<const Record*> sorted;
+    for (size_t i = 0; i < records.size(); i++) {
+        sorted.push_back(&records[i]);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(),
+            [](const Record* a, const Record* b) { return a->hash < b->hash; });
+
+    status_t result = NO_ERROR;
+    String8 tmpName = String8::format("%s.%d.tmp", mPath.string(), (int) getpid());
+    FILE* fp = NULL;
+    Header header;
+    std::vector<Entry> entries(sorted.size());
+    uint64_t dataSize = 0;
+
+    for (size_t i = 0; i < sorted.size(); i++) {
+        const Record* r = sorted[i];
+        Entry& e = entries[i];
+        memset(&e, 0, sizeof(e));
+        e.hash = r->hash;
+        e.size = r->identity.size;
+        e.mtime = r->identity.mtime;
+        e.cdCrc = r->identity.cdCrc;
+        e.pathOffset = dataSize;
+        e.pathLength = r->identity.path.length();
+        dataSize += e.pathLength;
+        e.kindOffset = dataSize;
+        e.kindLength = r->kind.length();
+        dataSize += e.kindLength;
+        e.valueOffset = dataSize;
+        e.valueLength = r->value.length();
+        dataSize += e.valueLength;
+    }
+    if (dataSize > UINT32_MAX) {
+        ALOGW("result cache '%s' is too big to write\n", mPath.string());
+        result = NO_MEMORY;
+        goto bail;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = kMagic;
+    header.version = kVersion;
+    header.toolHash = getToolHash();
+    header.entryCount = entries.size();
+    header.dataSize = dataSize;
+
+    makeParentDirs(mPath);
+    fp = fopen(tmpName.string(), "wb");
+    if (fp == NULL) {
+        ALOGW("unable to create result cache '%s': %s\n", tmpName.string(), strerror(errno));
+        result = UNKNOWN_ERROR;
+        goto bail;
+    }
+    if (fwrite(&header, sizeof(header), 1, fp) != 1
+            || (!entries.empty()
+                    && fwrite(&entries[0], sizeof(Entry), entries.size(), fp) != entries.size())) {
+        result = UNKNOWN_ERROR;
+        goto bail;
+    }
+    for (size_t i = 0; i < sorted.size(); i++) {
+        const Record* r = sorted[i];
+        if (fwrite(r->identity.path.string(), 1, r->identity.path.length(), fp)
+                        != r->identity.path.length()
+                || fwrite(r->kind.string(), 1, r->kind.length(), fp) != r->kind.length()
+                || fwrite(r->value.string(), 1, r->value.length(), fp) != r->value.length()) {
+            result = UNKNOWN_ERROR;
+            goto bail;
+        }
+    }
+    if (fclose(fp) != 0) {
+        fp = NULL;
+        result = UNKNOWN_ERROR;
+        goto bail;
+    }
+    fp = NULL;
+
+    if (rename(tmpName.string(), mPath.string()) != 0) {
+        /* some platforms won't rename over an existing file */
+        unlink(mPath.string());
+        if (rename(tmpName.string(), mPath.string()) != 0) {
+            result = UNKNOWN_ERROR;
+            goto bail;
+        }
+    }
+    mPending.clear();
+
+bail:
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    if (result != NO_ERROR) {
+        unlink(tmpName.string());
+    }
+    return result;
+}
+
+}
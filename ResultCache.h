@@ -0,0 +1,104 @@
+//
+// Copyright 2026 The Android Open Source Project
+//
+// Remembers what "apkname" and "dump badging" printed for an APK, so they
+// needn't open it again while it is unchanged.
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <utils/Errors.h>
+#include <utils/FileMap.h>
+#include <utils/String8.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+#include <stdint.h>
+
+namespace android {
+
+/*
+ * A cache file holding one result per (APK, kind of result).
+ *
+ * An APK is identified by its absolute path, its size and modification
+ * time, and the CRC of its central directory; an entry whose APK no
+ * longer matches is ignored.  The file is a sorted table mapped read-only,
+ * so a lookup doesn't read or parse the rest of it.  New results are kept
+ * in memory until flush() rewrites the file.  A file written by a
+ * different version of aapt is treated as empty.
+ *
+ * find() and put() may be called from several threads at once.
+ */
+class ResultCache {
+public:
+    struct ApkIdentity {
+        ApkIdentity() : size(0), mtime(0), cdCrc(0) {}
+
+        String8 path;
+        uint64_t size;
+        int64_t mtime;
+        uint32_t cdCrc;
+    };
+
+    ResultCache();
+    ~ResultCache();
+
+    /*
+     * The cache file to use unless told otherwise: $AAPT_RESULT_CACHE, or
+     * aapt/results under the user's cache directory.  Empty if there is
+     * nowhere to put one.
+     */
+    static String8 getDefaultPath();
+
+    /*
+     * Maps the cache file at "path".  A missing or unreadable file is an
+     * empty cache.  With "rebuild", the old entries are dropped and will
+     * be overwritten by the next flush().
+     */
+    status_t open(const String8& path, bool rebuild);
+
+    /* Works out the identity of "apkPath" by reading its central directory. */
+    static status_t getIdentity(const char* apkPath, ApkIdentity* outIdentity);
+
+    /* Looks up the "kind" result for the APK; false if there is none. */
+    bool find(const ApkIdentity& identity, const char* kind, String8* outValue) const;
+
+    /* Records the "kind" result for the APK.  "value" may hold any bytes. */
+    void put(const ApkIdentity& identity, const char* kind, const String8& value);
+
+    /* Writes the file out again if anything was put() since open(). */
+    status_t flush();
+
+private:
+    /* these are private and not defined */
+    ResultCache(const ResultCache& src);
+    ResultCache& operator=(const ResultCache& src);
+
+    struct Header;
+    struct Entry;
+
+    struct Record {
+        uint64_t hash;
+        ApkIdentity identity;
+        String8 kind;
+        String8 value;
+    };
+
+    static uint64_t hashKey(const String8& path, const char* kind);
+
+    const Entry* getEntries() const;
+    const char* getData() const;
+    bool getString(uint32_t offset, uint32_t length, String8* outString) const;
+
+    String8 mPath;
+    FileMap* mMap;
+    uint32_t mEntryCount;
+    uint32_t mDataSize;
+
+    mutable Mutex mLock;
+    Vector<Record> mPending;
+};
+
+}
+
+#endif
@@ -10,7 +10,9 @@
 
 #include <algorithm>
 
+#include "DumpWriter.h"
 #include "ResourceTable.h"
+#include "WorkStealingPool.h"
 
 // SSIZE: mingw does not have signed size_t == ssize_t.
 #if !defined(_WIN32)
@@ -82,6 +84,47 @@ void printStringPool(const ResStringPool* pool)
     }
 }
 
+/*
+ * The same as printStringPool(), as a "string-pool" record followed by a
+ * "string" record per entry.
+ */
+void writeStringPool(DumpWriter* out, const ResStringPool* pool)
+{
+    out->begin("string-pool", DumpWriter::STYLE_SPACED);
+    if (pool->getError() != NO_ERROR) {
+        out->attr("error", String8(pool->getError() == NO_INIT ? "uninitialized" : "corrupt"),
+                false);
+        out->end();
+        return;
+    }
+
+    SortedVector<const void*> uniqueStrings;
+    const size_t N = pool->size();
+    for (size_t i=0; i<N; i++) {
+        size_t len;
+        if (pool->isUTF8()) {
+            uniqueStrings.add(pool->string8At(i, &len));
+        } else {
+            uniqueStrings.add(pool->stringAt(i, &len));
+        }
+    }
+
+    out->attr("unique", (int32_t) uniqueStrings.size());
+    out->attr("encoding", String8(pool->isUTF8() ? "UTF-8" : "UTF-16"), false);
+    out->attr("sorted", String8(pool->isSorted() ? "true" : "false"), false);
+    out->attr("entries", (int32_t) N);
+    out->attr("styles", (int32_t) pool->styleCount());
+    out->attr("bytes", (int32_t) pool->bytes());
+    out->end();
+
+    for (size_t s=0; s<N; s++) {
+        out->begin("string", DumpWriter::STYLE_SPACED, 1);
+        out->attr("index", (int32_t) s);
+        out->attr("value", pool->string8ObjectAt(s), false);
+        out->end();
+    }
+}
+
 String8 StringPool::entry::makeConfigsString() const {
     String8 configStr(configTypeName);
     if (configStr.size() > 0) configStr.append(" ");
@@ -126,8 +169,91 @@ int StringPool::entry::compare(const entry& o) const {
     return 0;
 }
 
+// FNV-1a
+static uint32_t hashValue(const String16& value)
+{
+    uint32_t hash = 2166136261u;
+    const char16_t* p = value.string();
+    const char16_t* const end = p + value.size();
+    while (p < end) {
+        hash = (hash ^ *p++) * 16777619u;
+    }
+    return hash;
+}
+
+StringPool::ValueIndex::ValueIndex() :
+        mCount(0)
+{
+}
+
+ssize_t StringPool::ValueIndex::find(const StringPool& pool, const String16& value,
+        uint32_t hash) const
+{
+    if (mSlots.isEmpty()) {
+        return -1;
+    }
+    const size_t mask = mSlots.size() - 1;
+    for (size_t i = hash & mask; mSlots[i].pos != kEmpty; i = (i + 1) & mask) {
+        const Slot& slot = mSlots[i];
+        if (slot.hash == hash && pool.valueAt(slot.pos) == value) {
+            return slot.pos;
+        }
+    }
+    return -1;
+}
+
+void StringPool::ValueIndex::set(const StringPool& pool, const String16& value,
+        uint32_t hash, size_t pos)
+{
+    // Keep the table at most half full.
+    if ((mCount + 1) * 2 > mSlots.size()) {
+        grow();
+    }
+    const size_t mask = mSlots.size() - 1;
+    size_t i = hash & mask;
+    for (; mSlots[i].pos != kEmpty; i = (i + 1) & mask) {
+        Slot& slot = mSlots.editItemAt(i);
+        if (slot.hash == hash && pool.valueAt(slot.pos) == value) {
+            slot.pos = pos;
+            return;
+        }
+    }
+    Slot& slot = mSlots.editItemAt(i);
+    slot.hash = hash;
+    slot.pos = pos;
+    mCount++;
+}
+
+void StringPool::ValueIndex::clear()
+{
+    mSlots.clear();
+    mCount = 0;
+}
+
+void StringPool::ValueIndex::grow()
+{
+    const size_t capacity = mSlots.isEmpty() ? 64 : mSlots.size() * 2;
+    Vector<Slot> slots;
+    slots.insertAt(Slot(), 0, capacity);
+
+    // Slots carry their hash, so nothing is looked up again.
+    const size_t mask = capacity - 1;
+    for (size_t j = 0; j < mSlots.size(); j++) {
+        const Slot& old = mSlots[j];
+        if (old.pos == kEmpty) {
+            continue;
+        }
+        size_t i = old.hash & mask;
+        while (slots[i].pos != kEmpty) {
+            i = (i + 1) & mask;
+        }
+        slots.editItemAt(i) = old;
+    }
+    mSlots = slots;
+}
+
 StringPool::StringPool(bool utf8) :
-        mUTF8(utf8), mValues(-1)
+        mUTF8(utf8), mJobs(1)
 {
 }
 
@@ -144,8 +270,9 @@ ssize_t StringPool::add(const String16& value, const Vector<entry_style_span>& s
 ssize_t StringPool::add(const String16& value,
         bool mergeDuplicates, const String8* configTypeName, const ResTable_config* config)
 {
-    ssize_t vidx = mValues.indexOfKey(value);
-    ssize_t pos = vidx >= 0 ? mValues.valueAt(vidx) : -1;
+    const uint32_t hash = hashValue(value);
+    ssize_t pos = mValues.find(*this, value, hash);
+    const bool first = pos < 0;
     ssize_t eidx = pos >= 0 ? mEntryArray.itemAt(pos) : -1;
     if (eidx < 0) {
         eidx = mEntries.add(entry(value));
@@ -192,21 +319,20 @@ ssize_t StringPool::add(const String16& value,
         }
     }
 
-    const bool first = vidx < 0;
     const bool styled = (pos >= 0 && (size_t)pos < mEntryStyleArray.size()) ?
         mEntryStyleArray[pos].spans.size() : 0;
     if (first || styled || !mergeDuplicates) {
         pos = mEntryArray.add(eidx);
         if (first) {
-            vidx = mValues.add(value, pos);
+            mValues.set(*this, value, hash, pos);
         }
         entry& ent = mEntries.editItemAt(eidx);
         ent.indices.add(pos);
     }
 
     if (kIsDebug) {
-        printf("Adding string %s to pool: pos=%zd eidx=%zd vidx=%zd\n",
-                String8(value).string(), SSIZE(pos), SSIZE(eidx), SSIZE(vidx));
+        printf("Adding string %s to pool: pos=%zd eidx=%zd first=%d\n",
+                String8(value).string(), SSIZE(pos), SSIZE(eidx), first);
     }
 
     return pos;
@@ -307,11 +433,17 @@ void StringPool::sortByConfig()
     }
 #endif
 
-    // Now we rebuild the arrays.
+    // Now we rebuild the arrays.  Every position gets an entry of its own,
+    // sharing the value and configs of the entry it had before; only the
+    // indices are new, so those aren't copied along.
     Vector<entry> newEntries;
     Vector<size_t> newEntryArray;
     Vector<entry_style> newEntryStyleArray;
-    DefaultKeyedVector<size_t, size_t> origOffsetToNewOffset;
+    newEntries.setCapacity(N);
+    newEntryArray.setCapacity(N);
+    if (mEntryStyleArray.size() > 0) {
+        newEntryStyleArray.setCapacity(N);
+    }
 
     for (size_t i=0; i<N; i++) {
         // We are filling in new offset 'i'; oldI is where we can find it
@@ -319,22 +451,14 @@ void StringPool::sortByConfig()
         size_t oldI = newPosToOriginalPos[i];
         // This is the actual entry associated with the old offset.
         const entry& oldEnt = mEntries[mEntryArray[oldI]];
-        // This is the same entry the last time we added it to the
-        // new entry array, if any.
-        ssize_t newIndexOfOffset = origOffsetToNewOffset.indexOfKey(oldI);
-        size_t newOffset;
-        if (newIndexOfOffset < 0) {
-            // This is the first time we have seen the entry, so add
-            // it.
-            newOffset = newEntries.add(oldEnt);
-            newEntries.editItemAt(newOffset).indices.clear();
-        } else {
-            // We have seen this entry before, use the existing one
-            // instead of adding it again.
-            newOffset = origOffsetToNewOffset.valueAt(newIndexOfOffset);
-        }
+        const size_t newOffset = newEntries.add();
+        entry& newEnt = newEntries.editItemAt(newOffset);
+        newEnt.value = oldEnt.value;
+        newEnt.hasStyles = oldEnt.hasStyles;
+        newEnt.configTypeName = oldEnt.configTypeName;
+        newEnt.configs = oldEnt.configs;
         // Update the indices to include this new position.
-        newEntries.editItemAt(newOffset).indices.add(i);
+        newEnt.indices.add(i);
         // And add the offset of the entry to the new entry array.
         newEntryArray.add(newOffset);
         // Add any old style to the new style array.
@@ -367,7 +491,7 @@ void StringPool::sortByConfig()
     mValues.clear();
     for (size_t i=0; i<mEntries.size(); i++) {
         const entry& ent = mEntries[i];
-        mValues.add(ent.value, ent.indices[0]);
+        mValues.set(*this, ent.value, hashValue(ent.value), ent.indices[0]);
     }
 
 #if 0
@@ -398,6 +522,118 @@ sp<AaptFile> StringPool::createStringBlock()
     *str++ = strSize; \
 }
 
+/*
+ * Encodes a range of the pool's unique strings for writeStringBlock().
+ * MEASURE works out the size of each string in the block, converting it
+ * to UTF-8 first for a UTF-8 pool; WRITE copies each one to its offset.
+ * A string only touches its own slots, so ranges can run in parallel.
+ */
+class StringPool::StringEncoder : public WorkQueue::WorkUnit {
+public:
+    enum Pass {
+        MEASURE,
+        WRITE
+    };
+
+    StringEncoder(Pass pass, bool utf8, entry* entries, String8* encoded, size_t* sizes,
+            uint8_t* strings, size_t start, size_t end) :
+            mPass(pass), mUTF8(utf8), mEntries(entries), mEncoded(encoded), mSizes(sizes),
+            mStrings(strings), mStart(start), mEnd(end) {
+    }
+
+    virtual bool run() {
+        for (size_t i = mStart; i < mEnd; i++) {
+            if (mPass == MEASURE) {
+                measure(i);
+            } else {
+                write(i);
+            }
+        }
+        return true;
+    }
+
+private:
+    void measure(size_t i) {
+        const size_t charSize = mUTF8 ? sizeof(uint8_t) : sizeof(uint16_t);
+        const size_t strSize = mEntries[i].value.size();
+        const size_t lenSize = strSize > (size_t)(1<<((charSize*8)-1))-1 ?
+            charSize*2 : charSize;
+
+        if (mUTF8) {
+            mEncoded[i] = String8(mEntries[i].value);
+        }
+
+        const size_t encSize = mUTF8 ? mEncoded[i].size() : 0;
+        const size_t encLenSize = mUTF8 ?
+            (encSize > (size_t)(1<<((charSize*8)-1))-1 ?
+                charSize*2 : charSize) : 0;
+
+        mSizes[i] = lenSize + encLenSize +
+            ((mUTF8 ? encSize : strSize)+1)*charSize;
+    }
+
+    void write(size_t i) {
+        const entry& ent = mEntries[i];
+        const size_t strSize = ent.value.size();
+        uint8_t* dat = mStrings + ent.offset;
+        if (mUTF8) {
+            uint8_t* strings = dat;
+            const String8& encStr = mEncoded[i];
+            const size_t encSize = encStr.size();
+
+            ENCODE_LENGTH(strings, sizeof(uint8_t), strSize)
+
+            ENCODE_LENGTH(strings, sizeof(uint8_t), encSize)
+
+            strncpy((char*)strings, encStr, encSize+1);
+
+            // The converted copy is no longer needed.
+            mEncoded[i] = String8();
+        } else {
+            char16_t* strings = (char16_t*)dat;
+
+            ENCODE_LENGTH(strings, sizeof(char16_t), strSize)
+
+            strcpy16_htod(strings, ent.value);
+        }
+    }
+
+    const Pass mPass;
+    const bool mUTF8;
+    entry* const mEntries;
+    String8* const mEncoded;
+    size_t* const mSizes;
+    uint8_t* const mStrings;
+    const size_t mStart;
+    const size_t mEnd;
+};
+
+void StringPool::encodeStrings(int pass, entry* entries, String8* encoded, size_t* sizes,
+        uint8_t* strings, size_t count)
+{
+    // Ranges of this many strings are handed to the threads; a pool that
+    // fits in one is encoded here.
+    static const size_t kChunkSize = 8192;
+
+    const StringEncoder::Pass encoderPass = (StringEncoder::Pass) pass;
+    if (mJobs == 1 || count <= kChunkSize) {
+        StringEncoder(encoderPass, mUTF8, entries, encoded, sizes, strings, 0, count).run();
+        return;
+    }
+
+    WorkStealingPool wq(mJobs);
+    for (size_t start = 0; start < count; start += kChunkSize) {
+        const size_t end = std::min(start + kChunkSize, count);
+        StringEncoder* w = new StringEncoder(encoderPass, mUTF8, entries, encoded, sizes,
+                strings, start, end);
+        if (wq.schedule(w) != OK) {
+            w->run();
+            delete w;
+        }
+    }
+    wq.finish();
+}
+
 status_t StringPool::writeStringBlock(const sp<AaptFile>& pool)
 {
     // Allow appending.  Sorry this is a little wacky.
@@ -406,6 +642,10 @@ status_t StringPool::writeStringBlock(const sp<AaptFile>& pool)
         if (block == NULL) {
             return UNKNOWN_ERROR;
         }
+        status_t err = pool->reserveData(pool->getSize() + block->getSize());
+        if (err != NO_ERROR) {
+            return err;
+        }
         ssize_t res = pool->writeData(block->getData(), block->getSize());
         return (res >= 0) ? (status_t)NO_ERROR : res;
     }
@@ -435,78 +675,59 @@ status_t StringPool::writeStringBlock(const sp<AaptFile>& pool)
 
     const size_t ENTRIES = mEntryArray.size();
 
-    // Now build the pool of unique strings.
+    // Now build the pool of unique strings.  First every string is sized
+    // (and converted to UTF-8 if need be), which gives each its offset and
+    // the size of the whole block; then each is copied to its offset.
 
     const size_t STRINGS = mEntries.size();
     const size_t preSize = sizeof(ResStringPool_header)
                          + (sizeof(uint32_t)*ENTRIES)
                          + (sizeof(uint32_t)*STYLES);
-    if (pool->editData(preSize) == NULL) {
-        fprintf(stderr, "ERROR: Out of memory for string pool\n");
-        return NO_MEMORY;
+
+    entry* entries = mEntries.editArray();
+    Vector<String8> encoded;
+    if (mUTF8) {
+        encoded.insertAt(String8(), 0, STRINGS);
     }
+    Vector<size_t> sizes;
+    sizes.insertAt(0, 0, STRINGS);
 
-    const size_t charSize = mUTF8 ? sizeof(uint8_t) : sizeof(uint16_t);
+    encodeStrings(StringEncoder::MEASURE, entries, encoded.editArray(), sizes.editArray(),
+            NULL, STRINGS);
 
     size_t strPos = 0;
     for (i=0; i<STRINGS; i++) {
-        entry& ent = mEntries.editItemAt(i);
-        const size_t strSize = (ent.value.size());
-        const size_t lenSize = strSize > (size_t)(1<<((charSize*8)-1))-1 ?
-            charSize*2 : charSize;
-
-        String8 encStr;
-        if (mUTF8) {
-            encStr = String8(ent.value);
-        }
-
-        const size_t encSize = mUTF8 ? encStr.size() : 0;
-        const size_t encLenSize = mUTF8 ?
-            (encSize > (size_t)(1<<((charSize*8)-1))-1 ?
-                charSize*2 : charSize) : 0;
-
-        ent.offset = strPos;
-
-        const size_t totalSize = lenSize + encLenSize +
-            ((mUTF8 ? encSize : strSize)+1)*charSize;
-
-        void* dat = (void*)pool->editData(preSize + strPos + totalSize);
-        if (dat == NULL) {
-            fprintf(stderr, "ERROR: Out of memory for string pool\n");
-            return NO_MEMORY;
-        }
-        dat = (uint8_t*)dat + preSize + strPos;
-        if (mUTF8) {
-            uint8_t* strings = (uint8_t*)dat;
-
-            ENCODE_LENGTH(strings, sizeof(uint8_t), strSize)
-
-            ENCODE_LENGTH(strings, sizeof(uint8_t), encSize)
-
-            strncpy((char*)strings, encStr, encSize+1);
-        } else {
-            char16_t* strings = (char16_t*)dat;
-
-            ENCODE_LENGTH(strings, sizeof(char16_t), strSize)
-
-            strcpy16_htod(strings, ent.value);
-        }
-
-        strPos += totalSize;
+        entries[i].offset = strPos;
+        strPos += sizes[i];
     }
 
     // Pad ending string position up to a uint32_t boundary.
+    strPos = (strPos+3)&~0x3;
 
-    if (strPos&0x3) {
-        size_t padPos = ((strPos+3)&~0x3);
-        uint8_t* dat = (uint8_t*)pool->editData(preSize + padPos);
-        if (dat == NULL) {
-            fprintf(stderr, "ERROR: Out of memory padding string pool\n");
-            return NO_MEMORY;
-        }
-        memset(dat+preSize+strPos, 0, padPos-strPos);
-        strPos = padPos;
+    // The style spans are laid out below; their size is known now, so the
+    // whole block can be allocated once, at exactly the size it ends up.
+    size_t stySize = 0;
+    for (i=0; i<STYLES; i++) {
+        stySize += (mEntryStyleArray[i].spans.size()*sizeof(ResStringPool_span))
+                 + sizeof(ResStringPool_ref);
+    }
+    if (STYLES > 0) {
+        stySize += sizeof(ResStringPool_span)-sizeof(ResStringPool_ref);
     }
+    if (pool->reserveData(preSize + strPos + stySize) != NO_ERROR) {
+        fprintf(stderr, "ERROR: Out of memory for string pool\n");
+        return NO_MEMORY;
+    }
+
+    uint8_t* dat = (uint8_t*)pool->editData(preSize + strPos);
+    if (dat == NULL) {
+        fprintf(stderr, "ERROR: Out of memory for string pool\n");
+        return NO_MEMORY;
+    }
+    memset(dat + preSize, 0, strPos);
+
+    encodeStrings(StringEncoder::WRITE, entries, encoded.editArray(), sizes.editArray(),
+            dat + preSize, STRINGS);
 
     // Build the pool of style spans.
 
@@ -610,7 +831,7 @@ ssize_t StringPool::offsetForString(const String16& val) const
 
 const Vector<size_t>* StringPool::offsetsForString(const String16& val) const
 {
-    ssize_t pos = mValues.valueFor(val);
+    ssize_t pos = mValues.find(*this, val, hashValue(val));
     if (pos < 0) {
         return NULL;
     }
@@ -29,7 +29,10 @@ void strcpy16_htod(char16_t* dst, const char16_t* src);
 #endif
 void strcpy16_htod(uint16_t* dst, const char16_t* src);
 
+class DumpWriter;
+
 void printStringPool(const ResStringPool* pool);
+void writeStringPool(DumpWriter* out, const ResStringPool* pool);
 
 /**
  * The StringPool class is used as an intermediate representation for
@@ -116,6 +119,13 @@ public:
         return mOriginalPosToNewPos.itemAt(originalPos);
     }
 
+    /**
+     * Sets how many threads writeStringBlock() may use to encode a large
+     * pool: 1 (the default) encodes it on the calling thread, 0 uses one
+     * thread per CPU.
+     */
+    void setJobs(int jobs) { mJobs = jobs; }
+
     sp<AaptFile> createStringBlock();
 
     status_t writeStringBlock(const sp<AaptFile>& pool);
@@ -139,6 +149,11 @@ public:
     const Vector<size_t>* offsetsForString(const String16& val) const;
 
 private:
+    class StringEncoder;
+
+    void encodeStrings(int pass, entry* entries, String8* encoded, size_t* sizes,
+            uint8_t* strings, size_t count);
+
     class ConfigSorter
     {
     public:
@@ -149,6 +164,7 @@ private:
     };
 
     const bool                              mUTF8;
+    int                                     mJobs;
 
     // The following data structures represent the actual structures
     // that will be generated for the final string pool.
@@ -171,9 +187,45 @@ private:
     // The following data structures are used for book-keeping as the
     // string pool is constructed.
 
+    // Open-addressing hash from a string to an index of mEntryArray.  It
+    // holds no strings of its own: a slot keeps the hash and the position,
+    // and the string is read back from mEntries to compare.
+    class ValueIndex
+    {
+    public:
+        ValueIndex();
+
+        // Returns the position stored for "value", or -1.
+        ssize_t find(const StringPool& pool, const String16& value, uint32_t hash) const;
+
+        // Stores "pos" for "value", replacing any position already there.
+        void set(const StringPool& pool, const String16& value, uint32_t hash, size_t pos);
+
+        void clear();
+
+    private:
+        enum { kEmpty = 0xffffffff };
+
+        struct Slot {
+            Slot() : hash(0), pos(kEmpty) { }
+
+            uint32_t hash;
+            uint32_t pos;
+        };
+
+        void grow();
+
+        Vector<Slot>                        mSlots;
+        size_t                              mCount;
+    };
+
+    const String16& valueAt(size_t pos) const {
+        return mEntries[mEntryArray[pos]].value;
+    }
+
     // Unique set of all the strings added to the pool, mapped to
     // the first index of mEntryArray where the value was added.
-    DefaultKeyedVector<String16, ssize_t>   mValues;
+    ValueIndex                              mValues;
     // This array maps from the original position a string was placed at
     // in mEntryArray to its new position after being sorted with sortByConfig().
     Vector<size_t>                          mOriginalPosToNewPos;
@@ -0,0 +1,400 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+#define LOG_TAG "WorkStealingPool"
+
+#include <utils/Log.h>
+#include "WorkStealingPool.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace android {
+
+// --- WorkStealingPool ---
+
+WorkStealingPool::WorkStealingPool(size_t threads, bool canCallJava) :
+        mOwnerThreadId(getThreadId()), mInjectedCount(0), mPending(0),
+        mCanceled(false), mFinished(false), mDone(false), mWorkEpoch(0), mSleepers(0) {
+    if (threads == 0) {
+        threads = getCpuCount();
+    }
+
+    // Workers look at each other's deques, so the list has to be complete
+    // before any of them starts.
+    for (size_t i = 0; i < threads; i++) {
+        mWorkers.add(new WorkThread(this, i, canCallJava));
+    }
+    for (size_t i = 0; i < threads; i++) {
+        status_t status = mWorkers[i]->run("WorkStealingPool::WorkThread");
+        if (status) {
+            // The threads we did get, and finish(), will do the work.
+            ALOGW("Unable to start work thread %d: %d", (int) i, status);
+            break;
+        }
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    if (!cancel()) {
+        finish();
+    }
+}
+
+size_t WorkStealingPool::getCpuCount() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    long count = info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    return count > 0 ? count : 1;
+}
+
+status_t WorkStealingPool::schedule(WorkUnit* workUnit, size_t backlog) {
+    Deque* local = getLocalDeque();
+
+    if (mCanceled.load()) {
+        return INVALID_OPERATION;
+    }
+    // Work units may keep adding work until finish() is done with them.
+    if ((local == NULL && mFinished.load()) || mDone.load()) {
+        return INVALID_OPERATION;
+    }
+
+    mPending.fetch_add(1);
+    if (local != NULL) {
+        local->push(workUnit);
+    } else {
+        AutoMutex _l(mInjectLock);
+        mInjected.add(workUnit);
+        mInjectedCount.fetch_add(1);
+    }
+    wakeWorkers(false);
+
+    // Flow control: rather than wait for the workers to catch up, lend a hand.
+    if (backlog && local != NULL) {
+        while (mPending.load() > mWorkers.size() * backlog && !mCanceled.load()) {
+            WorkUnit* next = local->pop();
+            if (next == NULL) {
+                break;
+            }
+            mPending.fetch_sub(1);
+            runUnit(next);
+        }
+    }
+    return OK;
+}
+
+bool WorkStealingPool::runOne() {
+    Deque* local = getLocalDeque();
+    for (;;) {
+        bool retry = false;
+        WorkUnit* workUnit = findWork(local, mWorkers.size(), &retry);
+        if (workUnit != NULL) {
+            runUnit(workUnit);
+            return true;
+        }
+        if (!retry) {
+            return false;
+        }
+    }
+}
+
+status_t WorkStealingPool::cancel() {
+    if (mFinished.load()) {
+        return INVALID_OPERATION;
+    }
+
+    // Pending units are deleted, unrun, by whoever takes them next.
+    mCanceled.store(true);
+    wakeWorkers(true);
+    return OK;
+}
+
+status_t WorkStealingPool::finish() {
+    if (mFinished.exchange(true)) {
+        return INVALID_OPERATION;
+    }
+
+    // Work through what's left alongside the workers.
+    Deque* local = getLocalDeque();
+    for (;;) {
+        bool retry = false;
+        WorkUnit* workUnit = findWork(local, mWorkers.size(), &retry);
+        if (workUnit != NULL) {
+            runUnit(workUnit);
+        } else if (!retry) {
+            break;
+        }
+    }
+    wakeWorkers(true);
+
+    // No thread can be added once mFinished is set.
+    size_t count = mWorkers.size();
+    for (size_t i = 0; i < count; i++) {
+        mWorkers[i]->join();
+    }
+
+    drainAll();
+    mDone.store(true);
+    return OK;
+}
+
+WorkStealingPool::Deque* WorkStealingPool::getLocalDeque() {
+    android_thread_id_t self = getThreadId();
+    if (self == mOwnerThreadId) {
+        return &mOwnerDeque;
+    }
+
+    size_t count = mWorkers.size();
+    for (size_t i = 0; i < count; i++) {
+        if (mWorkers[i]->mThreadId.load() == self) {
+            return &mWorkers[i]->mDeque;
+        }
+    }
+    return NULL;
+}
+
+WorkStealingPool::WorkUnit* WorkStealingPool::findWork(Deque* local, size_t index,
+        bool* pRetry) {
+    WorkUnit* workUnit = NULL;
+
+    if (local != NULL) {
+        workUnit = local->pop();
+    }
+
+    // Start with our neighbour so the thieves spread out.
+    size_t count = mWorkers.size();
+    for (size_t i = 1; workUnit == NULL && i <= count; i++) {
+        Deque* victim = &mWorkers[(index + i) % count]->mDeque;
+        if (victim != local) {
+            workUnit = victim->steal(pRetry);
+        }
+    }
+
+    if (workUnit == NULL && local != &mOwnerDeque) {
+        workUnit = mOwnerDeque.steal(pRetry);
+    }
+
+    if (workUnit == NULL && mInjectedCount.load() > 0) {
+        AutoMutex _l(mInjectLock);
+        if (!mInjected.isEmpty()) {
+            workUnit = mInjected.itemAt(0);
+            mInjected.removeAt(0);
+            mInjectedCount.fetch_sub(1);
+        }
+    }
+
+    if (workUnit != NULL) {
+        mPending.fetch_sub(1);
+    }
+    return workUnit;
+}
+
+void WorkStealingPool::runUnit(WorkUnit* workUnit) {
+    if (mCanceled.load()) {
+        delete workUnit;
+        return;
+    }
+
+    bool shouldContinue = workUnit->run();
+    delete workUnit;
+
+    if (!shouldContinue) {
+        mCanceled.store(true);
+        wakeWorkers(true);
+    }
+}
+
+/*
+ * Moving mWorkEpoch first means a worker on its way to sleep either sees
+ * the new epoch, or is already counted in mSleepers and waiting on the
+ * condition by the time we take mSleepLock.
+ */
+void WorkStealingPool::wakeWorkers(bool all) {
+    mWorkEpoch.fetch_add(1);
+    if (mSleepers.load() > 0) {
+        AutoMutex _l(mSleepLock);
+        if (all) {
+            mWorkCondition.broadcast();
+        } else {
+            mWorkCondition.signal();
+        }
+    }
+}
+
+void WorkStealingPool::drainAll() {
+    // Only called once every worker has been joined.
+    WorkUnit* workUnit;
+    while ((workUnit = mOwnerDeque.pop()) != NULL) {
+        delete workUnit;
+    }
+    size_t count = mWorkers.size();
+    for (size_t i = 0; i < count; i++) {
+        while ((workUnit = mWorkers[i]->mDeque.pop()) != NULL) {
+            delete workUnit;
+        }
+    }
+
+    AutoMutex _l(mInjectLock);
+    count = mInjected.size();
+    for (size_t i = 0; i < count; i++) {
+        delete mInjected.itemAt(i);
+    }
+    mInjected.clear();
+    mInjectedCount.store(0);
+    mPending.store(0);
+}
+
+bool WorkStealingPool::threadLoop(size_t index) {
+    WorkThread* self = mWorkers[index].get();
+    self->mThreadId.store(getThreadId());
+    Deque* local = &self->mDeque;
+
+    for (;;) {
+        unsigned long epoch = mWorkEpoch.load();
+
+        bool retry = false;
+        WorkUnit* workUnit = findWork(local, index, &retry);
+        if (workUnit != NULL) {
+            runUnit(workUnit);
+            continue;
+        }
+        if (retry) {
+            continue;
+        }
+        if (mCanceled.load() || mFinished.load()) {
+            break;
+        }
+
+        AutoMutex _l(mSleepLock);
+        mSleepers.fetch_add(1);
+        while (mWorkEpoch.load() == epoch && !mCanceled.load() && !mFinished.load()) {
+            mWorkCondition.wait(mSleepLock);
+        }
+        mSleepers.fetch_sub(1);
+    }
+    return false;
+}
+
+// --- WorkStealingPool::Deque ---
+
+WorkStealingPool::Deque::Array::Array(size_t capacity) :
+        mCapacity(capacity), mSlots(new std::atomic<WorkUnit*>[capacity]) {
+}
+
+WorkStealingPool::Deque::Array::~Array() {
+    delete[] mSlots;
+}
+
+WorkStealingPool::Deque::Deque() :
+        mTop(0), mBottom(0), mArray(new Array(64)) {
+}
+
+WorkStealingPool::Deque::~Deque() {
+    delete mArray.load();
+    size_t count = mRetired.size();
+    for (size_t i = 0; i < count; i++) {
+        delete mRetired.itemAt(i);
+    }
+}
+
+void WorkStealingPool::Deque::push(WorkUnit* workUnit) {
+    long bottom = mBottom.load(std::memory_order_relaxed);
+    long top = mTop.load(std::memory_order_acquire);
+    Array* array = mArray.load(std::memory_order_relaxed);
+    if (bottom - top > (long) array->mCapacity - 1) {
+        array = grow(array, bottom, top);
+    }
+    array->put(bottom, workUnit);
+    std::atomic_thread_fence(std::memory_order_release);
+    mBottom.store(bottom + 1, std::memory_order_relaxed);
+}
+
+WorkStealingPool::WorkUnit* WorkStealingPool::Deque::pop() {
+    long bottom = mBottom.load(std::memory_order_relaxed) - 1;
+    Array* array = mArray.load(std::memory_order_relaxed);
+    mBottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    long top = mTop.load(std::memory_order_relaxed);
+
+    WorkUnit* workUnit = NULL;
+    if (top <= bottom) {
+        workUnit = array->get(bottom);
+        if (top == bottom) {
+            // Last one; race the thieves for it.
+            if (!mTop.compare_exchange_strong(top, top + 1,
+                    std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                workUnit = NULL;
+            }
+            mBottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+    } else {
+        mBottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return workUnit;
+}
+
+WorkStealingPool::WorkUnit* WorkStealingPool::Deque::steal(bool* pRetry) {
+    long top = mTop.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    long bottom = mBottom.load(std::memory_order_acquire);
+    if (top >= bottom) {
+        return NULL;
+    }
+
+    Array* array = mArray.load(std::memory_order_acquire);
+    WorkUnit* workUnit = array->get(top);
+    if (!mTop.compare_exchange_strong(top, top + 1,
+            std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        *pRetry = true;
+        return NULL;
+    }
+    return workUnit;
+}
+
+WorkStealingPool::Deque::Array* WorkStealingPool::Deque::grow(Array* array,
+        long bottom, long top) {
+    Array* bigger = new Array(array->mCapacity * 2);
+    for (long i = top; i < bottom; i++) {
+        bigger->put(i, array->get(i));
+    }
+    mRetired.add(array);
+    mArray.store(bigger, std::memory_order_release);
+    return bigger;
+}
+
+// --- WorkStealingPool::WorkThread ---
+
+WorkStealingPool::WorkThread::WorkThread(WorkStealingPool* pool, size_t index,
+        bool canCallJava) :
+        Thread(canCallJava), mThreadId(NULL), mPool(pool), mIndex(index) {
+}
+
+WorkStealingPool::WorkThread::~WorkThread() {
+}
+
+bool WorkStealingPool::WorkThread::threadLoop() {
+    return mPool->threadLoop(mIndex);
+}
+
+};  // namespace android
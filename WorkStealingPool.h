@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AAPT_WORK_STEALING_POOL_H
+#define AAPT_WORK_STEALING_POOL_H
+
+#include <utils/Errors.h>
+#include <utils/Vector.h>
+#include <utils/threads.h>
+
+#include <atomic>
+
+#include "WorkQueue.h"
+
+namespace android {
+
+/*
+ * A work-stealing thread pool.
+ *
+ * Runs the same WorkQueue::WorkUnit objects as WorkQueue, but each thread
+ * has a deque of its own instead of all threads sharing one locked list.
+ * A thread pushes and pops work at the bottom of its own deque; idle
+ * threads steal from the top of the others'.  Nothing on that path takes
+ * a lock.  A lock is only used to put idle threads to sleep, and for work
+ * posted by threads that don't belong to the pool.
+ *
+ * The thread that creates the pool owns a deque too: it is where its work
+ * units go, and schedule() and finish() run work from it rather than just
+ * blocking.
+ */
+class WorkStealingPool {
+public:
+    typedef WorkQueue::WorkUnit WorkUnit;
+
+    /*
+     * Creates a pool with "threads" worker threads.  If "threads" is 0, the
+     * pool gets one thread per online CPU.
+     */
+    WorkStealingPool(size_t threads = 0, bool canCallJava = false);
+
+    /* Cancels pending work and waits for all remaining threads to complete. */
+    ~WorkStealingPool();
+
+    /* The number of worker threads. */
+    size_t getThreadCount() const { return mWorkers.size(); }
+
+    /* The number of online CPUs, at least 1. */
+    static size_t getCpuCount();
+
+    /*
+     * Posts a work unit to run later.  Same contract as WorkQueue::schedule():
+     * returns INVALID_OPERATION if the pool is canceled or finished, in which
+     * case the caller keeps ownership of "workUnit".
+     *
+     * If more than 'backlog' times the number of threads units are pending,
+     * the calling thread runs some of them itself before returning.  If
+     * 'backlog' is 0, no throttle is applied.
+     */
+    status_t schedule(WorkUnit* workUnit, size_t backlog = 2);
+
+    /*
+     * Runs one pending work unit on the calling thread, for threads that
+     * would otherwise sit waiting on the pool.  Returns false if there was
+     * nothing to run.
+     */
+    bool runOne();
+
+    /* Discards all pending work.  Same contract as WorkQueue::cancel(). */
+    status_t cancel();
+
+    /*
+     * Waits for all work to complete, helping with it meanwhile.  Same
+     * contract as WorkQueue::finish().
+     */
+    status_t finish();
+
+private:
+    /* these are private and not defined */
+    WorkStealingPool(const WorkStealingPool& src);
+    WorkStealingPool& operator=(const WorkStealingPool& src);
+
+    /*
+     * Chase-Lev work-stealing deque.  Only the owning thread may push() and
+     * pop(); any thread may steal().
+     */
+    class Deque {
+    public:
+        Deque();
+        ~Deque();
+
+        void push(WorkUnit* workUnit);
+        WorkUnit* pop();
+
+        /* "*pRetry" is set when we lost a race and the deque may not be empty */
+        WorkUnit* steal(bool* pRetry);
+
+    private:
+        struct Array {
+            Array(size_t capacity);
+            ~Array();
+
+            WorkUnit* get(long index) const {
+                return mSlots[index & (mCapacity - 1)].load(std::memory_order_relaxed);
+            }
+            void put(long index, WorkUnit* workUnit) {
+                mSlots[index & (mCapacity - 1)].store(workUnit, std::memory_order_relaxed);
+            }
+
+            const size_t mCapacity;     // a power of two
+            std::atomic<WorkUnit*>* mSlots;
+        };
+
+        Array* grow(Array* array, long bottom, long top);
+
+        std::atomic<long> mTop;
+        std::atomic<long> mBottom;
+        std::atomic<Array*> mArray;
+
+        /* arrays we've outgrown; a thief may still be reading one */
+        Vector<Array*> mRetired;
+    };
+
+    class WorkThread : public Thread {
+    public:
+        WorkThread(WorkStealingPool* pool, size_t index, bool canCallJava);
+        virtual ~WorkThread();
+
+        Deque mDeque;
+        std::atomic<android_thread_id_t> mThreadId;
+
+    private:
+        virtual bool threadLoop();
+
+        WorkStealingPool* const mPool;
+        const size_t mIndex;
+    };
+
+    bool threadLoop(size_t index);      // called from each work thread
+
+    /* the deque the calling thread should push to, or NULL if it has none */
+    Deque* getLocalDeque();
+
+    /* find a unit to run, from our own deque first; NULL if there's none */
+    WorkUnit* findWork(Deque* local, size_t index, bool* pRetry);
+
+    /* run (or, once canceled, discard) one unit */
+    void runUnit(WorkUnit* workUnit);
+
+    /* wake one sleeping worker, or all of them */
+    void wakeWorkers(bool all);
+    void drainAll();
+
+    const android_thread_id_t mOwnerThreadId;
+
+    Vector<sp<WorkThread> > mWorkers;
+    Deque mOwnerDeque;
+
+    /* work from threads outside the pool */
+    Mutex mInjectLock;
+    Vector<WorkUnit*> mInjected;
+    std::atomic<size_t> mInjectedCount;
+
+    std::atomic<size_t> mPending;       // scheduled, not yet taken
+    std::atomic<bool> mCanceled;
+    std::atomic<bool> mFinished;        // finish() was called
+    std::atomic<bool> mDone;            // finish() returned
+
+    /* idle workers sleep here until mWorkEpoch moves */
+    Mutex mSleepLock;
+    Condition mWorkCondition;
+    std::atomic<unsigned long> mWorkEpoch;
+    std::atomic<size_t> mSleepers;
+};
+
+}; // namespace android
+
+#endif // AAPT_WORK_STEALING_POOL_H
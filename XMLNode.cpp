@@ -5,6 +5,7 @@
 //
 
 #include "XMLNode.h"
+#include "DumpWriter.h"
 #include "ResourceTable.h"
 #include "pseudolocalize.h"
 
@@ -551,6 +552,87 @@ void printXMLBlock(ResXMLTree* block)
     block->restart();
 }
 
+/*
+ * The same as printXMLBlock(), as records: "namespace", "element" and
+ * "text" at the depth they appear, and an "attribute" for each attribute
+ * of an element, one level deeper.  Attribute names carry the namespace
+ * prefix in use, as printXMLBlock() shows them.
+ */
+void writeXMLBlock(DumpWriter* out, ResXMLTree* block)
+{
+    block->restart();
+
+    Vector<namespace_entry> namespaces;
+
+    ResXMLTree::event_code_t code;
+    int depth = 0;
+    while ((code=block->next()) != ResXMLTree::END_DOCUMENT && code != ResXMLTree::BAD_DOCUMENT) {
+        size_t len;
+        if (code == ResXMLTree::START_TAG) {
+            String8 elemNs = build_namespace(namespaces, block->getElementNamespace(&len));
+            out->begin("element", DumpWriter::STYLE_SPACED, depth);
+            out->attr("name", elemNs + String8(block->getElementName(&len)), false);
+            out->attr("line", (int32_t) block->getLineNumber());
+            const char16_t* com16 = block->getComment(&len);
+            if (com16) {
+                out->attr("comment", String8(com16), false);
+            }
+            out->end();
+
+            const int N = block->getAttributeCount();
+            depth++;
+            for (int i=0; i<N; i++) {
+                String8 ns = build_namespace(namespaces, block->getAttributeNamespace(i, &len));
+                out->begin("attribute", DumpWriter::STYLE_SPACED, depth);
+                out->attr("name", ns + String8(block->getAttributeName(i, &len)), false);
+                uint32_t res = block->getAttributeNameResID(i);
+                if (res) {
+                    out->attr("resourceId", String8::format("0x%08x", res), false);
+                }
+                Res_value value;
+                block->getAttributeValue(i, &value);
+                out->attr("type", String8::format("0x%02x", (int)value.dataType), false);
+                out->attr("data", String8::format("0x%08x", (int)value.data), false);
+                const char16_t* val = block->getAttributeStringValue(i, &len);
+                if (val != NULL) {
+                    out->attr("raw", String8(val), false);
+                }
+                out->end();
+            }
+        } else if (code == ResXMLTree::END_TAG) {
+            if (--depth < 0) {
+                break;
+            }
+        } else if (code == ResXMLTree::START_NAMESPACE) {
+            namespace_entry ns;
+            const char16_t* prefix16 = block->getNamespacePrefix(&len);
+            if (prefix16) {
+                ns.prefix = String8(prefix16);
+            } else {
+                ns.prefix = "<DEF>";
+            }
+            ns.uri = String8(block->getNamespaceUri(&len));
+            namespaces.push(ns);
+            out->begin("namespace", DumpWriter::STYLE_SPACED, depth);
+            out->attr("prefix", ns.prefix, false);
+            out->attr("uri", ns.uri, false);
+            out->end();
+            depth++;
+        } else if (code == ResXMLTree::END_NAMESPACE) {
+            if (--depth < 0 || namespaces.isEmpty()) {
+                break;
+            }
+            namespaces.pop();
+        } else if (code == ResXMLTree::TEXT) {
+            out->begin("text", DumpWriter::STYLE_SPACED, depth);
+            out->attr("value", String8(block->getText(&len)), false);
+            out->end();
+        }
+    }
+
+    block->restart();
+}
+
 status_t parseXMLResource(const sp<AaptFile>& file, ResXMLTree* outTree,
                           bool stripAll, bool keepComments,
                           const char** cDataTags)
@@ -30,7 +30,10 @@ status_t parseStyledString(Bundle* bundle,
                            bool isFormatted,
                            PseudolocalizationMethod isPseudolocalizable);
 
+class DumpWriter;
+
 void printXMLBlock(ResXMLTree* block);
+void writeXMLBlock(DumpWriter* out, ResXMLTree* block);
 
 status_t parseXMLResource(const sp<AaptFile>& file, ResXMLTree* outTree,
                           bool stripAll=true, bool keepComments=false,
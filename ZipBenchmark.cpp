@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// Times ZipFile's name lookups: adding N entries to a new archive (each
+// add looks its name up first), then finding every entry by name through
+// the hash index and through the backward strcmp() scan it replaced.
+//
+// Usage: zipbench [entries] [scratch.zip]
+//
+
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ZipEntry.h"
+#include "ZipFile.h"
+
+using namespace android;
+
+// The lookup getEntryByName() used to do.
+static ZipEntry* findLinear(const ZipFile& zip, const char* fileName)
+{
+    for (int idx = zip.getNumEntries()-1; idx >= 0; idx--) {
+        ZipEntry* pEntry = zip.getEntryByIndex(idx);
+        if (!pEntry->getDeleted() &&
+            strcmp(fileName, pEntry->getFileName()) == 0)
+        {
+            return pEntry;
+        }
+    }
+    return NULL;
+}
+
+static double elapsedMs(nsecs_t start)
+{
+    return (systemTime(SYSTEM_TIME_MONOTONIC) - start) / 1000000.0;
+}
+
+int main(int argc, char* const argv[])
+{
+    const int count = argc > 1 ? atoi(argv[1]) : 50000;
+    const char* path = argc > 2 ? argv[2] : "zipbench.zip";
+    if (count <= 0) {
+        fprintf(stderr, "Usage: zipbench [entries] [scratch.zip]\n");
+        return 2;
+    }
+
+    Vector<String8> names;
+    names.setCapacity(count);
+    for (int i = 0; i < count; i++) {
+        // Shaped like resource paths, so names share long prefixes.
+        names.add(String8::format("res/drawable-xxhdpi-v4/icon_%06d.png", i));
+    }
+
+    ZipFile zip;
+    status_t result = zip.open(path,
+            ZipFile::kOpenReadWrite | ZipFile::kOpenCreate | ZipFile::kOpenTruncate);
+    if (result != NO_ERROR) {
+        fprintf(stderr, "Unable to open '%s' (%d)\n", path, result);
+        return 1;
+    }
+
+    const char payload[] = "x";
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < count; i++) {
+        result = zip.add(payload, sizeof(payload), names[i].string(),
+                ZipEntry::kCompressStored, NULL);
+        if (result != NO_ERROR) {
+            fprintf(stderr, "Unable to add '%s' (%d)\n", names[i].string(), result);
+            return 1;
+        }
+    }
+    printf("add %d entries:        %10.1f ms\n", count, elapsedMs(start));
+
+    int misses = 0;
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < count; i++) {
+        if (zip.getEntryByName(names[i].string()) == NULL)
+            misses++;
+    }
+    printf("indexed lookups:        %10.1f ms\n", elapsedMs(start));
+
+    start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (int i = 0; i < count; i++) {
+        if (findLinear(zip, names[i].string()) == NULL)
+            misses++;
+    }
+    printf("linear lookups:         %10.1f ms\n", elapsedMs(start));
+
+    // Leave nothing behind; there's no need to write the central directory.
+    unlink(path);
+
+    if (misses != 0) {
+        fprintf(stderr, "%d lookups failed\n", misses);
+        return 1;
+    }
+    return 0;
+}
@@ -32,6 +32,12 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <assert.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
 
 using namespace android;
 
@@ -146,27 +152,12 @@ ZipEntry* ZipFile::getEntryByIndex(int idx) const
 ZipEntry* ZipFile::getEntryByName(const char* fileName) const
 {
     /*
-     * Do a stupid linear string-compare search.
-     *
-     * There are various ways to speed this up, especially since it's rare
-     * to intermingle changes to the archive with "get by name" calls.  We
-     * don't want to sort the mEntries vector itself, however, because
-     * it's used to recreate the Central Directory.
-     *
-     * (Hash table works, parallel list of pointers in sorted order is good.)
+     * We don't want to sort the mEntries vector itself, because it's used
+     * to recreate the Central Directory, so names are looked up through a
+     * hash index kept alongside it.  When a name appears more than once the
+     * index holds the last live entry, same as a backward scan would find.
      */
-    int idx;
-
-    for (idx = mEntries.size()-1; idx >= 0; idx--) {
-        ZipEntry* pEntry = mEntries[idx];
-        if (!pEntry->getDeleted() &&
-            strcmp(fileName, pEntry->getFileName()) == 0)
-        {
-            return pEntry;
-        }
-    }
-
-    return NULL;
+    return mEntryIndex.find(fileName);
 }
 
 /*
@@ -180,6 +171,8 @@ void ZipFile::discardEntries(void)
         delete mEntries[count];
 
     mEntries.clear();
+    mEntryIndex.clear();
+    mHasDuplicateNames = false;
 }
 
 
@@ -316,6 +309,8 @@ status_t ZipFile::readCentralDir(void)
         }
 
         mEntries.add(pEntry);
+        if (mEntryIndex.insert(pEntry) != NULL)
+            mHasDuplicateNames = true;
     }
 
 
@@ -355,9 +350,9 @@ bail:
  * in a temp file and then overwrite the original after everything was
  * safely written.  Not really a concern for us.
  */
-status_t ZipFile::addCommon(const char* fileName, const void* data, size_t size,
-    const char* storageName, int sourceType, int compressionMethod,
-    ZipEntry** ppEntry)
+status_t ZipFile::addCommon(const char* fileName, const DataChunk* chunks,
+    size_t numChunks, const char* storageName, int sourceType,
+    int compressionMethod, ZipEntry** ppEntry)
 {
     ZipEntry* pEntry = NULL;
     status_t result = NO_ERROR;
@@ -365,6 +360,7 @@ status_t ZipFile::addCommon(const char* fileName, const void* data, size_t size,
     FILE* inputFp = NULL;
     unsigned long crc;
     time_t modWhen = 0;
+    size_t size = 0;
 
     if (mReadOnly)
         return INVALID_OPERATION;
@@ -380,10 +376,26 @@ status_t ZipFile::addCommon(const char* fileName, const void* data, size_t size,
     if (getEntryByName(storageName) != NULL)
         return ALREADY_EXISTS;
 
-    if (!data) {
+    /*
+     * In incremental mode a new entry may go into a hole, which needs its
+     * final size before anything is written.  Take the same route as
+     * entries compressed ahead of time, so the archive comes out the same
+     * however the caller added its entries.
+     */
+    if (mIncremental && sourceType == ZipEntry::kCompressStored) {
+        PreparedEntry prepared;
+        prepare(fileName, chunks, numChunks, compressionMethod,
+            mCompressionLevel, &prepared);
+        return addPrepared(prepared, storageName, ppEntry);
+    }
+
+    if (!chunks) {
         inputFp = fopen(fileName, FILE_OPEN_RO);
         if (inputFp == NULL)
             return errnoToStatus(errno);
+    } else {
+        for (size_t i = 0; i < numChunks; i++)
+            size += chunks[i].size;
     }
 
     if (fseek(mZipFp, mEOCD.mCentralDirOffset, SEEK_SET) != 0) {
@@ -414,7 +426,8 @@ status_t ZipFile::addCommon(const char* fileName, const void* data, size_t size,
     if (sourceType == ZipEntry::kCompressStored) {
         if (compressionMethod == ZipEntry::kCompressDeflated) {
             bool failed = false;
-            result = compressFpToFp(mZipFp, inputFp, data, size, &crc);
+            result = compressFpToFp(mZipFp, inputFp, chunks, numChunks,
+                                    mCompressionLevel, &crc);
             if (result != NO_ERROR) {
                 ALOGD("compression failed, storing\n");
                 failed = true;
@@ -445,7 +458,7 @@ status_t ZipFile::addCommon(const char* fileName, const void* data, size_t size,
             if (inputFp) {
                 result = copyFpToFp(mZipFp, inputFp, &crc);
             } else {
-                result = copyDataToFp(mZipFp, data, size, &crc);
+                result = copyDataToFp(mZipFp, chunks, numChunks, &crc);
             }
             if (result != NO_ERROR) {
                 // don't need to truncate; happens in CDE rewrite
@@ -517,6 +530,7 @@ status_t ZipFile::addCommon(const char* fileName, const void* data, size_t size,
      * Add pEntry to the list.
      */
     mEntries.add(pEntry);
+    mEntryIndex.insert(pEntry);
     if (ppEntry != NULL)
         *ppEntry = pEntry;
     pEntry = NULL;
@@ -537,6 +551,30 @@ bail:
  */
 status_t ZipFile::add(const ZipFile* pSourceZip, const ZipEntry* pSourceEntry,
     int padding, ZipEntry** ppEntry)
+{
+    return addCopy(pSourceZip, pSourceEntry, padding, false, ppEntry);
+}
+
+/*
+ * Add an entry by copying its compressed data from another zip file,
+ * building fresh headers for it.
+ *
+ * If "ppEntry" is non-NULL, a pointer to the new entry will be returned.
+ */
+status_t ZipFile::addNormalized(const ZipFile* pSourceZip,
+    const ZipEntry* pSourceEntry, ZipEntry** ppEntry)
+{
+    return addCopy(pSourceZip, pSourceEntry, 0, true, ppEntry);
+}
+
+/*
+ * Common code for the two flavors of copying an entry from another zip
+ * file.  With "normalize" set, the new headers carry only what add()
+ * would have written for the same data: no timestamp, extra field,
+ * comment or data descriptor.
+ */
+status_t ZipFile::addCopy(const ZipFile* pSourceZip, const ZipEntry* pSourceEntry,
+    int padding, bool normalize, ZipEntry** ppEntry)
 {
     ZipEntry* pEntry = NULL;
     status_t result;
@@ -560,9 +598,17 @@ status_t ZipFile::add(const ZipFile* pSourceZip, const ZipEntry* pSourceEntry,
         goto bail;
     }
 
-    result = pEntry->initFromExternal(pSourceZip, pSourceEntry);
-    if (result != NO_ERROR)
-        goto bail;
+    if (normalize) {
+        pEntry->initNew(pSourceEntry->getFileName(), NULL);
+        pEntry->setDataInfo(pSourceEntry->getUncompressedLen(),
+            pSourceEntry->getCompressedLen(), pSourceEntry->getCRC32(),
+            pSourceEntry->getCompressionMethod());
+        pEntry->setModWhen(0);
+    } else {
+        result = pEntry->initFromExternal(pSourceZip, pSourceEntry);
+        if (result != NO_ERROR)
+            goto bail;
+    }
     if (padding != 0) {
         result = pEntry->addPadding(padding);
         if (result != NO_ERROR)
@@ -582,25 +628,22 @@ status_t ZipFile::add(const ZipFile* pSourceZip, const ZipEntry* pSourceEntry,
     pEntry->mLFH.write(mZipFp);
 
     /*
-     * Copy the data over.
+     * Copy the data over, as is.  The sizes and CRC in the new LFH and
+     * CDE came from the source's central directory.
      *
      * If the "has data descriptor" flag is set, we want to copy the DD
-     * fields as well.  This is a fixed-size area immediately following
+     * fields as well.  This is a small area immediately following the
+     * data.  A normalized entry doesn't have the flag, so it gets just
      * the data.
      */
-    if (fseek(pSourceZip->mZipFp, pSourceEntry->getFileOffset(), SEEK_SET) != 0)
-    {
-        result = UNKNOWN_ERROR;
-        goto bail;
-    }
-
     off_t copyLen;
-    copyLen = pSourceEntry->getCompressedLen();
-    if ((pSourceEntry->mLFH.mGPBitFlag & ZipEntry::kUsesDataDescr) != 0)
-        copyLen += ZipEntry::kDataDescriptorLen;
+    if (normalize)
+        copyLen = pSourceEntry->getCompressedLen();
+    else
+        copyLen = pSourceZip->getEntryEnd(pSourceEntry) - pSourceEntry->getFileOffset();
 
-    if (copyPartialFpToFp(mZipFp, pSourceZip->mZipFp, copyLen, NULL)
-        != NO_ERROR)
+    if (copyRawFpToFp(mZipFp, pSourceZip->mZipFp, pSourceEntry->getFileOffset(),
+            copyLen) != NO_ERROR)
     {
         ALOGW("copy of '%s' failed\n", pEntry->mCDE.mFileName);
         result = UNKNOWN_ERROR;
@@ -625,6 +668,7 @@ status_t ZipFile::add(const ZipFile* pSourceZip, const ZipEntry* pSourceEntry,
      * Add pEntry to the list.
      */
     mEntries.add(pEntry);
+    mEntryIndex.insert(pEntry);
     if (ppEntry != NULL)
         *ppEntry = pEntry;
     pEntry = NULL;
@@ -636,6 +680,204 @@ bail:
     return result;
 }
 
+/*
+ * Read and compress the data for an entry ahead of time.  This mirrors
+ * the kCompressStored source path of addCommon(), including falling back
+ * to storing when the data doesn't compress "enough".
+ *
+ * Nothing here touches a ZipFile, so it can run on any thread.
+ */
+void ZipFile::prepare(const char* fileName, const DataChunk* chunks,
+    size_t numChunks, int compressionMethod, int compressionLevel,
+    PreparedEntry* pPrepared)
+{
+    assert(compressionMethod == ZipEntry::kCompressDeflated ||
+           compressionMethod == ZipEntry::kCompressStored);
+
+    DataChunk ownedChunk = { NULL, 0 };
+    size_t size = 0;
+
+    if (!chunks) {
+        FILE* inputFp = fopen(fileName, FILE_OPEN_RO);
+        if (inputFp == NULL) {
+            pPrepared->mResult = errnoToStatus(errno);
+            return;
+        }
+
+        long fileLen = -1;
+        if (fseek(inputFp, 0, SEEK_END) == 0)
+            fileLen = ftell(inputFp);
+        if (fileLen < 0 || fseek(inputFp, 0, SEEK_SET) != 0) {
+            fclose(inputFp);
+            pPrepared->mResult = UNKNOWN_ERROR;
+            return;
+        }
+
+        /* one spare byte so that empty files still get a buffer */
+        pPrepared->mOwnedData = malloc(fileLen + 1);
+        if (pPrepared->mOwnedData == NULL) {
+            fclose(inputFp);
+            pPrepared->mResult = NO_MEMORY;
+            return;
+        }
+        if (fread(pPrepared->mOwnedData, 1, fileLen, inputFp) != (size_t) fileLen) {
+            ALOGD("short read of '%s'\n", fileName);
+            fclose(inputFp);
+            pPrepared->mResult = UNKNOWN_ERROR;
+            return;
+        }
+        fclose(inputFp);
+
+        ownedChunk.data = pPrepared->mOwnedData;
+        ownedChunk.size = fileLen;
+        chunks = &ownedChunk;
+        numChunks = 1;
+    }
+
+    for (size_t i = 0; i < numChunks; i++)
+        size += chunks[i].size;
+
+    pPrepared->mUncompressedLen = size;
+
+    if (compressionMethod == ZipEntry::kCompressDeflated) {
+        void* compressed = NULL;
+        size_t compressedLen = 0;
+        unsigned long crc;
+        status_t result = compressDataToBuffer(chunks, numChunks,
+            compressionLevel, &compressed, &compressedLen, &crc);
+        if (result != NO_ERROR) {
+            ALOGD("compression failed, storing\n");
+        } else if (compressedLen + (compressedLen / 10) > size) {
+            /* same "enough" criteria as addCommon() */
+            ALOGD("insufficient compression (src=%ld dst=%ld), storing\n",
+                (long) size, (long) compressedLen);
+            free(compressed);
+        } else {
+            DataChunk compressedChunk = { compressed, compressedLen };
+            pPrepared->mOwnedCompressed = compressed;
+            pPrepared->mChunks.add(compressedChunk);
+            pPrepared->mDataLen = compressedLen;
+            pPrepared->mCRC32 = crc;
+            pPrepared->mCompressionMethod = ZipEntry::kCompressDeflated;
+            return;
+        }
+    }
+
+    /* handle "no compression" request, or failed compression from above */
+    unsigned long crc = crc32(0L, Z_NULL, 0);
+    pPrepared->mChunks.appendArray(chunks, numChunks);
+    for (size_t i = 0; i < numChunks; i++) {
+        if (chunks[i].size > 0) {
+            crc = crc32(crc, (const unsigned char*) chunks[i].data,
+                chunks[i].size);
+        }
+    }
+    pPrepared->mDataLen = size;
+    pPrepared->mCRC32 = crc;
+    pPrepared->mCompressionMethod = ZipEntry::kCompressStored;
+}
+
+/*
+ * Append an entry set up by prepare().  Apart from where the compressed
+ * bytes come from, this does exactly what addCommon() does.
+ */
+status_t ZipFile::addPrepared(const PreparedEntry& prepared,
+    const char* storageName, ZipEntry** ppEntry)
+{
+    ZipEntry* pEntry = NULL;
+    status_t result = NO_ERROR;
+    long lfhPosn, startPosn, endPosn, holePosn;
+
+    if (mReadOnly)
+        return INVALID_OPERATION;
+
+    /* make sure we're in a reasonable state */
+    assert(mZipFp != NULL);
+    assert(mEntries.size() == mEOCD.mTotalNumEntries);
+
+    /* make sure it doesn't already exist */
+    if (getEntryByName(storageName) != NULL)
+        return ALREADY_EXISTS;
+
+    if (prepared.mResult != NO_ERROR)
+        return prepared.mResult;
+
+    pEntry = new ZipEntry;
+    pEntry->initNew(storageName, NULL);
+
+    /*
+     * We know the size up front, so in incremental mode we can drop it
+     * into a hole instead of growing the file.
+     */
+    holePosn = -1;
+    if (mIncremental) {
+        holePosn = allocSpan(ZipEntry::LocalFileHeader::kLFHLen +
+            pEntry->mLFH.mFileNameLength + pEntry->mLFH.mExtraFieldLength +
+            prepared.mDataLen);
+    }
+    if (fseek(mZipFp, holePosn >= 0 ? holePosn : (long) mEOCD.mCentralDirOffset,
+            SEEK_SET) != 0)
+    {
+        result = UNKNOWN_ERROR;
+        goto bail;
+    }
+
+    /*
+     * From here on out, failures are more interesting.
+     */
+    mNeedCDRewrite = true;
+
+    lfhPosn = ftell(mZipFp);
+    pEntry->mLFH.write(mZipFp);
+    startPosn = ftell(mZipFp);
+
+    for (size_t i = 0; i < prepared.mChunks.size(); i++) {
+        const DataChunk& chunk = prepared.mChunks[i];
+        if (chunk.size > 0 &&
+            fwrite(chunk.data, 1, chunk.size, mZipFp) != chunk.size)
+        {
+            // don't need to truncate; happens in CDE rewrite
+            ALOGD("fwrite %d bytes failed\n", (int) chunk.size);
+            result = UNKNOWN_ERROR;
+            goto bail;
+        }
+    }
+
+    endPosn = ftell(mZipFp);
+
+    pEntry->setDataInfo(prepared.mUncompressedLen, endPosn - startPosn,
+        prepared.mCRC32, prepared.mCompressionMethod);
+    pEntry->setModWhen(0);
+    pEntry->setLFHOffset(lfhPosn);
+    mEOCD.mNumEntries++;
+    mEOCD.mTotalNumEntries++;
+    mEOCD.mCentralDirSize = 0;      // mark invalid; set by flush()
+    if (holePosn < 0)
+        mEOCD.mCentralDirOffset = endPosn;
+
+    /*
+     * Go back and write the LFH.
+     */
+    if (fseek(mZipFp, lfhPosn, SEEK_SET) != 0) {
+        result = UNKNOWN_ERROR;
+        goto bail;
+    }
+    pEntry->mLFH.write(mZipFp);
+
+    /*
+     * Add pEntry to the list.
+     */
+    mEntries.add(pEntry);
+    mEntryIndex.insert(pEntry);
+    if (ppEntry != NULL)
+        *ppEntry = pEntry;
+    pEntry = NULL;
+
+bail:
+    delete pEntry;
+    return result;
+}
+
 /*
  * Copy all of the bytes in "src" to "dst".
  *
@@ -668,19 +910,23 @@ status_t ZipFile::copyFpToFp(FILE* dstFp, FILE* srcFp, unsigned long* pCRC32)
 }
 
 /*
- * Copy all of the bytes in "src" to "dst".
+ * Copy all of the bytes in "chunks" to "dst", one chunk after another.
  *
  * On exit, "dstFp" will be seeked immediately past the data.
  */
-status_t ZipFile::copyDataToFp(FILE* dstFp,
-    const void* data, size_t size, unsigned long* pCRC32)
+status_t ZipFile::copyDataToFp(FILE* dstFp, const DataChunk* chunks,
+    size_t numChunks, unsigned long* pCRC32)
 {
     *pCRC32 = crc32(0L, Z_NULL, 0);
-    if (size > 0) {
-        *pCRC32 = crc32(*pCRC32, (const unsigned char*)data, size);
-        if (fwrite(data, 1, size, dstFp) != size) {
-            ALOGD("fwrite %d bytes failed\n", (int) size);
-            return UNKNOWN_ERROR;
+    for (size_t i = 0; i < numChunks; i++) {
+        const void* data = chunks[i].data;
+        size_t size = chunks[i].size;
+        if (size > 0) {
+            *pCRC32 = crc32(*pCRC32, (const unsigned char*)data, size);
+            if (fwrite(data, 1, size, dstFp) != size) {
+                ALOGD("fwrite %d bytes failed\n", (int) size);
+                return UNKNOWN_ERROR;
+            }
         }
     }
 
@@ -732,13 +978,49 @@ status_t ZipFile::copyPartialFpToFp(FILE* dstFp, FILE* srcFp, long length,
 }
 
 /*
- * Compress all of the data in "srcFp" and write it to "dstFp".
+ * Destination for deflated output: either a stdio stream, or a malloc()ed
+ * buffer that grows as needed.
+ */
+struct DeflateSink {
+    DeflateSink(FILE* fp) : mFp(fp), mBuf(NULL), mLen(0), mCapacity(0) {}
+
+    bool write(const unsigned char* data, size_t len) {
+        if (mFp != NULL)
+            return fwrite(data, 1, len, mFp) == len;
+
+        if (mLen + len > mCapacity) {
+            size_t newCapacity = mCapacity ? mCapacity * 2 : 32768;
+            while (newCapacity < mLen + len)
+                newCapacity *= 2;
+            unsigned char* newBuf = (unsigned char*) realloc(mBuf, newCapacity);
+            if (newBuf == NULL)
+                return false;
+            mBuf = newBuf;
+            mCapacity = newCapacity;
+        }
+        memcpy(mBuf + mLen, data, len);
+        mLen += len;
+        return true;
+    }
+
+    FILE*           mFp;
+    unsigned char*  mBuf;
+    size_t          mLen;
+    size_t          mCapacity;
+};
+
+/*
+ * Compress all of the data in "srcFp" (or "chunks", if set) and hand it
+ * to "sink".  Both the stream and the buffer variants go through here, so
+ * they produce exactly the same bytes.  Chunks are gathered into the same
+ * full-sized input reads a single buffer would get, so how the data is
+ * split up doesn't change the output either.
  *
- * On exit, "srcFp" will be seeked to the end of the file, and "dstFp"
- * will be seeked immediately past the compressed data.
+ * On exit, "srcFp" will be seeked to the end of the file.
  */
-status_t ZipFile::compressFpToFp(FILE* dstFp, FILE* srcFp,
-    const void* data, size_t size, unsigned long* pCRC32)
+static status_t deflateToSink(DeflateSink* sink, FILE* srcFp,
+    const ZipFile::DataChunk* chunks, size_t numChunks, int level,
+    unsigned long* pCRC32)
 {
     status_t result = NO_ERROR;
     const size_t kBufSize = 32768;
@@ -746,6 +1028,7 @@ status_t ZipFile::compressFpToFp(FILE* dstFp, FILE* srcFp,
     unsigned char* outBuf = NULL;
     z_stream zstream;
     bool atEof = false;     // no feof() aviailable yet
+    size_t chunkPos = 0;    // bytes of "*chunks" already consumed
     unsigned long crc;
     int zerr;
 
@@ -772,7 +1055,7 @@ status_t ZipFile::compressFpToFp(FILE* dstFp, FILE* srcFp,
     zstream.avail_out = kBufSize;
     zstream.data_type = Z_UNKNOWN;
 
-    zerr = deflateInit2(&zstream, Z_BEST_COMPRESSION,
+    zerr = deflateInit2(&zstream, level,
         Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY);
     if (zerr != Z_OK) {
         result = UNKNOWN_ERROR;
@@ -797,11 +1080,24 @@ status_t ZipFile::compressFpToFp(FILE* dstFp, FILE* srcFp,
         /* only read if the input buffer is empty */
         if (zstream.avail_in == 0 && !atEof) {
             ALOGV("+++ reading %d bytes\n", (int)kBufSize);
-            if (data) {
-                getSize = size > kBufSize ? kBufSize : size;
-                memcpy(inBuf, data, getSize);
-                data = ((const char*)data) + getSize;
-                size -= getSize;
+            if (chunks) {
+                getSize = 0;
+                while (getSize < kBufSize && numChunks > 0) {
+                    size_t count = chunks->size - chunkPos;
+                    if (count > kBufSize - getSize)
+                        count = kBufSize - getSize;
+                    if (count > 0) {
+                        memcpy(inBuf + getSize,
+                            ((const char*)chunks->data) + chunkPos, count);
+                    }
+                    getSize += count;
+                    chunkPos += count;
+                    if (chunkPos == chunks->size) {
+                        chunks++;
+                        numChunks--;
+                        chunkPos = 0;
+                    }
+                }
             } else {
                 getSize = fread(inBuf, 1, kBufSize, srcFp);
                 if (ferror(srcFp)) {
@@ -838,11 +1134,10 @@ status_t ZipFile::compressFpToFp(FILE* dstFp, FILE* srcFp,
             (zerr == Z_STREAM_END && zstream.avail_out != (uInt) kBufSize))
         {
             ALOGV("+++ writing %d bytes\n", (int) (zstream.next_out - outBuf));
-            if (fwrite(outBuf, 1, zstream.next_out - outBuf, dstFp) !=
-                (size_t)(zstream.next_out - outBuf))
-            {
+            if (!sink->write(outBuf, zstream.next_out - outBuf)) {
                 ALOGD("write %d failed in deflate\n",
                     (int) (zstream.next_out - outBuf));
+                result = UNKNOWN_ERROR;
                 goto z_bail;
             }
 
@@ -865,12 +1160,109 @@ bail:
     return result;
 }
 
+/*
+ * Copy "length" bytes starting at "srcOffset" in "srcFp" to the current
+ * position of "dstFp", without looking at them.  Where the kernel can
+ * copy between files for us, the data never passes through a user-space
+ * buffer; otherwise we fall back to copyPartialFpToFp().
+ *
+ * On exit, "dstFp" will be seeked immediately past the data.  The
+ * position of "srcFp" is undefined.
+ */
+status_t ZipFile::copyRawFpToFp(FILE* dstFp, FILE* srcFp, off_t srcOffset,
+    off_t length)
+{
+#if defined(__linux__)
+    /* get anything stdio is holding for "dstFp" out of the way */
+    if (fflush(dstFp) != 0)
+        return UNKNOWN_ERROR;
+
+    int srcFd = fileno(srcFp);
+    int dstFd = fileno(dstFp);
+    off_t dstOffset = ftell(dstFp);
+    off_t remaining = length;
+
+#if defined(__NR_copy_file_range)
+    /* copy_file_range() can share or clone blocks on some filesystems */
+    while (remaining > 0) {
+        loff_t inOff = srcOffset;
+        loff_t outOff = dstOffset;
+        ssize_t actual = syscall(__NR_copy_file_range, srcFd, &inOff,
+            dstFd, &outOff, (size_t) remaining, 0);
+        if (actual <= 0)
+            break;          // not supported here; try something else
+        srcOffset += actual;
+        dstOffset += actual;
+        remaining -= actual;
+    }
+#endif
+
+    /* sendfile() leaves the file offset of "srcFd" alone */
+    if (remaining > 0 && lseek(dstFd, dstOffset, SEEK_SET) == dstOffset) {
+        while (remaining > 0) {
+            ssize_t actual = sendfile(dstFd, srcFd, &srcOffset, (size_t) remaining);
+            if (actual <= 0)
+                break;
+            dstOffset += actual;
+            remaining -= actual;
+        }
+    }
+
+    if (fseek(dstFp, dstOffset, SEEK_SET) != 0)
+        return UNKNOWN_ERROR;
+    if (remaining == 0)
+        return NO_ERROR;
+    length = remaining;
+#endif
+
+    if (fseek(srcFp, srcOffset, SEEK_SET) != 0)
+        return UNKNOWN_ERROR;
+    return copyPartialFpToFp(dstFp, srcFp, length, NULL);
+}
+
+/*
+ * Compress all of the data in "srcFp" and write it to "dstFp".
+ *
+ * On exit, "srcFp" will be seeked to the end of the file, and "dstFp"
+ * will be seeked immediately past the compressed data.
+ */
+status_t ZipFile::compressFpToFp(FILE* dstFp, FILE* srcFp,
+    const DataChunk* chunks, size_t numChunks, int level,
+    unsigned long* pCRC32)
+{
+    DeflateSink sink(dstFp);
+    return deflateToSink(&sink, srcFp, chunks, numChunks, level, pCRC32);
+}
+
+/*
+ * Compress all of "data" into a buffer allocated with malloc().  On
+ * success the caller owns "*pBuf".
+ */
+status_t ZipFile::compressDataToBuffer(const DataChunk* chunks,
+    size_t numChunks, int level, void** pBuf, size_t* pBufLen,
+    unsigned long* pCRC32)
+{
+    DeflateSink sink(NULL);
+    status_t result = deflateToSink(&sink, NULL, chunks, numChunks, level,
+        pCRC32);
+    if (result != NO_ERROR) {
+        free(sink.mBuf);
+        return result;
+    }
+
+    *pBuf = sink.mBuf;
+    *pBufLen = sink.mLen;
+    return NO_ERROR;
+}
+
 /*
  * Mark an entry as deleted.
  *
  * We will eventually need to crunch the file down, but if several files
  * are being removed (perhaps as part of an "update" process) we can make
  * things considerably faster by deferring the removal to "flush" time.
+ *
+ * In incremental mode the entry's space goes straight to the free list.
  */
 status_t ZipFile::remove(ZipEntry* pEntry)
 {
@@ -879,9 +1271,28 @@ status_t ZipFile::remove(ZipEntry* pEntry)
      * not some stray ZipEntry from a different file.
      */
 
+    if (mIncremental && !pEntry->getDeleted()) {
+        long start = pEntry->getLFHOffset();
+        releaseSpan(start, getEntryEnd(pEntry) - start);
+    }
+
     /* mark entry as deleted, and mark archive as dirty */
     pEntry->setDeleted();
     mNeedCDRewrite = true;
+    mEntryIndex.erase(pEntry);
+
+    /* an older entry with the same name is visible again */
+    if (mHasDuplicateNames) {
+        for (int idx = mEntries.size()-1; idx >= 0; idx--) {
+            ZipEntry* pOther = mEntries[idx];
+            if (!pOther->getDeleted() &&
+                strcmp(pEntry->getFileName(), pOther->getFileName()) == 0)
+            {
+                mEntryIndex.insert(pOther);
+                break;
+            }
+        }
+    }
     return NO_ERROR;
 }
 
@@ -889,7 +1300,9 @@ status_t ZipFile::remove(ZipEntry* pEntry)
  * Flush any pending writes.
  *
  * In particular, this will crunch out deleted entries, and write the
- * Central Directory and EOCD if we have stomped on them.
+ * Central Directory and EOCD if we have stomped on them.  In incremental
+ * mode deleted entries just leave holes, unless there are enough of them
+ * to be worth compacting the archive.
  */
 status_t ZipFile::flush(void)
 {
@@ -904,7 +1317,16 @@ status_t ZipFile::flush(void)
 
     assert(mZipFp != NULL);
 
-    result = crunchArchive();
+    if (mIncremental) {
+        dropDeletedEntries();
+        if (mFreeBytes > mMaxFreeRatio * mEOCD.mCentralDirOffset) {
+            ALOGV("compacting: %ld of %ld bytes free\n", mFreeBytes,
+                (long) mEOCD.mCentralDirOffset);
+            result = compactArchive();
+        }
+    } else {
+        result = crunchArchive();
+    }
     if (result != NO_ERROR)
         return result;
 
@@ -1092,6 +1514,231 @@ status_t ZipFile::filemove(FILE* fp, off_t dst, off_t src, size_t n)
     return NO_ERROR;
 }
 
+/*
+ * Order entries by where their data lives in the file.
+ */
+static int compareLFHOffset(ZipEntry* const* lhs, ZipEntry* const* rhs)
+{
+    if ((*lhs)->getLFHOffset() < (*rhs)->getLFHOffset())
+        return -1;
+    if ((*lhs)->getLFHOffset() > (*rhs)->getLFHOffset())
+        return 1;
+    return 0;
+}
+
+/*
+ * Turn on incremental updates.  An archive written this way before may
+ * already have holes in it, so rebuild the free list from the gaps
+ * between the entries we just read.
+ */
+void ZipFile::setIncremental(double maxFreeRatio)
+{
+    assert(!mReadOnly);
+
+    mIncremental = true;
+    mMaxFreeRatio = maxFreeRatio;
+    mFreeSpans.clear();
+    mFreeBytes = 0;
+
+    Vector<ZipEntry*> sorted;
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        if (!mEntries[i]->getDeleted())
+            sorted.add(mEntries[i]);
+    }
+    if (sorted.size() == 0)
+        return;
+    sorted.sort(compareLFHOffset);
+
+    /* anything ahead of the first entry isn't ours to reuse */
+    long posn = sorted[0]->getLFHOffset();
+    for (size_t i = 0; i < sorted.size(); i++) {
+        ZipEntry* pEntry = sorted[i];
+        if (pEntry->getLFHOffset() > posn)
+            releaseSpan(posn, pEntry->getLFHOffset() - posn);
+        long end = getEntryEnd(pEntry);
+        if (end > posn)
+            posn = end;
+    }
+    if (posn < (long) mEOCD.mCentralDirOffset)
+        releaseSpan(posn, mEOCD.mCentralDirOffset - posn);
+}
+
+/*
+ * Find the end of an entry's data.  If there's a data descriptor, we
+ * have to look at it to see whether it has the (optional) signature.
+ */
+long ZipFile::getEntryEnd(const ZipEntry* pEntry) const
+{
+    long end = pEntry->getFileOffset() + pEntry->getCompressedLen();
+
+    if ((pEntry->mLFH.mGPBitFlag & ZipEntry::kUsesDataDescr) != 0) {
+        unsigned char buf[4];
+
+        if (fseek(mZipFp, end, SEEK_SET) == 0 &&
+            fread(buf, 1, sizeof(buf), mZipFp) == sizeof(buf) &&
+            ZipEntry::getLongLE(buf) == 0x08074b50)
+        {
+            end += ZipEntry::kDataDescriptorLen;
+        } else {
+            end += ZipEntry::kDataDescriptorLen - 4;
+        }
+    }
+    return end;
+}
+
+/*
+ * Give a range of the file back to the free list.  Space that ends at
+ * the central directory just moves the directory down, so new entries
+ * appended at the end land there.
+ */
+void ZipFile::releaseSpan(long offset, long length)
+{
+    if (length <= 0)
+        return;
+
+    /* find the first span after this one */
+    size_t idx = 0;
+    while (idx < mFreeSpans.size() && mFreeSpans[idx].mOffset < offset)
+        idx++;
+
+    /* merge with the neighbours */
+    if (idx > 0) {
+        FreeSpan& prev = mFreeSpans.editItemAt(idx-1);
+        if (prev.mOffset + prev.mLength == offset) {
+            offset = prev.mOffset;
+            length += prev.mLength;
+            mFreeBytes -= prev.mLength;
+            mFreeSpans.removeAt(--idx);
+        }
+    }
+    if (idx < mFreeSpans.size()) {
+        const FreeSpan& next = mFreeSpans[idx];
+        if (offset + length == next.mOffset) {
+            length += next.mLength;
+            mFreeBytes -= next.mLength;
+            mFreeSpans.removeAt(idx);
+        }
+    }
+
+    if (offset + length == (long) mEOCD.mCentralDirOffset) {
+        mEOCD.mCentralDirOffset = offset;
+        mEOCD.mCentralDirSize = 0;      // mark invalid; set by flush()
+        return;
+    }
+
+    FreeSpan span;
+    span.mOffset = offset;
+    span.mLength = length;
+    mFreeSpans.insertAt(span, idx);
+    mFreeBytes += length;
+}
+
+/*
+ * Take "length" bytes from the smallest hole they fit in.  Returns the
+ * offset, or -1 if no hole is big enough.
+ */
+long ZipFile::allocSpan(long length)
+{
+    ssize_t best = -1;
+    for (size_t i = 0; i < mFreeSpans.size(); i++) {
+        const FreeSpan& span = mFreeSpans[i];
+        if (span.mLength >= length &&
+            (best < 0 || span.mLength < mFreeSpans[best].mLength))
+        {
+            best = i;
+            if (span.mLength == length)
+                break;
+        }
+    }
+    if (best < 0)
+        return -1;
+
+    FreeSpan& span = mFreeSpans.editItemAt(best);
+    long offset = span.mOffset;
+    span.mOffset += length;
+    span.mLength -= length;
+    mFreeBytes -= length;
+    if (span.mLength == 0)
+        mFreeSpans.removeAt(best);
+    return offset;
+}
+
+/*
+ * Forget about deleted entries without touching the file.  Their space
+ * was already handed to the free list by remove().
+ */
+void ZipFile::dropDeletedEntries(void)
+{
+    long delCount = 0;
+
+    for (int i = mEntries.size()-1; i >= 0; i--) {
+        ZipEntry* pEntry = mEntries[i];
+        if (pEntry->getDeleted()) {
+            delete pEntry;
+            mEntries.removeAt(i);
+            delCount++;
+        }
+    }
+
+    mEOCD.mNumEntries -= delCount;
+    mEOCD.mTotalNumEntries -= delCount;
+    mEOCD.mCentralDirSize = 0;  // mark invalid; set by flush()
+}
+
+/*
+ * Slide the live entries, in file order, down over the holes.  The file
+ * is rewritten where it is, so it keeps its mode and any other links to
+ * it.  Neighbouring entries are moved in a single run, so this is one
+ * filemove() per run of entries rather than one per entry.  Like
+ * crunchArchive(), a failure part way through leaves the archive
+ * unusable until it is rebuilt.
+ */
+status_t ZipFile::compactArchive(void)
+{
+    Vector<ZipEntry*> sorted;
+    long dstPosn = 0;
+
+    for (size_t i = 0; i < mEntries.size(); i++)
+        sorted.add(mEntries[i]);
+    sorted.sort(compareLFHOffset);
+
+    for (size_t i = 0; i < sorted.size(); ) {
+        long runStart = sorted[i]->getLFHOffset();
+        long runEnd = getEntryEnd(sorted[i]);
+        size_t runCount = 1;
+
+        /* extend the run while the next entry starts where this one ends */
+        while (i + runCount < sorted.size() &&
+               sorted[i + runCount]->getLFHOffset() == runEnd)
+        {
+            runEnd = getEntryEnd(sorted[i + runCount]);
+            runCount++;
+        }
+
+        /* entries only ever move toward the start of the file */
+        assert(dstPosn <= runStart);
+        status_t result = filemove(mZipFp, dstPosn, runStart, runEnd - runStart);
+        if (result != NO_ERROR) {
+            ALOGD("failed moving entries at %ld to %ld\n", runStart, dstPosn);
+            return result;
+        }
+
+        for (size_t j = 0; j < runCount; j++) {
+            ZipEntry* pEntry = sorted[i + j];
+            pEntry->setLFHOffset(dstPosn + (pEntry->getLFHOffset() - runStart));
+        }
+        dstPosn += runEnd - runStart;
+        i += runCount;
+    }
+
+    /* flush() writes the central directory here and truncates after it */
+    mEOCD.mCentralDirOffset = dstPosn;
+    mEOCD.mCentralDirSize = 0;  // mark invalid; set by flush()
+    mFreeSpans.clear();
+    mFreeBytes = 0;
+    return NO_ERROR;
+}
+
 
 /*
  * Get the modification time from a file descriptor.
@@ -1202,6 +1849,152 @@ bail:
 }
 
 
+/*
+ * ===========================================================================
+ *      ZipFile::EntryIndex
+ * ===========================================================================
+ */
+
+// djb2; names in an archive are short and mostly distinct
+unsigned int ZipFile::EntryIndex::hashName(const char* fileName)
+{
+    unsigned int hash = 5381;
+    int c;
+
+    while ((c = (unsigned char) *fileName++) != 0)
+        hash = ((hash << 5) + hash) + c;    /* hash * 33 + c */
+
+    return hash;
+}
+
+/*
+ * Find the live entry called "fileName".  Returns NULL if there isn't one.
+ */
+ZipEntry* ZipFile::EntryIndex::find(const char* fileName) const
+{
+    if (mCount == 0)
+        return NULL;
+
+    const unsigned int hash = hashName(fileName);
+    const size_t mask = mCapacity - 1;
+
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+        const Slot& slot = mSlots[i];
+        if (slot.mEntry == NULL) {
+            if (!slot.mErased)
+                return NULL;
+        } else if (slot.mHash == hash &&
+                   strcmp(fileName, slot.mEntry->getFileName()) == 0) {
+            return slot.mEntry;
+        }
+    }
+}
+
+ZipEntry* ZipFile::EntryIndex::insert(ZipEntry* pEntry)
+{
+    /* keep the table at most 3/4 full, counting tombstones */
+    if ((mUsed + 1) * 4 > mCapacity * 3) {
+        size_t newCapacity = mCapacity ? mCapacity : 64;
+        while ((mCount + 1) * 2 > newCapacity)
+            newCapacity *= 2;
+        rehash(newCapacity);
+    }
+
+    const char* fileName = pEntry->getFileName();
+    const unsigned int hash = hashName(fileName);
+    const size_t mask = mCapacity - 1;
+    Slot* pTombstone = NULL;
+
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+        Slot& slot = mSlots[i];
+        if (slot.mEntry == NULL) {
+            if (slot.mErased) {
+                if (pTombstone == NULL)
+                    pTombstone = &slot;
+                continue;
+            }
+            Slot* pSlot = &slot;
+            if (pTombstone != NULL) {
+                pSlot = pTombstone;
+            } else {
+                mUsed++;
+            }
+            pSlot->mEntry = pEntry;
+            pSlot->mHash = hash;
+            pSlot->mErased = false;
+            mCount++;
+            return NULL;
+        }
+        if (slot.mHash == hash &&
+            strcmp(fileName, slot.mEntry->getFileName()) == 0) {
+            ZipEntry* pOld = slot.mEntry;
+            slot.mEntry = pEntry;
+            return pOld;
+        }
+    }
+}
+
+/*
+ * Drop "pEntry" from the index.  Does nothing if it isn't the entry
+ * currently indexed under its name.
+ */
+void ZipFile::EntryIndex::erase(const ZipEntry* pEntry)
+{
+    if (mCount == 0)
+        return;
+
+    const unsigned int hash = hashName(pEntry->getFileName());
+    const size_t mask = mCapacity - 1;
+
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+        Slot& slot = mSlots[i];
+        if (slot.mEntry == pEntry) {
+            slot.mEntry = NULL;
+            slot.mErased = true;
+            mCount--;
+            return;
+        }
+        if (slot.mEntry == NULL && !slot.mErased)
+            return;
+    }
+}
+
+void ZipFile::EntryIndex::clear(void)
+{
+    delete[] mSlots;
+    mSlots = NULL;
+    mCapacity = mCount = mUsed = 0;
+}
+
+/*
+ * Move the live entries into a table of "newCapacity" slots, dropping
+ * the tombstones.
+ */
+void ZipFile::EntryIndex::rehash(size_t newCapacity)
+{
+    Slot* oldSlots = mSlots;
+    const size_t oldCapacity = mCapacity;
+
+    mSlots = new Slot[newCapacity];
+    memset(mSlots, 0, newCapacity * sizeof(Slot));
+    mCapacity = newCapacity;
+    mUsed = mCount;
+
+    const size_t mask = mCapacity - 1;
+    for (size_t j = 0; j < oldCapacity; j++) {
+        const Slot& old = oldSlots[j];
+        if (old.mEntry == NULL)
+            continue;
+        size_t i = old.mHash & mask;
+        while (mSlots[i].mEntry != NULL)
+            i = (i + 1) & mask;
+        mSlots[i] = old;
+    }
+
+    delete[] oldSlots;
+}
+
+
 /*
  * ===========================================================================
  *      ZipFile::EndOfCentralDir
@@ -24,6 +24,7 @@
 #include <utils/Vector.h>
 #include <utils/Errors.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "ZipEntry.h"
 
@@ -44,7 +45,9 @@ namespace android {
 class ZipFile {
 public:
     ZipFile(void)
-      : mZipFp(NULL), mReadOnly(false), mNeedCDRewrite(false)
+      : mZipFp(NULL), mReadOnly(false), mNeedCDRewrite(false),
+        mHasDuplicateNames(false), mCompressionLevel(kDefaultCompressionLevel),
+        mIncremental(false), mMaxFreeRatio(0.0), mFreeBytes(0)
       {}
     ~ZipFile(void) {
         if (!mReadOnly)
@@ -65,6 +68,39 @@ public:
     };
     status_t open(const char* zipFileName, int flags);
 
+    /*
+     * The zlib level (0-9) used to deflate entries added from here on.
+     * The default is the best (and slowest) compression.  Level 0 only
+     * writes stored deflate blocks, which never compress "enough", so
+     * entries that would be deflated end up stored instead.
+     */
+    enum {
+        kDefaultCompressionLevel = 9,   // Z_BEST_COMPRESSION
+    };
+    void setCompressionLevel(int level) { mCompressionLevel = level; }
+    int getCompressionLevel(void) const { return mCompressionLevel; }
+
+    /*
+     * Switch a read-write archive to incremental updates.  Removed entries
+     * are no longer crunched out by flush(); their space is kept in a free
+     * list and reused by later entries that fit.  Once free space is more
+     * than "maxFreeRatio" of the archive, flush() compacts it by sliding
+     * the live entries down over the holes, in place.
+     *
+     * Call this right after open().
+     */
+    void setIncremental(double maxFreeRatio);
+
+    /*
+     * One piece of the data for an entry.  An entry can be added from a
+     * list of these, taken in order, so data that was built up in pieces
+     * never has to be copied into one buffer first.
+     */
+    struct DataChunk {
+        const void*     data;
+        size_t          size;
+    };
+
     /*
      * Add a file to the end of the archive.  Specify whether you want the
      * library to try to store it compressed.
@@ -111,7 +147,20 @@ public:
     status_t add(const void* data, size_t size, const char* storageName,
         int compressionMethod, ZipEntry** ppEntry)
     {
-        return addCommon(NULL, data, size, storageName,
+        DataChunk chunk = { data, size };
+        return add(&chunk, 1, storageName, compressionMethod, ppEntry);
+    }
+
+    /*
+     * Add a file from a list of in-memory chunks, which are stored
+     * back-to-back as a single entry.
+     *
+     * If "ppEntry" is non-NULL, a pointer to the new entry will be returned.
+     */
+    status_t add(const DataChunk* chunks, size_t numChunks,
+        const char* storageName, int compressionMethod, ZipEntry** ppEntry)
+    {
+        return addCommon(NULL, chunks, numChunks, storageName,
                          ZipEntry::kCompressStored,
                          compressionMethod, ppEntry);
     }
@@ -126,6 +175,82 @@ public:
     status_t add(const ZipFile* pSourceZip, const ZipEntry* pSourceEntry,
         int padding, ZipEntry** ppEntry);
 
+    /*
+     * Add an entry by copying its compressed data from another zip file,
+     * without recompressing it.  Unlike add(), the headers aren't copied:
+     * they are built the way add() builds them for new data, so the
+     * timestamp, extra field, comment and data descriptor of the source
+     * entry are dropped.
+     *
+     * If "ppEntry" is non-NULL, a pointer to the new entry will be returned.
+     */
+    status_t addNormalized(const ZipFile* pSourceZip,
+        const ZipEntry* pSourceEntry, ZipEntry** ppEntry);
+
+    /*
+     * File data that has been read and compressed ahead of time by
+     * prepare(), so that the deflate work can happen on another thread
+     * and adding the entry only has to append the finished bytes.
+     */
+    class PreparedEntry {
+    public:
+        PreparedEntry(void)
+          : mResult(NO_ERROR), mCompressionMethod(ZipEntry::kCompressStored),
+            mDataLen(0), mUncompressedLen(0), mCRC32(0),
+            mOwnedData(NULL), mOwnedCompressed(NULL)
+          {}
+        ~PreparedEntry(void) {
+            free(mOwnedData);
+            free(mOwnedCompressed);
+        }
+
+        status_t getResult(void) const { return mResult; }
+
+    private:
+        friend class ZipFile;
+
+        /* these are private and not defined */
+        PreparedEntry(const PreparedEntry& src);
+        PreparedEntry& operator=(const PreparedEntry& src);
+
+        status_t        mResult;
+        int             mCompressionMethod;     // what we ended up using
+        Vector<DataChunk> mChunks;              // bytes to store in the archive
+        size_t          mDataLen;
+        long            mUncompressedLen;
+        unsigned long   mCRC32;
+        void*           mOwnedData;             // file contents we read in
+        void*           mOwnedCompressed;       // deflated copy, if kept
+    };
+
+    /*
+     * Read (if "fileName" is set) and compress the data for an entry,
+     * without touching any archive.  Applies the same rules as add(), so
+     * an entry added through addPrepared() is byte-for-byte the same as
+     * one added directly.  "data" (or "chunks") must stay valid until
+     * addPrepared().
+     *
+     * This is safe to call from several threads at once.
+     */
+    static void prepare(const char* fileName, const void* data, size_t size,
+        int compressionMethod, int compressionLevel, PreparedEntry* pPrepared)
+    {
+        DataChunk chunk = { data, size };
+        prepare(fileName, data ? &chunk : NULL, data ? 1 : 0,
+            compressionMethod, compressionLevel, pPrepared);
+    }
+    static void prepare(const char* fileName, const DataChunk* chunks,
+        size_t numChunks, int compressionMethod, int compressionLevel,
+        PreparedEntry* pPrepared);
+
+    /*
+     * Add an entry from data set up by prepare().
+     *
+     * If "ppEntry" is non-NULL, a pointer to the new entry will be returned.
+     */
+    status_t addPrepared(const PreparedEntry& prepared, const char* storageName,
+        ZipEntry** ppEntry);
+
     /*
      * Mark an entry as having been removed.  It is not actually deleted
      * from the archive or our internal data structures until flush() is
@@ -210,6 +335,46 @@ private:
         void dump(void) const;
     };
 
+    /*
+     * Open-addressing hash index from file name to the live (not deleted)
+     * entry with that name.  It doesn't own the entries; ZipFile keeps it
+     * in step with mEntries so name lookups don't scan the whole archive.
+     */
+    class EntryIndex {
+    public:
+        EntryIndex(void) : mSlots(NULL), mCapacity(0), mCount(0), mUsed(0) {}
+        ~EntryIndex(void) { delete[] mSlots; }
+
+        ZipEntry* find(const char* fileName) const;
+
+        /*
+         * Index "pEntry" under its name.  If another entry already had that
+         * name it is replaced, and returned so the caller knows.
+         */
+        ZipEntry* insert(ZipEntry* pEntry);
+        void erase(const ZipEntry* pEntry);
+        void clear(void);
+
+    private:
+        /* these are private and not defined */
+        EntryIndex(const EntryIndex& src);
+        EntryIndex& operator=(const EntryIndex& src);
+
+        struct Slot {
+            ZipEntry*       mEntry;     // NULL if empty or erased
+            unsigned int    mHash;
+            bool            mErased;    // tombstone, keeps probe chains intact
+        };
+
+        static unsigned int hashName(const char* fileName);
+        void rehash(size_t newCapacity);
+
+        Slot*   mSlots;
+        size_t  mCapacity;              // zero or a power of two
+        size_t  mCount;                 // live entries
+        size_t  mUsed;                  // live entries plus tombstones
+    };
+
 
     /* read all entries in the central dir */
     status_t readCentralDir(void);
@@ -217,27 +382,49 @@ private:
     /* crunch deleted entries out */
     status_t crunchArchive(void);
 
+    /* incremental mode: drop deleted entries, leaving holes */
+    void dropDeletedEntries(void);
+    /* incremental mode: slide live entries down over the holes */
+    status_t compactArchive(void);
+    /* offset just past the data (and data descriptor) of "pEntry" */
+    long getEntryEnd(const ZipEntry* pEntry) const;
+    /* free list upkeep */
+    void releaseSpan(long offset, long length);
+    long allocSpan(long length);
+
     /* clean up mEntries */
     void discardEntries(void);
 
     /* common handler for all "add" functions */
-    status_t addCommon(const char* fileName, const void* data, size_t size,
-        const char* storageName, int sourceType, int compressionMethod,
+    status_t addCommon(const char* fileName, const DataChunk* chunks,
+        size_t numChunks, const char* storageName, int sourceType, int compressionMethod,
         ZipEntry** ppEntry);
 
+    /* common handler for add() and addNormalized() from another zip */
+    status_t addCopy(const ZipFile* pSourceZip, const ZipEntry* pSourceEntry,
+        int padding, bool normalize, ZipEntry** ppEntry);
+
     /* copy all of "srcFp" into "dstFp" */
     status_t copyFpToFp(FILE* dstFp, FILE* srcFp, unsigned long* pCRC32);
-    /* copy all of "data" into "dstFp" */
-    status_t copyDataToFp(FILE* dstFp,
-        const void* data, size_t size, unsigned long* pCRC32);
+    /* copy all of "chunks" into "dstFp" */
+    status_t copyDataToFp(FILE* dstFp, const DataChunk* chunks,
+        size_t numChunks, unsigned long* pCRC32);
     /* copy some of "srcFp" into "dstFp" */
     status_t copyPartialFpToFp(FILE* dstFp, FILE* srcFp, long length,
         unsigned long* pCRC32);
+    /* copy part of "srcFp" into "dstFp" without a user-space buffer */
+    status_t copyRawFpToFp(FILE* dstFp, FILE* srcFp, off_t srcOffset,
+        off_t length);
     /* like memmove(), but on parts of a single file */
     status_t filemove(FILE* fp, off_t dest, off_t src, size_t n);
     /* compress all of "srcFp" into "dstFp", using Deflate */
-    status_t compressFpToFp(FILE* dstFp, FILE* srcFp,
-        const void* data, size_t size, unsigned long* pCRC32);
+    static status_t compressFpToFp(FILE* dstFp, FILE* srcFp,
+        const DataChunk* chunks, size_t numChunks, int level,
+        unsigned long* pCRC32);
+    /* compress all of "chunks" into a malloc()ed buffer, using Deflate */
+    static status_t compressDataToBuffer(const DataChunk* chunks,
+        size_t numChunks, int level, void** pBuf, size_t* pBufLen,
+        unsigned long* pCRC32);
 
     /* get modification date from a file descriptor */
     time_t getModTime(int fd);
@@ -263,6 +450,32 @@ private:
      * classes and sub-classes.
      */
     Vector<ZipEntry*>   mEntries;
+
+    /* name lookup for mEntries; holds only entries not pending deletion */
+    EntryIndex          mEntryIndex;
+
+    /*
+     * Set if the archive we read had the same name twice.  Removing one of
+     * them must then bring the other back into mEntryIndex.
+     */
+    bool                mHasDuplicateNames;
+
+    /* zlib level for new deflated entries */
+    int                 mCompressionLevel;
+
+    /*
+     * Incremental updates (see setIncremental()).  mFreeSpans holds the
+     * holes left between entries, sorted by offset and coalesced; space
+     * right before the central directory is given back to it instead.
+     */
+    struct FreeSpan {
+        long    mOffset;
+        long    mLength;
+    };
+    bool                mIncremental;
+    double              mMaxFreeRatio;
+    Vector<FreeSpan>    mFreeSpans;
+    long                mFreeBytes;
 };
 
 }; // namespace android
@@ -35,6 +35,7 @@
 
 #include <android/configuration.h>
 
+#include <atomic>
 #include <memory>
 
 namespace android {
@@ -516,6 +517,12 @@ public:
 
     ssize_t indexOfString(const char16_t* str, size_t strLen) const;
 
+    // indexOfString() searches the pool directly for its first few calls,
+    // then builds a hash index of the pool and uses that from then on.
+    // Sets how many lookups are made before the index is built; 0 builds
+    // it on the first lookup.
+    void setIndexThreshold(uint32_t lookups);
+
     size_t size() const;
     size_t styleCount() const;
     size_t bytes() const;
@@ -524,6 +531,10 @@ public:
     bool isUTF8() const;
 
 private:
+    struct StringIndex;
+
+    const StringIndex* buildIndex() const;
+
     status_t                    mError;
     void*                       mOwnedData;
     const ResStringPool_header* mHeader;
@@ -536,6 +547,12 @@ private:
     uint32_t                    mStringPoolSize;    // number of uint16_t
     const uint32_t*             mStyles;
     uint32_t                    mStylePoolSize;    // number of uint32_t
+
+    // Built by buildIndex() under mIndexLock, then only read.
+    mutable Mutex               mIndexLock;
+    mutable std::atomic<StringIndex*> mIndex;
+    mutable std::atomic<uint32_t> mLookups;
+    uint32_t                    mIndexThreshold;
 };
 
 /**
@@ -1660,6 +1677,10 @@ public:
      * @param outBag Filled inm with a pointer to the bag mappings.
      *
      * @return ssize_t Either a >= 0 bag count of negative error code.
+     *
+     * On success the bag stays valid until unlockBag().  The table itself
+     * is not locked in between; a bag that has already been built is
+     * returned without taking the table's lock at all.
      */
     ssize_t lockBag(uint32_t resID, const bag_entry** outBag) const;
 
@@ -1879,12 +1900,38 @@ public:
     void print(bool inclValues) const;
     static String8 normalizeForOutput(const char* input);
 
+    // Receives the contents of the table from visit(), in the order that
+    // print() shows them.  Malformed entries that print() reports are
+    // skipped.
+    class EntryVisitor {
+    public:
+        virtual ~EntryVisitor() {}
+
+        virtual void visitPackage(uint32_t id, const String8& name) = 0;
+
+        // Called once per entry in each configuration.  "resName" is NULL
+        // if the entry has no name.  "value" is NULL for a bag, whose items
+        // follow as calls to visitBagItem().  String values are indices
+        // into "strings".
+        virtual void visitEntry(uint32_t resID, const resource_name* resName,
+                const ResTable_config& config, uint16_t flags, const Res_value* value,
+                uint32_t bagParent, const ResStringPool* strings) = 0;
+
+        virtual void visitBagItem(uint32_t key, const Res_value& value,
+                const ResStringPool* strings) = 0;
+    };
+
+    void visit(EntryVisitor* visitor) const;
+
 private:
     struct Header;
     struct Type;
     struct Entry;
     struct Package;
     struct PackageGroup;
+    struct TypeNameIndex;
+    struct TypeResolution;
+    struct TypeResolutionSet;
     typedef Vector<Type*> TypeList;
 
     struct bag_set {
@@ -1894,6 +1941,13 @@ private:
         // Followed by 'numAttr' bag_entry structures.
     };
 
+    // The bags of one type, taken out of the cache by setParameters() but
+    // possibly still in use by readers that got them from lockBag().
+    struct RetiredBags {
+        std::atomic<bag_set*>* bags;
+        size_t count;
+    };
+
     /**
      * Configuration dependent cached data. This must be cleared when the configuration is
      * changed (setParameters).
@@ -1901,8 +1955,10 @@ private:
     struct TypeCacheEntry {
         TypeCacheEntry() : cachedBags(NULL) {}
 
-        // Computed attribute bags for this type.
-        bag_set** cachedBags;
+        // Computed attribute bags for this type.  They are built under mLock
+        // and published once complete; after that a bag never changes until
+        // the cache is cleared, so lockBag() reads them without mLock.
+        std::atomic<std::atomic<bag_set*>*> cachedBags;
 
         // Pre-filtered list of configurations (per asset path) that match the parameters set on this
         // ResTable.
@@ -1919,9 +1975,17 @@ private:
         const ResTable_config* config,
         Entry* outEntry) const;
 
+    ssize_t getPublishedBag(uint32_t resID, const bag_entry** outBag) const;
+    void retireBags(std::atomic<bag_set*>* bags, size_t count) const;
+    void releaseRetiredBags() const;
+    static void freeRetiredBags(const Vector<RetiredBags>& retired);
+
     uint32_t findEntry(const PackageGroup* group, ssize_t typeIndex, const char16_t* name,
             size_t nameLen, uint32_t* outTypeSpecFlags) const;
 
+    const TypeResolution* getTypeResolution(const PackageGroup* group, int typeIndex,
+            const ResTable_config& config) const;
+
     status_t parsePackage(
         const ResTable_package* const pkg, const Header* const header,
         bool appAsLib, bool isSystemAsset);
@@ -1941,6 +2005,18 @@ private:
     // Mutex is not reentrant, so we must use a different lock than mLock.
     mutable Mutex               mFilteredConfigLock;
 
+    // Mutex that guards building the per-type name indices used by
+    // findEntry(); once built, an index is only read.
+    mutable Mutex               mNameIndexLock;
+
+    // Mutex that guards building the per-type config resolution tables used
+    // by getEntry(); once published, a table is read without it.
+    mutable Mutex               mResolutionLock;
+
+    // Mutex that guards mRetiredBags.  Nothing else is locked while it is
+    // held, so it can be taken from unlockBag() whatever the caller holds.
+    mutable Mutex               mRetiredBagsLock;
+
     status_t                    mError;
 
     ResTable_config             mParams;
@@ -1956,6 +2032,15 @@ private:
     uint8_t                     mPackageMap[256];
 
     uint8_t                     mNextPackageId;
+
+    // Number of bags handed out by lockBag() and not yet given back with
+    // unlockBag().  Retired bags are only freed while this is zero.
+    mutable std::atomic<int32_t> mBagReaders;
+
+    // Bags unpublished by setParameters(), waiting for mBagReaders to
+    // drop to zero; whoever sees it there frees them.
+    mutable Vector<RetiredBags> mRetiredBags;
+    mutable std::atomic<bool>   mHaveRetiredBags;
 };
 
 }   // namespace android
@@ -902,10 +902,15 @@ const void* _CompressedAsset::getBuffer(bool)
 
     /*
      * Success - now that we have the full asset in RAM we
-     * no longer need the streaming inflater
+     * no longer need the streaming inflater, or the compressed
+     * data it was reading; read() and seek() use mBuf from here on.
+     * Unmapping it keeps it from staying resident for as long as
+     * the asset is cached.
      */
     delete mZipInflater;
     mZipInflater = NULL;
+    delete mMap;
+    mMap = NULL;
 
     mBuf = buf;
     buf = NULL;
@@ -417,13 +417,149 @@ Res_png_9patch* Res_png_9patch::deserialize(void* inData)
 // --------------------------------------------------------------------
 // --------------------------------------------------------------------
 
+// Lookups made on a string pool before indexOfString() builds its index.
+// Pools that are searched only once or twice (most XML trees) never pay
+// for one.
+static const uint32_t kDefaultIndexThreshold = 8;
+
+// FNV-1a over the code units of a string.
+template <typename T>
+static inline uint32_t hashStringUnits(const T* str, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint16_t) str[i]) * 16777619u;
+    }
+    return hash;
+}
+
+// Open-addressing hash from string to its index in the pool.  UTF-8 pools
+// are hashed and compared as UTF-8, so building the index decodes nothing.
+// Strings are added from the back of the pool and the first one added
+// wins, so with duplicates the result is the one the linear scan in
+// indexOfString() finds.
+struct ResStringPool::StringIndex
+{
+    explicit StringIndex(const ResStringPool& pool)
+        : slots(NULL), mask(0)
+    {
+        const size_t count = pool.size();
+
+        // Keep the table at most half full.
+        size_t capacity = 16;
+        while (capacity < count * 2) {
+            capacity <<= 1;
+        }
+        slots = new Slot[capacity];
+        mask = capacity - 1;
+
+        const bool isUTF8 = pool.isUTF8();
+        for (size_t i = count; i-- > 0; ) {
+            size_t len;
+            if (isUTF8) {
+                const char* str8 = pool.string8At(i, &len);
+                if (str8 != NULL) {
+                    add(pool, hashStringUnits(str8, len), i);
+                }
+            } else {
+                const char16_t* str = pool.stringAt(i, &len);
+                if (str != NULL) {
+                    add(pool, hashStringUnits(str, len), i);
+                }
+            }
+        }
+    }
+
+    ~StringIndex() {
+        delete[] slots;
+    }
+
+    ssize_t find(const ResStringPool& pool, const char16_t* str, size_t strLen) const {
+        if (pool.isUTF8()) {
+            const String8 str8(str, strLen);
+            return find8(pool, str8.string(), str8.size());
+        }
+
+        const uint32_t hash = hashStringUnits(str, strLen);
+        for (size_t i = hash & mask; slots[i].index != kEmpty; i = (i + 1) & mask) {
+            if (slots[i].hash != hash) {
+                continue;
+            }
+            size_t len;
+            const char16_t* s = pool.stringAt(slots[i].index, &len);
+            if (s != NULL && strzcmp16(s, len, str, strLen) == 0) {
+                return slots[i].index;
+            }
+        }
+        return NAME_NOT_FOUND;
+    }
+
+private:
+    enum { kEmpty = 0xffffffff };
+
+    struct Slot {
+        Slot() : hash(0), index(kEmpty) { }
+
+        uint32_t hash;
+        uint32_t index;
+    };
+
+    ssize_t find8(const ResStringPool& pool, const char* str8, size_t str8Len) const {
+        const uint32_t hash = hashStringUnits(str8, str8Len);
+        for (size_t i = hash & mask; slots[i].index != kEmpty; i = (i + 1) & mask) {
+            if (slots[i].hash != hash) {
+                continue;
+            }
+            size_t len;
+            const char* s = pool.string8At(slots[i].index, &len);
+            if (s != NULL && len == str8Len && memcmp(s, str8, str8Len) == 0) {
+                return slots[i].index;
+            }
+        }
+        return NAME_NOT_FOUND;
+    }
+
+    // Adds string "index" unless an equal string is already in the table.
+    void add(const ResStringPool& pool, uint32_t hash, size_t index) {
+        size_t i = hash & mask;
+        for (; slots[i].index != kEmpty; i = (i + 1) & mask) {
+            if (slots[i].hash != hash) {
+                continue;
+            }
+            size_t len;
+            if (pool.isUTF8()) {
+                size_t otherLen;
+                const char* a = pool.string8At(slots[i].index, &len);
+                const char* b = pool.string8At(index, &otherLen);
+                if (len == otherLen && memcmp(a, b, len) == 0) {
+                    return;
+                }
+            } else {
+                size_t otherLen;
+                const char16_t* a = pool.stringAt(slots[i].index, &len);
+                const char16_t* b = pool.stringAt(index, &otherLen);
+                if (strzcmp16(a, len, b, otherLen) == 0) {
+                    return;
+                }
+            }
+        }
+        slots[i].hash = hash;
+        slots[i].index = index;
+    }
+
+    Slot*   slots;
+    size_t  mask;
+};
+
 ResStringPool::ResStringPool()
-    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL)
+    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL),
+      mIndex(NULL), mLookups(0), mIndexThreshold(kDefaultIndexThreshold)
 {
 }
 
 ResStringPool::ResStringPool(const void* data, size_t size, bool copyData)
-    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL)
+    : mError(NO_INIT), mOwnedData(NULL), mHeader(NULL), mCache(NULL),
+      mIndex(NULL), mLookups(0), mIndexThreshold(kDefaultIndexThreshold)
 {
     setTo(data, size, copyData);
 }
@@ -634,6 +770,8 @@ status_t ResStringPool::getError() const
 void ResStringPool::uninit()
 {
     mError = NO_INIT;
+    delete mIndex.exchange(NULL);
+    mLookups = 0;
     if (mHeader != NULL && mCache != NULL) {
         for (size_t x = 0; x < mHeader->stringCount; x++) {
             if (mCache[x] != NULL) {
@@ -856,12 +994,40 @@ const ResStringPool_span* ResStringPool::styleAt(size_t idx) const
     return NULL;
 }
 
+void ResStringPool::setIndexThreshold(uint32_t lookups)
+{
+    mIndexThreshold = lookups;
+}
+
+const ResStringPool::StringIndex* ResStringPool::buildIndex() const
+{
+    AutoMutex _l(mIndexLock);
+    StringIndex* index = mIndex.load(std::memory_order_relaxed);
+    if (index == NULL) {
+        index = new StringIndex(*this);
+        mIndex.store(index, std::memory_order_release);
+    }
+    return index;
+}
+
 ssize_t ResStringPool::indexOfString(const char16_t* str, size_t strLen) const
 {
     if (mError != NO_ERROR) {
         return mError;
     }
 
+    const StringIndex* index = mIndex.load(std::memory_order_acquire);
+    if (index == NULL
+            && mLookups.fetch_add(1, std::memory_order_relaxed) >= mIndexThreshold) {
+        index = buildIndex();
+    }
+    if (index != NULL) {
+        if (kDebugStringPoolNoisy) {
+            ALOGI("indexOfString hashed: %s", String8(str, strLen).string());
+        }
+        return index->find(*this, str, strLen);
+    }
+
     size_t len;
 
     if ((mHeader->flags&ResStringPool_header::UTF8_FLAG) != 0) {
@@ -877,7 +1043,7 @@ ssize_t ResStringPool::indexOfString(const char16_t* str, size_t strLen) const
             // the ordering, we need to convert strings in the pool to UTF-16.
             // But we don't want to hit the cache, so instead we will have a
             // local temporary allocation for the conversions.
-            char16_t* convBuffer = (char16_t*)malloc(strLen+4);
+            char16_t* convBuffer = (char16_t*)malloc((strLen+4)*sizeof(char16_t));
             ssize_t l = 0;
             ssize_t h = mHeader->stringCount-1;
 
@@ -3183,6 +3349,339 @@ struct ResTable::Package
     size_t                          typeIdOffset;
 };
 
+// The entry names of one type, hashed, so identifierForName() can go
+// straight from a name to its entry.  Entries are added in the order the
+// old scan in findEntry() visited them (type, then config, then entry),
+// and the first entry seen with a name wins, so lookups give the same
+// answer that scan did.
+struct ResTable::TypeNameIndex
+{
+    explicit TypeNameIndex(const TypeList& typeList)
+        : slots(NULL), mask(0)
+    {
+        size_t maxEntries = 0;
+        const size_t typeCount = typeList.size();
+        for (size_t i = 0; i < typeCount; i++) {
+            maxEntries += typeList[i]->entryCount;
+        }
+
+        // Keep the table at most half full.
+        size_t capacity = 16;
+        while (capacity < maxEntries * 2) {
+            capacity <<= 1;
+        }
+        slots = new Slot[capacity];
+        mask = capacity - 1;
+
+        for (size_t i = 0; i < typeCount; i++) {
+            const Type* t = typeList[i];
+            const ResStringPool& keyStrings = t->package->keyStrings;
+
+            // An entry's name is usually the same in every config.
+            Vector<bool> seen;
+            seen.insertAt(false, 0, keyStrings.size());
+
+            const size_t configCount = t->configs.size();
+            for (size_t j = 0; j < configCount; j++) {
+                const TypeVariant tv(t->configs[j]);
+                for (TypeVariant::iterator iter = tv.beginEntries();
+                     iter != tv.endEntries();
+                     iter++) {
+                    const ResTable_entry* entry = *iter;
+                    if (entry == NULL) {
+                        continue;
+                    }
+
+                    const size_t ki = dtohl(entry->key.index);
+                    if (ki >= seen.size() || seen[ki]) {
+                        continue;
+                    }
+                    seen.editItemAt(ki) = true;
+
+                    size_t len;
+                    if (keyStrings.isUTF8()) {
+                        const char* str8 = keyStrings.string8At(ki, &len);
+                        if (str8 != NULL) {
+                            add(String16(str8, len), iter.index());
+                        }
+                    } else {
+                        const char16_t* str = keyStrings.stringAt(ki, &len);
+                        if (str != NULL) {
+                            add(String16(str, len), iter.index());
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    ~TypeNameIndex() {
+        delete[] slots;
+    }
+
+    // Returns the entry index of "name", or -1 if the type has no such entry.
+    ssize_t find(const char16_t* name, size_t nameLen) const {
+        const uint32_t hash = hashName(name, nameLen);
+        for (size_t i = hash & mask; slots[i].entryIndex != kEmpty; i = (i + 1) & mask) {
+            const Slot& slot = slots[i];
+            if (slot.hash == hash
+                    && strzcmp16(slot.name.string(), slot.name.size(), name, nameLen) == 0) {
+                return slot.entryIndex;
+            }
+        }
+        return -1;
+    }
+
+private:
+    enum { kEmpty = 0xffffffff };
+
+    struct Slot {
+        Slot() : hash(0), entryIndex(kEmpty) { }
+
+        String16 name;
+        uint32_t hash;
+        uint32_t entryIndex;
+    };
+
+    void add(const String16& name, uint32_t entryIndex) {
+        const uint32_t hash = hashName(name.string(), name.size());
+        size_t i = hash & mask;
+        for (; slots[i].entryIndex != kEmpty; i = (i + 1) & mask) {
+            const Slot& slot = slots[i];
+            if (slot.hash == hash && slot.name == name) {
+                return;
+            }
+        }
+        slots[i].name = name;
+        slots[i].hash = hash;
+        slots[i].entryIndex = entryIndex;
+    }
+
+    // FNV-1a
+    static uint32_t hashName(const char16_t* name, size_t nameLen) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < nameLen; i++) {
+            hash = (hash ^ name[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    Slot*   slots;
+    size_t  mask;
+};
+
+// The winner of getEntry()'s config selection for every entry of one
+// type, for one requested configuration.  Built once getEntry() has been
+// asked for entries of that type in that configuration a few times in a
+// row (see TypeResolutionSet); after that a lookup is an array index.  Each entry sees the Types and configs in the
+// order getEntry() visits them, so every choice is the one getEntry()
+// would have made.
+struct ResTable::TypeResolution
+{
+    struct Choice {
+        Choice()
+            : type(NULL), package(NULL), offset(ResTable_type::NO_ENTRY),
+              specFlags(0), actualTypeIndex(0), outOfRange(false) { }
+
+        const ResTable_type*    type;
+        const Package*          package;
+        uint32_t                offset;
+        uint32_t                specFlags;
+        uint8_t                 actualTypeIndex;
+
+        // Some Type of the list has no entry this far out.  getEntry()
+        // takes its slow path for these so it can warn about it.
+        bool                    outOfRange;
+    };
+
+    TypeResolution(const TypeList& typeList, uint8_t typeIndex, const ResTable_config& _config)
+        : config(_config), choices(NULL), count(0)
+    {
+        const size_t typeCount = typeList.size();
+        for (size_t i = 0; i < typeCount; i++) {
+            count = max(count, typeList[i]->entryCount);
+        }
+        choices = new Choice[count];
+        for (size_t e = 0; e < count; e++) {
+            choices[e].actualTypeIndex = typeIndex;
+        }
+
+        // The config of each entry's current choice.
+        ResTable_config* bestConfigs = new ResTable_config[count];
+
+        for (size_t i = 0; i < typeCount; i++) {
+            const Type* const typeSpec = typeList[i];
+            const bool isOverlay = typeSpec->idmapEntries.hasEntries();
+
+            // Whether a config matches doesn't depend on the entry, so only
+            // test each one once.
+            Vector<const ResTable_type*> candidates;
+            Vector<ResTable_config> candidateConfigs;
+            const size_t configCount = typeSpec->configs.size();
+            for (size_t c = 0; c < configCount; c++) {
+                const ResTable_type* const thisType = typeSpec->configs[c];
+                if (thisType == NULL) {
+                    continue;
+                }
+                ResTable_config thisConfig;
+                thisConfig.copyFromDtoH(thisType->config);
+                if (thisConfig.match(config)) {
+                    candidates.add(thisType);
+                    candidateConfigs.add(thisConfig);
+                }
+            }
+
+            for (size_t e = 0; e < count; e++) {
+                Choice& choice = choices[e];
+
+                size_t realEntryIndex = e;
+                uint8_t realTypeIndex = typeIndex;
+                if (isOverlay) {
+                    uint16_t overlayEntryIndex;
+                    if (typeSpec->idmapEntries.lookup(e, &overlayEntryIndex) != NO_ERROR) {
+                        continue;
+                    }
+                    realEntryIndex = overlayEntryIndex;
+                    realTypeIndex = typeSpec->idmapEntries.overlayTypeId() - 1;
+                }
+
+                if (realEntryIndex >= typeSpec->entryCount) {
+                    choice.outOfRange = true;
+                    continue;
+                }
+
+                if (typeSpec->typeSpecFlags != NULL) {
+                    choice.specFlags |= dtohl(typeSpec->typeSpecFlags[realEntryIndex]);
+                } else {
+                    choice.specFlags = -1;
+                }
+
+                const size_t candidateCount = candidates.size();
+                for (size_t c = 0; c < candidateCount; c++) {
+                    const ResTable_type* const thisType = candidates[c];
+                    const ResTable_config& thisConfig = candidateConfigs[c];
+
+                    const uint32_t* const eindex = reinterpret_cast<const uint32_t*>(
+                            reinterpret_cast<const uint8_t*>(thisType)
+                            + dtohs(thisType->header.headerSize));
+                    const uint32_t thisOffset = dtohl(eindex[realEntryIndex]);
+                    if (thisOffset == ResTable_type::NO_ENTRY) {
+                        continue;
+                    }
+
+                    if (choice.type != NULL
+                            && !thisConfig.isBetterThan(bestConfigs[e], &config)) {
+                        if (!isOverlay || thisConfig.compare(bestConfigs[e]) != 0) {
+                            continue;
+                        }
+                    }
+
+                    choice.type = thisType;
+                    choice.offset = thisOffset;
+                    choice.package = typeSpec->package;
+                    choice.actualTypeIndex = realTypeIndex;
+                    bestConfigs[e] = thisConfig;
+                }
+            }
+        }
+
+        delete[] bestConfigs;
+    }
+
+    ~TypeResolution() {
+        delete[] choices;
+    }
+
+    const ResTable_config   config;
+    Choice*                 choices;
+    size_t                  count;
+};
+
+// The resolution tables of one type.  Tables are built under
+// mResolutionLock and published into an empty slot; a published table
+// never changes or moves until the type itself does, so getEntry() reads
+// the slots without a lock.
+//
+// Building a table costs a scan of every config for every entry, which
+// only pays off for a config that keeps being asked for.  A config gets
+// one once it has been seen kMinUses times in a row for the type; a
+// caller that steps through configs (like badging's locale loop) uses
+// each one a few times and moves on, and never gets that far.
+struct ResTable::TypeResolutionSet
+{
+    enum {
+        kMaxTables = 4,
+        kMinUses = 8
+    };
+
+    TypeResolutionSet() : created(false), candidateHash(0), candidateUses(0) {
+        for (size_t i = 0; i < kMaxTables; i++) {
+            tables[i].store(NULL, std::memory_order_relaxed);
+        }
+    }
+
+    ~TypeResolutionSet() {
+        clear();
+    }
+
+    // Only while nothing else is reading the table.
+    void clear() {
+        for (size_t i = 0; i < kMaxTables; i++) {
+            delete tables[i].exchange(NULL, std::memory_order_relaxed);
+        }
+        candidateHash.store(0, std::memory_order_relaxed);
+        candidateUses.store(0, std::memory_order_relaxed);
+    }
+
+    const TypeResolution* find(const ResTable_config& config) const {
+        for (size_t i = 0; i < kMaxTables; i++) {
+            const TypeResolution* resolution = tables[i].load(std::memory_order_acquire);
+            if (resolution == NULL) {
+                break;
+            }
+            if (memcmp(&resolution->config, &config, sizeof(config)) == 0) {
+                return resolution;
+            }
+        }
+        return NULL;
+    }
+
+    // Counts a lookup in a config that has no table yet, and says whether
+    // it has now been asked for often enough to get one.  Lookups from
+    // several threads may miscount; that only moves when a table is built.
+    bool noteUse(const ResTable_config& config) const {
+        uint32_t hash = 2166136261u;
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(&config);
+        for (size_t i = 0; i < sizeof(config); i++) {
+            hash = (hash ^ p[i]) * 16777619u;
+        }
+        if (candidateHash.load(std::memory_order_relaxed) != hash) {
+            candidateHash.store(hash, std::memory_order_relaxed);
+            candidateUses.store(1, std::memory_order_relaxed);
+            return false;
+        }
+        return candidateUses.fetch_add(1, std::memory_order_relaxed) + 1 >= kMinUses;
+    }
+
+    // Set once the set belongs to a type (see clearResolutions()).  The
+    // empty set ByteBucketArray hands back for a missing bucket is shared
+    // by every type, so nothing is ever published into it.
+    bool                                    created;
+
+    // Published tables fill the slots from the front.
+    mutable std::atomic<TypeResolution*>    tables[kMaxTables];
+
+    // The config most recently asked for without a table, and how many
+    // times in a row.
+    mutable std::atomic<uint32_t>           candidateHash;
+    mutable std::atomic<uint32_t>           candidateUses;
+
+private:
+    // these are private and not defined
+    TypeResolutionSet(const TypeResolutionSet& src);
+    TypeResolutionSet& operator=(const TypeResolutionSet& src);
+};
+
 // A group of objects describing a particular resource package.
 // The first in 'package' is always the root object (from the resource
 // table that defined the package); the ones after are skins on top of it.
@@ -3201,6 +3700,7 @@ struct ResTable::PackageGroup
 
     ~PackageGroup() {
         clearBagCache();
+        clearNameIndices();
         const size_t numTypes = types.size();
         for (size_t i = 0; i < numTypes; i++) {
             const TypeList& typeList = types[i];
@@ -3224,6 +3724,10 @@ struct ResTable::PackageGroup
     /**
      * Clear all cache related data that depends on parameters/configuration.
      * This includes the bag caches and filtered types.
+     *
+     * Bags handed out by lockBag() are read without mLock, so the cached
+     * bags are unpublished and handed to the owner, which frees them once
+     * every such reader has called unlockBag().  Nothing waits here.
      */
     void clearBagCache() {
         for (size_t i = 0; i < typeCacheEntries.size(); i++) {
@@ -3237,26 +3741,45 @@ struct ResTable::PackageGroup
                 // Reset the filtered configurations.
                 cacheEntry.filteredConfigs.clear();
 
-                bag_set** typeBags = cacheEntry.cachedBags;
+                std::atomic<bag_set*>* typeBags = cacheEntry.cachedBags.exchange(NULL);
                 if (kDebugTableNoisy) {
                     printf("typeBags=%p\n", typeBags);
                 }
 
                 if (typeBags) {
-                    const size_t N = typeList[0]->entryCount;
-                    if (kDebugTableNoisy) {
-                        printf("type->entryCount=%zu\n", N);
-                    }
-                    for (size_t j = 0; j < N; j++) {
-                        if (typeBags[j] && typeBags[j] != (bag_set*)0xFFFFFFFF) {
-                            free(typeBags[j]);
-                        }
-                    }
-                    free(typeBags);
-                    cacheEntry.cachedBags = NULL;
+                    owner->retireBags(typeBags, typeList[0]->entryCount);
                 }
             }
         }
+        owner->releaseRetiredBags();
+    }
+
+    /**
+     * Drop the name index of a type whose list of Types has changed, or of
+     * every type if typeIndex is negative.
+     */
+    void clearNameIndices(ssize_t typeIndex = -1) {
+        for (size_t i = 0; i < nameIndices.size(); i++) {
+            if (typeIndex >= 0 && i != (size_t) typeIndex) {
+                continue;
+            }
+            if (nameIndices[i] != NULL) {
+                delete nameIndices[i];
+                nameIndices.editItemAt(i) = NULL;
+            }
+        }
+    }
+
+    /**
+     * Drop the config resolution tables of a type whose list of Types or
+     * configs has changed.  The rest go when the group does.  This also
+     * creates the type's set, which getEntry() reads without a lock, so
+     * it must be called for every type the group gets.
+     */
+    void clearResolutions(size_t typeIndex) {
+        TypeResolutionSet& set = resolutions.editItemAt(typeIndex);
+        set.clear();
+        set.created = true;
     }
 
     ssize_t findType16(const char16_t* type, size_t len) const {
@@ -3289,6 +3812,15 @@ struct ResTable::PackageGroup
     // be shared by other ResTable's (framework resources are shared this way).
     ByteBucketArray<TypeCacheEntry> typeCacheEntries;
 
+    // Maps entry names to entry indices, per type.  Built by findEntry()
+    // when a name is first looked up in the type, under mNameIndexLock.
+    mutable ByteBucketArray<TypeNameIndex*> nameIndices;
+
+    // The winning config of every entry, per type and requested config.
+    // Built by getEntry() under mResolutionLock and read without it.  These
+    // only depend on the Types, not on the parameters of the ResTable.
+    ByteBucketArray<TypeResolutionSet> resolutions;
+
     // The table mapping dynamic references to resolved references for
     // this package group.
     // TODO: We may be able to support dynamic references in overlays
@@ -3631,7 +4163,7 @@ void ResTable::Theme::dumpToLog() const
 }
 
 ResTable::ResTable()
-    : mError(NO_INIT), mNextPackageId(2)
+    : mError(NO_INIT), mNextPackageId(2), mBagReaders(0), mHaveRetiredBags(false)
 {
     memset(&mParams, 0, sizeof(mParams));
     memset(mPackageMap, 0, sizeof(mPackageMap));
@@ -3641,7 +4173,7 @@ ResTable::ResTable()
 }
 
 ResTable::ResTable(const void* data, size_t size, const int32_t cookie, bool copyData)
-    : mError(NO_INIT), mNextPackageId(2)
+    : mError(NO_INIT), mNextPackageId(2), mBagReaders(0), mHaveRetiredBags(false)
 {
     memset(&mParams, 0, sizeof(mParams));
     memset(mPackageMap, 0, sizeof(mPackageMap));
@@ -3658,6 +4190,8 @@ ResTable::~ResTable()
         ALOGI("Destroying ResTable in %p\n", this);
     }
     uninit();
+    // Nobody can be reading the table any more.
+    freeRetiredBags(mRetiredBags);
 }
 
 inline ssize_t ResTable::getResourcePackageIndex(uint32_t resID) const
@@ -3732,6 +4266,8 @@ status_t ResTable::add(ResTable* src, bool isSystemAsset)
 
             TypeList& typeList = pg->types.editItemAt(j);
             typeList.appendVector(srcPg->types[j]);
+            pg->typeCacheEntries.editItemAt(j);
+            pg->clearResolutions(j);
         }
         pg->dynamicRefTable.addMappings(srcPg->dynamicRefTable);
         pg->largestTypeId = max(pg->largestTypeId, srcPg->largestTypeId);
@@ -4128,11 +4664,22 @@ const char16_t* ResTable::valueToString(
 
 ssize_t ResTable::lockBag(uint32_t resID, const bag_entry** outBag) const
 {
-    mLock.lock();
-    ssize_t err = getBagLocked(resID, outBag);
-    if (err < NO_ERROR) {
-        //printf("*** get failed!  unlocking\n");
-        mLock.unlock();
+    // Count ourselves as a reader before looking, so that a bag we find
+    // can't be freed by setParameters() until unlockBag().
+    mBagReaders.fetch_add(1);
+    ssize_t err = getPublishedBag(resID, outBag);
+    if (err >= NO_ERROR) {
+        return err;
+    }
+    // Don't hold bags back from being freed while we wait for mLock.
+    if (mBagReaders.fetch_sub(1) == 1) {
+        releaseRetiredBags();
+    }
+
+    AutoMutex _lock(mLock);
+    err = getBagLocked(resID, outBag);
+    if (err >= NO_ERROR) {
+        mBagReaders.fetch_add(1);
     }
     return err;
 }
@@ -4140,7 +4687,94 @@ ssize_t ResTable::lockBag(uint32_t resID, const bag_entry** outBag) const
 void ResTable::unlockBag(const bag_entry* /*bag*/) const
 {
     //printf("<<< unlockBag %p\n", this);
-    mLock.unlock();
+    if (mBagReaders.fetch_sub(1) == 1) {
+        releaseRetiredBags();
+    }
+}
+
+ssize_t ResTable::getPublishedBag(uint32_t resID, const bag_entry** outBag) const
+{
+    if (mError != NO_ERROR) {
+        return mError;
+    }
+
+    const ssize_t p = getResourcePackageIndex(resID);
+    const int t = Res_GETTYPE(resID);
+    const int e = Res_GETENTRY(resID);
+    if (p < 0 || t < 0) {
+        return BAD_INDEX;
+    }
+
+    const PackageGroup* const grp = mPackageGroups[p];
+    if (grp == NULL || grp->types[t].isEmpty()
+            || e >= (int)grp->types[t][0]->entryCount) {
+        return BAD_INDEX;
+    }
+
+    // Sequentially consistent, like the reader count lockBag() bumped
+    // before getting here: a table retired after this load is seen still
+    // in use by releaseRetiredBags().
+    const std::atomic<bag_set*>* typeSet = grp->typeCacheEntries[t].cachedBags.load();
+    if (typeSet == NULL) {
+        return NAME_NOT_FOUND;
+    }
+    const bag_set* set = typeSet[e].load(std::memory_order_acquire);
+    if (set == NULL || set == (bag_set*)0xFFFFFFFF) {
+        return NAME_NOT_FOUND;
+    }
+    *outBag = (const bag_entry*)(set+1);
+    return set->numAttrs;
+}
+
+void ResTable::retireBags(std::atomic<bag_set*>* bags, size_t count) const
+{
+    RetiredBags retired;
+    retired.bags = bags;
+    retired.count = count;
+
+    AutoMutex _lock(mRetiredBagsLock);
+    mRetiredBags.add(retired);
+    mHaveRetiredBags.store(true);
+}
+
+void ResTable::releaseRetiredBags() const
+{
+    if (!mHaveRetiredBags.load()) {
+        return;
+    }
+
+    // Bags are unpublished before they are retired, so a reader that
+    // could still hold one was counted before they were put on the list.
+    // If the count is zero with the list locked, all of it can go.
+    Vector<RetiredBags> retired;
+    {
+        AutoMutex _lock(mRetiredBagsLock);
+        if (mBagReaders.load() != 0) {
+            return;
+        }
+        retired = mRetiredBags;
+        mRetiredBags.clear();
+        mHaveRetiredBags.store(false);
+    }
+    freeRetiredBags(retired);
+}
+
+void ResTable::freeRetiredBags(const Vector<RetiredBags>& retired)
+{
+    for (size_t i = 0; i < retired.size(); i++) {
+        std::atomic<bag_set*>* typeBags = retired[i].bags;
+        const size_t N = retired[i].count;
+        if (kDebugTableNoisy) {
+            printf("type->entryCount=%zu\n", N);
+        }
+        for (size_t j = 0; j < N; j++) {
+            bag_set* set = typeBags[j].load(std::memory_order_relaxed);
+            if (set && set != (bag_set*)0xFFFFFFFF) {
+                free(set);
+            }
+        }
+        delete[] typeBags;
+    }
 }
 
 void ResTable::lock() const
@@ -4195,9 +4829,9 @@ ssize_t ResTable::getBagLocked(uint32_t resID, const bag_entry** outBag,
 
     // First see if we've already computed this bag...
     TypeCacheEntry& cacheEntry = grp->typeCacheEntries.editItemAt(t);
-    bag_set** typeSet = cacheEntry.cachedBags;
+    std::atomic<bag_set*>* typeSet = cacheEntry.cachedBags.load(std::memory_order_relaxed);
     if (typeSet) {
-        bag_set* set = typeSet[e];
+        bag_set* set = typeSet[e].load(std::memory_order_relaxed);
         if (set) {
             if (set != (bag_set*)0xFFFFFFFF) {
                 if (outTypeSpecFlags != NULL) {
@@ -4217,13 +4851,13 @@ ssize_t ResTable::getBagLocked(uint32_t resID, const bag_entry** outBag,
 
     // Bag not found, we need to compute it!
     if (!typeSet) {
-        typeSet = (bag_set**)calloc(NENTRY, sizeof(bag_set*));
-        if (!typeSet) return NO_MEMORY;
-        cacheEntry.cachedBags = typeSet;
+        typeSet = new std::atomic<bag_set*>[NENTRY]();
+        cacheEntry.cachedBags.store(typeSet, std::memory_order_release);
     }
 
-    // Mark that we are currently working on this one.
-    typeSet[e] = (bag_set*)0xFFFFFFFF;
+    // Mark that we are currently working on this one.  lockBag() only
+    // reads a bag without mLock once it is complete.
+    typeSet[e].store((bag_set*)0xFFFFFFFF, std::memory_order_relaxed);
 
     if (kDebugTableNoisy) {
         ALOGI("Building bag: %x\n", resID);
@@ -4408,8 +5042,9 @@ ssize_t ResTable::getBagLocked(uint32_t resID, const bag_entry** outBag,
         set->numAttrs = curEntry;
     }
 
-    // And this is it...
-    typeSet[e] = set;
+    // And this is it...  Publish the finished bag; it doesn't change again
+    // until setParameters() throws the cache away.
+    typeSet[e].store(set, std::memory_order_release);
     if (set) {
         if (outTypeSpecFlags != NULL) {
             *outTypeSpecFlags = set->typeSpecFlags;
@@ -4660,42 +5295,31 @@ nope:
 
 uint32_t ResTable::findEntry(const PackageGroup* group, ssize_t typeIndex, const char16_t* name,
         size_t nameLen, uint32_t* outTypeSpecFlags) const {
-    const TypeList& typeList = group->types[typeIndex];
-    const size_t typeCount = typeList.size();
-    for (size_t i = 0; i < typeCount; i++) {
-        const Type* t = typeList[i];
-        const ssize_t ei = t->package->keyStrings.indexOfString(name, nameLen);
-        if (ei < 0) {
-            continue;
+    const TypeNameIndex* index;
+    {
+        AutoMutex _lock(mNameIndexLock);
+        index = group->nameIndices[typeIndex];
+        if (index == NULL) {
+            index = new TypeNameIndex(group->types[typeIndex]);
+            group->nameIndices.editItemAt(typeIndex) = const_cast<TypeNameIndex*>(index);
         }
+    }
 
-        const size_t configCount = t->configs.size();
-        for (size_t j = 0; j < configCount; j++) {
-            const TypeVariant tv(t->configs[j]);
-            for (TypeVariant::iterator iter = tv.beginEntries();
-                 iter != tv.endEntries();
-                 iter++) {
-                const ResTable_entry* entry = *iter;
-                if (entry == NULL) {
-                    continue;
-                }
+    const ssize_t ei = index->find(name, nameLen);
+    if (ei < 0) {
+        return 0;
+    }
 
-                if (dtohl(entry->key.index) == (size_t) ei) {
-                    uint32_t resId = Res_MAKEID(group->id - 1, typeIndex, iter.index());
-                    if (outTypeSpecFlags) {
-                        Entry result;
-                        if (getEntry(group, typeIndex, iter.index(), NULL, &result) != NO_ERROR) {
-                            ALOGW("Failed to find spec flags for 0x%08x", resId);
-                            return 0;
-                        }
-                        *outTypeSpecFlags = result.specFlags;
-                    }
-                    return resId;
-                }
-            }
+    uint32_t resId = Res_MAKEID(group->id - 1, typeIndex, ei);
+    if (outTypeSpecFlags) {
+        Entry result;
+        if (getEntry(group, typeIndex, ei, NULL, &result) != NO_ERROR) {
+            ALOGW("Failed to find spec flags for 0x%08x", resId);
+            return 0;
         }
+        *outTypeSpecFlags = result.specFlags;
     }
-    return 0;
+    return resId;
 }
 
 bool ResTable::expandResourceRef(const char16_t* refStr, size_t refLen,
@@ -5961,6 +6585,43 @@ bool ResTable::getResourceFlags(uint32_t resID, uint32_t* outFlags) const {
     return true;
 }
 
+const ResTable::TypeResolution* ResTable::getTypeResolution(const PackageGroup* group,
+        int typeIndex, const ResTable_config& config) const
+{
+    // The set was made when the type got its first Type, so this doesn't
+    // create anything.  Should it be missing, getEntry() just scans.
+    const TypeResolutionSet& set = group->resolutions[typeIndex];
+    if (!set.created) {
+        return NULL;
+    }
+    const TypeResolution* resolution = set.find(config);
+    if (resolution != NULL || !set.noteUse(config)) {
+        return resolution;
+    }
+
+    AutoMutex _lock(mResolutionLock);
+    size_t slot = 0;
+    for (; slot < TypeResolutionSet::kMaxTables; slot++) {
+        resolution = set.tables[slot].load(std::memory_order_relaxed);
+        if (resolution == NULL) {
+            break;
+        }
+        if (memcmp(&resolution->config, &config, sizeof(config)) == 0) {
+            // Someone else built it while we waited.
+            return resolution;
+        }
+    }
+    if (slot == TypeResolutionSet::kMaxTables) {
+        // A type is rarely asked for in more than a couple of configs;
+        // the rest keep using the scan.
+        return NULL;
+    }
+
+    resolution = new TypeResolution(group->types[typeIndex], typeIndex, config);
+    set.tables[slot].store(const_cast<TypeResolution*>(resolution), std::memory_order_release);
+    return resolution;
+}
+
 status_t ResTable::getEntry(
         const PackageGroup* packageGroup, int typeIndex, int entryIndex,
         const ResTable_config* config,
@@ -5980,8 +6641,29 @@ status_t ResTable::getEntry(
     ResTable_config bestConfig;
     memset(&bestConfig, 0, sizeof(bestConfig));
 
-    // Iterate over the Types of each package.
-    const size_t typeCount = typeList.size();
+    const TypeResolution::Choice* choice = NULL;
+    if (config != NULL && entryIndex >= 0) {
+        const TypeResolution* resolution = getTypeResolution(packageGroup, typeIndex, *config);
+        if (resolution != NULL && static_cast<size_t>(entryIndex) < resolution->count
+                && !resolution->choices[entryIndex].outOfRange) {
+            choice = &resolution->choices[entryIndex];
+        }
+    }
+
+    if (choice != NULL) {
+        bestType = choice->type;
+        bestOffset = choice->offset;
+        bestPackage = choice->package;
+        specFlags = choice->specFlags;
+        actualTypeIndex = choice->actualTypeIndex;
+        if (bestType != NULL) {
+            bestConfig.copyFromDtoH(bestType->config);
+        }
+    }
+
+    // Iterate over the Types of each package, unless the resolution table
+    // has already made the choice.
+    const size_t typeCount = choice != NULL ? 0 : typeList.size();
     for (size_t i = 0; i < typeCount; i++) {
         const Type* const typeSpec = typeList[i];
 
@@ -6311,6 +6993,10 @@ status_t ResTable::parsePackage(const ResTable_package* const pkg,
                     t->idmapEntries = idmapEntries[idmapIndex];
                 }
                 typeList.add(t);
+                group->clearNameIndices(typeIndex);
+                group->clearResolutions(typeIndex);
+                // Create the cache entry now: lockBag() reads it without mLock.
+                group->typeCacheEntries.editItemAt(typeIndex);
                 group->largestTypeId = max(group->largestTypeId, typeSpec->id);
             } else {
                 ALOGV("Skipping empty ResTable_typeSpec for type %d", typeSpec->id);
@@ -6379,6 +7065,8 @@ status_t ResTable::parsePackage(const ResTable_package* const pkg,
                 }
 
                 t->configs.add(type);
+                group->clearNameIndices(typeIndex);
+                group->clearResolutions(typeIndex);
 
                 if (kDebugTableGetEntry) {
                     ResTable_config thisConfig;
@@ -7131,4 +7819,98 @@ void ResTable::print(bool inclValues) const
     }
 }
 
+void ResTable::visit(EntryVisitor* visitor) const
+{
+    const size_t pgCount = mPackageGroups.size();
+    for (size_t pgIndex=0; pgIndex<pgCount; pgIndex++) {
+        const PackageGroup* pg = mPackageGroups[pgIndex];
+
+        int packageId = pg->id;
+        const size_t pkgCount = pg->packages.size();
+        for (size_t pkgIndex=0; pkgIndex<pkgCount; pkgIndex++) {
+            const Package* pkg = pg->packages[pkgIndex];
+            packageId = pkg->package->id;
+            char16_t tmpName[sizeof(pkg->package->name)/sizeof(pkg->package->name[0])];
+            strcpy16_dtoh(tmpName, pkg->package->name,
+                    sizeof(pkg->package->name)/sizeof(pkg->package->name[0]));
+            visitor->visitPackage(packageId, String8(tmpName));
+        }
+
+        for (size_t typeIndex=0; typeIndex < pg->types.size(); typeIndex++) {
+            const TypeList& typeList = pg->types[typeIndex];
+            if (typeList.isEmpty()) {
+                continue;
+            }
+            const Type* typeConfigs = typeList[0];
+            const ResStringPool* strings = &typeConfigs->package->header->values;
+            const size_t NTC = typeConfigs->configs.size();
+            for (size_t configIndex=0; configIndex<NTC; configIndex++) {
+                const ResTable_type* type = typeConfigs->configs[configIndex];
+                if ((((uint64_t)type)&0x3) != 0) {
+                    continue;
+                }
+
+                ResTable_config thisConfig;
+                thisConfig.copyFromDtoH(type->config);
+
+                const size_t entryCount = dtohl(type->entryCount);
+                const uint32_t entriesStart = dtohl(type->entriesStart);
+                const uint32_t typeSize = dtohl(type->header.size);
+                if ((entriesStart&0x3) != 0 || (typeSize&0x3) != 0) {
+                    continue;
+                }
+                const uint32_t* const eindex = (const uint32_t*)
+                    (((const uint8_t*)type) + dtohs(type->header.headerSize));
+                for (size_t entryIndex=0; entryIndex<entryCount; entryIndex++) {
+                    const uint32_t thisOffset = dtohl(eindex[entryIndex]);
+                    if (thisOffset == ResTable_type::NO_ENTRY || (thisOffset&0x3) != 0
+                            || (thisOffset+sizeof(ResTable_entry)) > typeSize
+                            || ((entriesStart + thisOffset)&0x3) != 0) {
+                        continue;
+                    }
+                    const ResTable_entry* ent = (const ResTable_entry*)
+                        (((const uint8_t*)type) + entriesStart + thisOffset);
+                    const uintptr_t esize = dtohs(ent->size);
+                    if ((esize&0x3) != 0 || (thisOffset+esize) > typeSize) {
+                        continue;
+                    }
+
+                    uint32_t resID = (0xff000000 & ((packageId)<<24))
+                                | (0x00ff0000 & ((typeIndex+1)<<16))
+                                | (0x0000ffff & (entryIndex));
+                    if (packageId == 0) {
+                        pg->dynamicRefTable.lookupResourceId(&resID);
+                    }
+                    resource_name resName;
+                    const bool hasName = this->getResourceName(resID, true, &resName);
+                    const uint16_t flags = dtohs(ent->flags);
+
+                    Res_value value;
+                    if ((flags&ResTable_entry::FLAG_COMPLEX) == 0) {
+                        value.copyFrom_dtoh(*(const Res_value*)(((const uint8_t*)ent) + esize));
+                        visitor->visitEntry(resID, hasName ? &resName : NULL, thisConfig, flags,
+                                &value, 0, strings);
+                        continue;
+                    }
+
+                    const ResTable_map_entry* bagPtr = (const ResTable_map_entry*)ent;
+                    visitor->visitEntry(resID, hasName ? &resName : NULL, thisConfig, flags,
+                            NULL, dtohl(bagPtr->parent.ident), strings);
+                    const int N = dtohl(bagPtr->count);
+                    const uint8_t* baseMapPtr = (const uint8_t*)ent;
+                    size_t mapOffset = esize;
+                    const ResTable_map* mapPtr = (const ResTable_map*)(baseMapPtr+mapOffset);
+                    for (int i=0; i<N && mapOffset < (typeSize-sizeof(ResTable_map)); i++) {
+                        value.copyFrom_dtoh(mapPtr->value);
+                        visitor->visitBagItem(dtohl(mapPtr->name.ident), value, strings);
+                        const size_t size = dtohs(mapPtr->value.size);
+                        mapOffset += size + sizeof(*mapPtr)-sizeof(mapPtr->value);
+                        mapPtr = (const ResTable_map*)(baseMapPtr+mapOffset);
+                    }
+                }
+            }
+        }
+    }
+}
+
 }   // namespace android
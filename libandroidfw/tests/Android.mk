@@ -0,0 +1,38 @@
+# Copyright (C) 2026 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH:= $(call my-dir)
+
+# Host unit tests for libandroidfw
+# =====================================================
+
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := libandroidfw_tests
+LOCAL_SRC_FILES := ResTable_test.cpp
+LOCAL_C_INCLUDES := \
+    $(LOCAL_PATH)/../../include \
+    system/core/include
+LOCAL_STATIC_LIBRARIES := \
+    libandroidfw_static \
+    libziparchive \
+    libbase \
+    libutils \
+    liblog \
+    libcutils \
+    libz
+
+LOCAL_CFLAGS += -Wall -Werror -Wunused -Wunreachable-code
+
+include $(BUILD_HOST_NATIVE_TEST)
@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2026 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <androidfw/ResourceTypes.h>
+
+#include <gtest/gtest.h>
+
+#include <string.h>
+#include <vector>
+
+using namespace android;
+
+namespace {
+
+// Package 0x7f with two types of kEntryCount integers each, all in the
+// default configuration.  Entry e of type t holds valueOf(t, e).
+const uint32_t kPackageId = 0x7f;
+const uint32_t kTypeCount = 2;
+const uint32_t kEntryCount = 3;
+
+uint32_t valueOf(uint32_t t, uint32_t e) {
+    return 0x100 * (t + 1) + e;
+}
+
+template <typename T>
+void append(std::vector<uint8_t>* out, const T& value) {
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(&value);
+    out->insert(out->end(), p, p + sizeof(value));
+}
+
+void append(std::vector<uint8_t>* out, const std::vector<uint8_t>& data) {
+    out->insert(out->end(), data.begin(), data.end());
+}
+
+// Sets the size of the chunk that starts at "start" to run to the end.
+void finishChunk(std::vector<uint8_t>* out, size_t start) {
+    ResChunk_header* header = reinterpret_cast<ResChunk_header*>(&(*out)[start]);
+    header->size = out->size() - start;
+}
+
+std::vector<uint8_t> buildStringPool(const char* const* strings, size_t count) {
+    std::vector<uint8_t> chars;
+    std::vector<uint32_t> offsets;
+    for (size_t i = 0; i < count; i++) {
+        offsets.push_back(chars.size());
+        const size_t len = strlen(strings[i]);
+        append(&chars, (uint16_t) len);
+        for (size_t j = 0; j < len; j++) {
+            append(&chars, (uint16_t) strings[i][j]);
+        }
+        append(&chars, (uint16_t) 0);
+    }
+    while (chars.size() % 4 != 0) {
+        chars.push_back(0);
+    }
+
+    ResStringPool_header header;
+    memset(&header, 0, sizeof(header));
+    header.header.type = RES_STRING_POOL_TYPE;
+    header.header.headerSize = sizeof(header);
+    header.stringCount = count;
+    header.stringsStart = count > 0 ? sizeof(header) + 4 * count : 0;
+
+    std::vector<uint8_t> out;
+    append(&out, header);
+    for (size_t i = 0; i < count; i++) {
+        append(&out, offsets[i]);
+    }
+    append(&out, chars);
+    finishChunk(&out, 0);
+    return out;
+}
+
+std::vector<uint8_t> buildTable() {
+    static const char* const kTypeNames[kTypeCount] = { "first", "second" };
+    static const char* const kKeyNames[kEntryCount] = { "a", "b", "c" };
+
+    std::vector<uint8_t> out;
+
+    ResTable_header tableHeader;
+    memset(&tableHeader, 0, sizeof(tableHeader));
+    tableHeader.header.type = RES_TABLE_TYPE;
+    tableHeader.header.headerSize = sizeof(tableHeader);
+    tableHeader.packageCount = 1;
+    append(&out, tableHeader);
+    append(&out, buildStringPool(NULL, 0));
+
+    const size_t packageStart = out.size();
+    const std::vector<uint8_t> typeStrings = buildStringPool(kTypeNames, kTypeCount);
+    const std::vector<uint8_t> keyStrings = buildStringPool(kKeyNames, kEntryCount);
+
+    ResTable_package package;
+    memset(&package, 0, sizeof(package));
+    package.header.type = RES_TABLE_PACKAGE_TYPE;
+    package.header.headerSize = sizeof(package);
+    package.id = kPackageId;
+    const char* name = "com.example";
+    for (size_t i = 0; name[i] != '\0'; i++) {
+        package.name[i] = name[i];
+    }
+    package.typeStrings = sizeof(package);
+    package.lastPublicType = kTypeCount;
+    package.keyStrings = sizeof(package) + typeStrings.size();
+    package.lastPublicKey = kEntryCount;
+    append(&out, package);
+    append(&out, typeStrings);
+    append(&out, keyStrings);
+
+    for (uint32_t t = 0; t < kTypeCount; t++) {
+        const size_t specStart = out.size();
+        ResTable_typeSpec spec;
+        memset(&spec, 0, sizeof(spec));
+        spec.header.type = RES_TABLE_TYPE_SPEC_TYPE;
+        spec.header.headerSize = sizeof(spec);
+        spec.id = t + 1;
+        spec.entryCount = kEntryCount;
+        append(&out, spec);
+        for (uint32_t e = 0; e < kEntryCount; e++) {
+            append(&out, (uint32_t) 0);
+        }
+        finishChunk(&out, specStart);
+
+        const size_t typeStart = out.size();
+        ResTable_type type;
+        memset(&type, 0, sizeof(type));
+        type.header.type = RES_TABLE_TYPE_TYPE;
+        type.header.headerSize = sizeof(type);
+        type.id = t + 1;
+        type.entryCount = kEntryCount;
+        type.entriesStart = sizeof(type) + 4 * kEntryCount;
+        type.config.size = sizeof(ResTable_config);
+        append(&out, type);
+        for (uint32_t e = 0; e < kEntryCount; e++) {
+            append(&out, (uint32_t) (e * (sizeof(ResTable_entry) + sizeof(Res_value))));
+        }
+        for (uint32_t e = 0; e < kEntryCount; e++) {
+            ResTable_entry entry;
+            memset(&entry, 0, sizeof(entry));
+            entry.size = sizeof(entry);
+            entry.key.index = e;
+            append(&out, entry);
+
+            Res_value value;
+            memset(&value, 0, sizeof(value));
+            value.size = sizeof(value);
+            value.dataType = Res_value::TYPE_INT_DEC;
+            value.data = valueOf(t, e);
+            append(&out, value);
+        }
+        finishChunk(&out, typeStart);
+    }
+
+    finishChunk(&out, packageStart);
+    finishChunk(&out, 0);
+    return out;
+}
+
+void expectValues(const ResTable& table) {
+    for (uint32_t t = 0; t < kTypeCount; t++) {
+        for (uint32_t e = 0; e < kEntryCount; e++) {
+            const uint32_t resId = Res_MAKEID(kPackageId - 1, t, e);
+            Res_value value;
+            ASSERT_GE(table.getResource(resId, &value, false), 0)
+                    << "resource 0x" << std::hex << resId;
+            EXPECT_EQ(valueOf(t, e), value.data) << "resource 0x" << std::hex << resId;
+        }
+    }
+}
+
+} // namespace
+
+TEST(ResTableTest, resolvesEachTypeOfATableSeparately) {
+    const std::vector<uint8_t> data = buildTable();
+    ResTable table;
+    ASSERT_EQ(NO_ERROR, table.add(data.data(), data.size()));
+
+    ResTable_config config;
+    memset(&config, 0, sizeof(config));
+    config.size = sizeof(config);
+    table.setParameters(&config);
+
+    // Well past the point where every type has its own resolution table.
+    for (int round = 0; round < 32; round++) {
+        expectValues(table);
+    }
+}
+
+TEST(ResTableTest, resolvesEachTypeOfACopiedTableSeparately) {
+    // AssetManager shares tables this way; the copy's package groups are
+    // built by add(ResTable*) rather than by parsing.
+    const std::vector<uint8_t> data = buildTable();
+    ResTable src;
+    ASSERT_EQ(NO_ERROR, src.add(data.data(), data.size()));
+    ResTable table;
+    ASSERT_EQ(NO_ERROR, table.add(&src));
+
+    ResTable_config config;
+    memset(&config, 0, sizeof(config));
+    config.size = sizeof(config);
+    table.setParameters(&config);
+
+    // The same config in both types, interleaved, until both have a
+    // resolution table: each must keep answering for its own type.
+    for (int round = 0; round < 32; round++) {
+        expectValues(table);
+    }
+}